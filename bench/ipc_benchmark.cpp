@@ -0,0 +1,441 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Ping-pong between a parent and a forked child over sasm::Semaphore (with the ping payload
+// handed over in a Shared_Memory segment), a plain POSIX named semaphore and the kernel IPC
+// baselines: pipes, eventfd, a Unix socket pair and a raw futex. Reports round trip latency
+// percentiles and round trips per second as CSV, or JSON with --json.
+// Build: g++ -std=c++17 -O2 -I.. ipc_benchmark.cpp -o ipc_benchmark -pthread -lrt
+// Usage: ipc_benchmark [round_trips] [--json]
+
+#include "sasm.h"
+
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  constexpr int warmup_round_trips{ 1000 };
+
+  // One notification channel per direction: 0 is parent -> child, 1 is child -> parent.
+  // Everything is created before fork() and inherited by the child.
+  class Transport
+  {
+  public:
+    virtual const char* name() const = 0;
+    virtual void post(int direction) = 0;
+    virtual void wait(int direction) = 0;
+    virtual ~Transport() = default;
+  };
+
+  // Ping writes a sequence number into the segment, pong checks it, so this is a real handoff
+  class Sasm_Semaphore_Transport : public Transport
+  {
+    sasm::Shared_Memory memory;
+    sasm::Semaphore semaphores[2];
+
+  public:
+    std::uint64_t sent{ 0 };
+
+    const char* name() const override { return "sasm_semaphore"; }
+
+    void post(int direction) override
+    {
+      std::uint64_t* payload = static_cast<std::uint64_t*>(this->memory.get_address());
+      payload[direction] = ++this->sent;
+      this->semaphores[direction].increment();
+    }
+
+    void wait(int direction) override
+    {
+      this->semaphores[direction].wait();
+      std::uint64_t* payload = static_cast<std::uint64_t*>(this->memory.get_address());
+
+      if (payload[direction] != ++this->sent)
+      {
+        std::fprintf(stderr, "sasm_semaphore: lost a handoff\n");
+        _exit(1);
+      }
+    }
+
+    bool ok() const
+    {
+      return this->memory.get_address() != nullptr && this->semaphores[0].get_object() != nullptr && this->semaphores[1].get_object() != nullptr;
+    }
+
+    // Semaphores aren't safe to copy, so no temporaries in an initializer list
+    Sasm_Semaphore_Transport()
+      : memory{ "/sasm_ipc_benchmark_payload", 4096 }
+    {
+      this->semaphores[0].create("/sasm_ipc_benchmark_ping", 0);
+      this->semaphores[1].create("/sasm_ipc_benchmark_pong", 0);
+    }
+  };
+
+  class Posix_Semaphore_Transport : public Transport
+  {
+    sem_t* semaphores[2]{ SEM_FAILED, SEM_FAILED };
+
+  public:
+    const char* name() const override { return "posix_semaphore"; }
+
+    void post(int direction) override
+    {
+      sem_post(this->semaphores[direction]);
+    }
+
+    void wait(int direction) override
+    {
+      while (sem_wait(this->semaphores[direction]) == -1 && errno == EINTR)
+      {
+      }
+    }
+
+    bool ok() const
+    {
+      return this->semaphores[0] != SEM_FAILED && this->semaphores[1] != SEM_FAILED;
+    }
+
+    Posix_Semaphore_Transport()
+    {
+      const char* names[2]{ "/sasm_ipc_benchmark_posix_ping", "/sasm_ipc_benchmark_posix_pong" };
+
+      // The mapping survives fork(), so the names can go right away
+      for (int i = 0; i < 2; ++i)
+      {
+        sem_unlink(names[i]);
+        this->semaphores[i] = sem_open(names[i], O_CREAT | O_EXCL, 0600, 0);
+        sem_unlink(names[i]);
+      }
+    }
+
+    ~Posix_Semaphore_Transport() override
+    {
+      for (sem_t* semaphore : this->semaphores)
+      {
+        if (semaphore != SEM_FAILED)
+        {
+          sem_close(semaphore);
+        }
+      }
+    }
+  };
+
+  // Shared by the transports that move a byte or a counter through a file descriptor
+  class Descriptor_Transport : public Transport
+  {
+  protected:
+    int write_fds[2]{ -1, -1 };
+    int read_fds[2]{ -1, -1 };
+    std::size_t message_size{ 1 };
+
+  public:
+    void post(int direction) override
+    {
+      std::uint64_t message = 1;
+
+      while (write(this->write_fds[direction], &message, this->message_size) == -1 && errno == EINTR)
+      {
+      }
+    }
+
+    void wait(int direction) override
+    {
+      std::uint64_t message = 0;
+
+      while (read(this->read_fds[direction], &message, this->message_size) == -1 && errno == EINTR)
+      {
+      }
+    }
+
+    bool ok() const
+    {
+      return this->write_fds[0] != -1 && this->write_fds[1] != -1 && this->read_fds[0] != -1 && this->read_fds[1] != -1;
+    }
+
+    ~Descriptor_Transport() override
+    {
+      for (int i = 0; i < 2; ++i)
+      {
+        if (this->write_fds[i] != -1)
+        {
+          close(this->write_fds[i]);
+        }
+
+        if (this->read_fds[i] != -1 && this->read_fds[i] != this->write_fds[i])
+        {
+          close(this->read_fds[i]);
+        }
+      }
+    }
+  };
+
+  class Pipe_Transport : public Descriptor_Transport
+  {
+  public:
+    const char* name() const override { return "pipe"; }
+
+    Pipe_Transport()
+    {
+      for (int i = 0; i < 2; ++i)
+      {
+        int fds[2];
+
+        if (pipe(fds) == 0)
+        {
+          this->read_fds[i] = fds[0];
+          this->write_fds[i] = fds[1];
+        }
+      }
+    }
+  };
+
+  class Eventfd_Transport : public Descriptor_Transport
+  {
+  public:
+    const char* name() const override { return "eventfd"; }
+
+    Eventfd_Transport()
+    {
+      // eventfd reads and writes are always 8 bytes
+      this->message_size = sizeof(std::uint64_t);
+
+      for (int i = 0; i < 2; ++i)
+      {
+        this->read_fds[i] = this->write_fds[i] = eventfd(0, 0);
+      }
+    }
+  };
+
+  class Socket_Transport : public Descriptor_Transport
+  {
+  public:
+    const char* name() const override { return "unix_socket"; }
+
+    Socket_Transport()
+    {
+      int fds[2];
+
+      // One stream socket pair carries both directions, each side reads what the other wrote
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0)
+      {
+        this->write_fds[0] = fds[0];
+        this->read_fds[0] = fds[1];
+        this->write_fds[1] = fds[1];
+        this->read_fds[1] = fds[0];
+      }
+    }
+
+    ~Socket_Transport() override
+    {
+      if (this->write_fds[0] != -1)
+      {
+        close(this->write_fds[0]);
+        close(this->write_fds[1]);
+      }
+
+      this->write_fds[0] = this->write_fds[1] = this->read_fds[0] = this->read_fds[1] = -1;
+    }
+  };
+
+  // The floor for anything futex based: one flag word per direction, no counting, no spinning
+  class Futex_Transport : public Transport
+  {
+    sasm::Shared_Memory memory;
+
+    std::atomic<std::uint32_t>* word(int direction) const
+    {
+      return static_cast<std::atomic<std::uint32_t>*>(this->memory.get_address()) + direction;
+    }
+
+  public:
+    const char* name() const override { return "raw_futex"; }
+
+    void post(int direction) override
+    {
+      this->word(direction)->store(1, std::memory_order_release);
+      sasm::detail::futex_wake(this->word(direction), 1);
+    }
+
+    void wait(int direction) override
+    {
+      while (this->word(direction)->exchange(0, std::memory_order_acquire) == 0)
+      {
+        sasm::detail::futex_wait(this->word(direction), 0, nullptr);
+      }
+    }
+
+    bool ok() const
+    {
+      return this->memory.get_address() != nullptr;
+    }
+
+    Futex_Transport()
+    {
+      this->memory.create_anonymous(4096);
+    }
+  };
+
+  struct Result
+  {
+    const char* transport;
+    int round_trips;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+    double round_trips_per_second;
+  };
+
+  double percentile(const std::vector<double>& sorted, double fraction)
+  {
+    std::size_t index = static_cast<std::size_t>(fraction * (sorted.size() - 1));
+    return sorted[index];
+  }
+
+  // Child answers every ping with a pong. The parent times each round trip.
+  bool run(Transport& transport, int round_trips, Result& result)
+  {
+    int total = warmup_round_trips + round_trips;
+    pid_t child = fork();
+
+    if (child == -1)
+    {
+      return false;
+    }
+
+    // Children leave with _exit, destructors would close (and unlink) the parent's objects
+    if (child == 0)
+    {
+      for (int i = 0; i < total; ++i)
+      {
+        transport.wait(0);
+        transport.post(1);
+      }
+
+      _exit(0);
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(round_trips);
+    Clock::time_point start;
+
+    for (int i = 0; i < total; ++i)
+    {
+      if (i == warmup_round_trips)
+      {
+        start = Clock::now();
+      }
+
+      Clock::time_point sent = Clock::now();
+      transport.post(0);
+      transport.wait(1);
+
+      if (i >= warmup_round_trips)
+      {
+        latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - sent).count());
+      }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    std::sort(latencies.begin(), latencies.end());
+    result.transport = transport.name();
+    result.round_trips = round_trips;
+    result.p50_ns = percentile(latencies, 0.5);
+    result.p99_ns = percentile(latencies, 0.99);
+    result.p999_ns = percentile(latencies, 0.999);
+    result.max_ns = latencies.back();
+    result.round_trips_per_second = round_trips / elapsed;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int round_trips = 100000;
+  bool json = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--json") == 0)
+    {
+      json = true;
+    }
+    else
+    {
+      round_trips = std::atoi(argv[i]);
+    }
+  }
+
+  round_trips = round_trips < 1000 ? 1000 : round_trips;
+
+  shm_unlink("/sasm_ipc_benchmark_payload");
+  shm_unlink("/sasm_ipc_benchmark_ping.sem");
+  shm_unlink("/sasm_ipc_benchmark_pong.sem");
+
+  Sasm_Semaphore_Transport sasm_semaphore;
+  Posix_Semaphore_Transport posix_semaphore;
+  Pipe_Transport pipe_transport;
+  Eventfd_Transport eventfd_transport;
+  Socket_Transport socket_transport;
+  Futex_Transport futex_transport;
+
+  if (!sasm_semaphore.ok() || !posix_semaphore.ok() || !pipe_transport.ok() || !eventfd_transport.ok() || !socket_transport.ok() || !futex_transport.ok())
+  {
+    std::fprintf(stderr, "failed to create a transport\n");
+    return 1;
+  }
+
+  Transport* transports[]{ &sasm_semaphore, &posix_semaphore, &pipe_transport, &eventfd_transport, &socket_transport, &futex_transport };
+  std::vector<Result> results;
+
+  for (Transport* transport : transports)
+  {
+    Result result{};
+
+    if (!run(*transport, round_trips, result))
+    {
+      std::fprintf(stderr, "%s: child failed\n", transport->name());
+      return 1;
+    }
+
+    results.push_back(result);
+  }
+
+  if (json)
+  {
+    std::printf("[\n");
+
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+      const Result& r = results[i];
+      std::printf("  {\"transport\": \"%s\", \"round_trips\": %d, \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f, \"round_trips_per_second\": %.0f}%s\n",
+        r.transport, r.round_trips, r.p50_ns, r.p99_ns, r.p999_ns, r.max_ns, r.round_trips_per_second, i + 1 < results.size() ? "," : "");
+    }
+
+    std::printf("]\n");
+  }
+  else
+  {
+    std::printf("transport,round_trips,p50_ns,p99_ns,p999_ns,max_ns,round_trips_per_second\n");
+
+    for (const Result& r : results)
+    {
+      std::printf("%s,%d,%.0f,%.0f,%.0f,%.0f,%.0f\n", r.transport, r.round_trips, r.p50_ns, r.p99_ns, r.p999_ns, r.max_ns, r.round_trips_per_second);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,164 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Allocation throughput of the shared memory pmr resources against new/delete.
+// Build: g++ -std=c++17 -O2 -I.. pmr_benchmark.cpp -o pmr_benchmark -pthread -lrt
+
+#include "sasm.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+  constexpr std::size_t operation_count{ 2000000 };
+  constexpr std::size_t live_limit{ 4096 };
+  constexpr std::size_t segment_size{ std::size_t{ 512 } << 20 };
+
+  // Mixed small/medium sizes, same sequence for every resource
+  std::vector<std::size_t> make_sizes()
+  {
+    std::mt19937 rng{ 42 };
+    std::vector<std::size_t> sizes(operation_count);
+
+    for (std::size_t& size : sizes)
+    {
+      size = (rng() % 8 == 0) ? 2048 + rng() % 16384 : 8 + rng() % 512;
+    }
+
+    return sizes;
+  }
+
+  // Allocates into a ring of live_limit slots, freeing whatever was there before
+  template <typename Allocate, typename Deallocate>
+  double churn(const std::vector<std::size_t>& sizes, Allocate allocate, Deallocate deallocate)
+  {
+    std::vector<std::pair<void*, std::size_t>> live(live_limit, { nullptr, 0 });
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < sizes.size(); ++i)
+    {
+      std::pair<void*, std::size_t>& slot = live[i % live_limit];
+
+      if (slot.first != nullptr)
+      {
+        deallocate(slot.first, slot.second);
+      }
+
+      slot = { allocate(sizes[i]), sizes[i] };
+    }
+
+    for (std::pair<void*, std::size_t>& slot : live)
+    {
+      if (slot.first != nullptr)
+      {
+        deallocate(slot.first, slot.second);
+      }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return sizes.size() / elapsed.count();
+  }
+
+  // Build-once workload: allocate only
+  template <typename Allocate>
+  double build(const std::vector<std::size_t>& sizes, std::size_t count, Allocate allocate)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      allocate(sizes[i]);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return count / elapsed.count();
+  }
+
+  template <typename Vector>
+  double fill_vector(Vector& vector)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < operation_count; ++i)
+    {
+      vector.push_back(i);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return operation_count / elapsed.count();
+  }
+}
+
+int main()
+{
+  std::vector<std::size_t> sizes = make_sizes();
+
+#ifndef _WIN32
+  // Leftovers from an interrupted run would start out partially used
+  shm_unlink("/sasm_pmr_benchmark_pool");
+  shm_unlink("/sasm_pmr_benchmark_monotonic");
+#endif
+
+  sasm::Shared_Pool_Resource pool("/sasm_pmr_benchmark_pool", segment_size);
+  sasm::Shared_Monotonic_Resource monotonic("/sasm_pmr_benchmark_monotonic", segment_size);
+
+  if (pool.get_arena().get_capacity() == 0 || monotonic.get_capacity() == 0)
+  {
+    std::fprintf(stderr, "failed to create shared memory segments\n");
+    return 1;
+  }
+
+  std::printf("workload,resource,ops_per_second\n");
+
+  double rate = churn(sizes,
+    [](std::size_t size) { return ::operator new(size); },
+    [](void* pointer, std::size_t) { ::operator delete(pointer); });
+  std::printf("churn,new_delete,%.0f\n", rate);
+
+  rate = churn(sizes,
+    [&](std::size_t size) { return pool.allocate(size); },
+    [&](void* pointer, std::size_t size) { pool.deallocate(pointer, size); });
+  std::printf("churn,shared_pool,%.0f\n", rate);
+
+  // Build-once: a share of the sizes that comfortably fits in one segment
+  std::size_t build_count = operation_count / 10;
+  void* volatile sink = nullptr;
+  std::vector<void*> built;
+  built.reserve(build_count);
+
+  rate = build(sizes, build_count, [&](std::size_t size) { built.push_back(::operator new(size)); });
+  std::printf("build,new_delete,%.0f\n", rate);
+
+  for (void* pointer : built)
+  {
+    ::operator delete(pointer);
+  }
+
+  rate = build(sizes, build_count, [&](std::size_t size) { sink = monotonic.allocate(size); });
+  std::printf("build,shared_monotonic,%.0f\n", rate);
+
+  rate = build(sizes, build_count, [&](std::size_t size) { sink = pool.allocate(size); });
+  std::printf("build,shared_pool,%.0f\n", rate);
+
+  {
+    std::vector<std::size_t> vector;
+    rate = fill_vector(vector);
+    std::printf("vector_push_back,new_delete,%.0f\n", rate);
+  }
+
+  {
+    monotonic.reset();
+    std::pmr::vector<std::size_t> vector{ &monotonic };
+    rate = fill_vector(vector);
+    std::printf("vector_push_back,shared_monotonic,%.0f\n", rate);
+  }
+
+  (void)sink;
+
+  return 0;
+}
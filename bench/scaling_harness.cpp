@@ -0,0 +1,449 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Multi-process scaling harness: N producers and M consumers share a bounded buffer in a
+// Shared_Memory segment, guarded by the classic empty / full / mutex Semaphore trio. Every
+// process is pinned with sched_setaffinity according to a placement spec built from the CPU
+// topology in /sys. Reports per process and per role throughput, queueing latency histograms
+// (producer timestamp to consumer pickup) and context switches from getrusage. Prints CSV.
+// Linux only.
+// Build: g++ -std=c++17 -O2 -I.. scaling_harness.cpp -o scaling_harness -pthread -lrt
+// Usage: scaling_harness [producers] [consumers] [placement] [seconds]
+//   placement: none | compact | spread | sockets | cpu list such as 0,2,4-7
+//     compact fills SMT siblings of a core before moving on, spread uses one thread per
+//     physical core (alternating sockets) before doubling up, sockets alternates sockets.
+
+#include "sasm.h"
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+namespace
+{
+  constexpr int max_processes{ 256 };
+  constexpr std::uint32_t capacity{ 256 };  // Below Semaphore::max_count
+  constexpr int histogram_buckets{ 64 };    // Bucket b counts latencies in [2^(b-1), 2^b) ns
+  constexpr unsigned int poll_timeout_ms{ 50 }; // How often blocked processes check for shutdown
+
+  enum Role : std::uint32_t
+  {
+    producer = 0,
+    consumer = 1
+  };
+
+  struct Message
+  {
+    std::uint64_t sent_ns;
+    std::uint64_t producer;
+  };
+
+  struct Process_Result
+  {
+    std::uint32_t role;
+    std::int32_t cpu;
+    std::uint64_t operations;
+    std::uint64_t voluntary_switches;
+    std::uint64_t involuntary_switches;
+    std::uint64_t histogram[histogram_buckets];
+  };
+
+  struct Shared_State
+  {
+    std::atomic<std::uint32_t> running;
+    std::atomic<std::uint32_t> ready;
+    std::atomic<std::uint32_t> go;
+    std::uint32_t head; // Guarded by the mutex semaphore
+    std::uint32_t tail;
+    Message ring[capacity];
+    Process_Result results[max_processes];
+  };
+
+  struct Cpu
+  {
+    int id;
+    int core;
+    int package;
+  };
+
+  const char* const memory_name{ "/sasm_scaling_harness" };
+  const char* const empty_name{ "/sasm_scaling_harness_empty" };
+  const char* const full_name{ "/sasm_scaling_harness_full" };
+  const char* const mutex_name{ "/sasm_scaling_harness_mutex" };
+
+  std::uint64_t now_ns()
+  {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  int read_topology_value(int cpu, const char* file)
+  {
+    std::ifstream input("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + file);
+    int value = 0;
+    return (input >> value) ? value : 0;
+  }
+
+  // CPUs this process may run on, with their core and socket
+  std::vector<Cpu> read_topology()
+  {
+    std::vector<Cpu> cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+      return cpus;
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (CPU_ISSET(cpu, &allowed))
+      {
+        cpus.push_back(Cpu{ cpu, read_topology_value(cpu, "core_id"), read_topology_value(cpu, "physical_package_id") });
+      }
+    }
+
+    return cpus;
+  }
+
+  // "0,2,4-7" style list
+  std::vector<int> parse_cpu_list(const std::string& spec)
+  {
+    std::vector<int> cpus;
+    std::size_t position = 0;
+
+    while (position < spec.size())
+    {
+      std::size_t end = spec.find(',', position);
+      end = end == std::string::npos ? spec.size() : end;
+      std::string item = spec.substr(position, end - position);
+      std::size_t dash = item.find('-');
+      int first = std::atoi(item.c_str());
+      int last = dash == std::string::npos ? first : std::atoi(item.c_str() + dash + 1);
+
+      for (int cpu = first; cpu <= last; ++cpu)
+      {
+        cpus.push_back(cpu);
+      }
+
+      position = end + 1;
+    }
+
+    return cpus;
+  }
+
+  // CPU order processes are assigned from, round robin. Empty means don't pin.
+  std::vector<int> placement_order(const std::string& spec, std::vector<Cpu> cpus)
+  {
+    std::vector<int> order;
+
+    if (spec == "none" || cpus.empty())
+    {
+      return order;
+    }
+
+    if (spec == "compact")
+    {
+      std::sort(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b)
+      {
+        return a.package != b.package ? a.package < b.package : (a.core != b.core ? a.core < b.core : a.id < b.id);
+      });
+    }
+    else if (spec == "spread" || spec == "sockets")
+    {
+      // Rank every CPU among its core's SMT siblings, and its core among the cores of its socket
+      std::vector<std::pair<int, int>> seen_cpus;  // (package, core) per CPU visited so far
+      std::vector<std::pair<int, int>> seen_cores; // Distinct (package, core)
+      std::vector<int> sibling_rank(cpus.size());
+      std::vector<int> core_rank(cpus.size());
+
+      for (std::size_t i = 0; i < cpus.size(); ++i)
+      {
+        std::pair<int, int> core{ cpus[i].package, cpus[i].core };
+        sibling_rank[i] = static_cast<int>(std::count(seen_cpus.begin(), seen_cpus.end(), core));
+        seen_cpus.push_back(core);
+
+        if (sibling_rank[i] == 0)
+        {
+          seen_cores.push_back(core);
+        }
+
+        core_rank[i] = static_cast<int>(std::count_if(seen_cores.begin(), seen_cores.end(), [&](const std::pair<int, int>& other)
+        {
+          return other.first == core.first && other != core;
+        }));
+
+        // SMT siblings take the rank of their core
+        if (sibling_rank[i] > 0)
+        {
+          core_rank[i] = core_rank[std::find(seen_cpus.begin(), seen_cpus.end(), core) - seen_cpus.begin()];
+        }
+      }
+
+      std::vector<std::size_t> indices(cpus.size());
+
+      for (std::size_t i = 0; i < indices.size(); ++i)
+      {
+        indices[i] = i;
+      }
+
+      bool spread = spec == "spread";
+      std::sort(indices.begin(), indices.end(), [&](std::size_t a, std::size_t b)
+      {
+        // spread: first siblings of every core, then second siblings. sockets: alternate sockets throughout.
+        if (spread && sibling_rank[a] != sibling_rank[b])
+        {
+          return sibling_rank[a] < sibling_rank[b];
+        }
+
+        if (core_rank[a] != core_rank[b])
+        {
+          return core_rank[a] < core_rank[b];
+        }
+
+        return cpus[a].package != cpus[b].package ? cpus[a].package < cpus[b].package : cpus[a].id < cpus[b].id;
+      });
+
+      std::vector<Cpu> sorted;
+
+      for (std::size_t index : indices)
+      {
+        sorted.push_back(cpus[index]);
+      }
+
+      cpus = sorted;
+    }
+    else
+    {
+      return parse_cpu_list(spec);
+    }
+
+    for (const Cpu& cpu : cpus)
+    {
+      order.push_back(cpu.id);
+    }
+
+    return order;
+  }
+
+  void record_latency(Process_Result& result, std::uint64_t latency_ns)
+  {
+    int bucket = 0;
+
+    while (bucket < histogram_buckets - 1 && (std::uint64_t{ 1 } << bucket) <= latency_ns)
+    {
+      ++bucket;
+    }
+
+    ++result.histogram[bucket];
+  }
+
+  // Children use the parent's Semaphores (inherited through fork) and leave with _exit, since
+  // destroying a Semaphore unlinks the name
+  void run_process(Shared_State* state, const sasm::Semaphore& empty, const sasm::Semaphore& full, const sasm::Semaphore& mutex,
+    int index, Role role, int cpu)
+  {
+    Process_Result& result = state->results[index];
+    result.role = role;
+    result.cpu = -1;
+
+    if (cpu >= 0)
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      result.cpu = sched_setaffinity(0, sizeof(set), &set) == 0 ? cpu : -1;
+    }
+
+    state->ready.fetch_add(1);
+
+    while (state->go.load() == 0)
+    {
+      std::this_thread::yield();
+    }
+
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+
+    const sasm::Semaphore& acquire = role == producer ? empty : full;
+    const sasm::Semaphore& release = role == producer ? full : empty;
+
+    while (state->running.load(std::memory_order_relaxed))
+    {
+      if (!acquire.wait(poll_timeout_ms))
+      {
+        continue;
+      }
+
+      mutex.wait();
+
+      if (role == producer)
+      {
+        state->ring[state->head % capacity] = Message{ now_ns(), static_cast<std::uint64_t>(index) };
+        ++state->head;
+        mutex.increment();
+      }
+      else
+      {
+        Message message = state->ring[state->tail % capacity];
+        ++state->tail;
+        mutex.increment();
+        std::uint64_t now = now_ns();
+        record_latency(result, now > message.sent_ns ? now - message.sent_ns : 0);
+      }
+
+      release.increment();
+      ++result.operations;
+    }
+
+    struct rusage after;
+    getrusage(RUSAGE_SELF, &after);
+    result.voluntary_switches = static_cast<std::uint64_t>(after.ru_nvcsw - before.ru_nvcsw);
+    result.involuntary_switches = static_cast<std::uint64_t>(after.ru_nivcsw - before.ru_nivcsw);
+  }
+
+  // Upper bound of the bucket holding the given fraction of samples
+  std::uint64_t histogram_percentile(const std::uint64_t* histogram, double fraction)
+  {
+    std::uint64_t total = 0;
+
+    for (int bucket = 0; bucket < histogram_buckets; ++bucket)
+    {
+      total += histogram[bucket];
+    }
+
+    std::uint64_t target = static_cast<std::uint64_t>(fraction * total);
+    std::uint64_t seen = 0;
+
+    for (int bucket = 0; bucket < histogram_buckets; ++bucket)
+    {
+      seen += histogram[bucket];
+
+      if (total != 0 && seen > target)
+      {
+        return std::uint64_t{ 1 } << bucket;
+      }
+    }
+
+    return 0;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int producers = argc > 1 ? std::atoi(argv[1]) : 1;
+  int consumers = argc > 2 ? std::atoi(argv[2]) : 1;
+  std::string placement = argc > 3 ? argv[3] : "compact";
+  double seconds = argc > 4 ? std::atof(argv[4]) : 2.0;
+
+  if (producers < 1 || consumers < 1 || producers + consumers > max_processes)
+  {
+    std::fprintf(stderr, "need 1..%d producers + consumers in total\n", max_processes);
+    return 1;
+  }
+
+  std::vector<Cpu> topology = read_topology();
+  std::vector<int> order = placement_order(placement, topology);
+
+  shm_unlink(memory_name);
+  sasm::Shared_Memory memory(memory_name, sizeof(Shared_State));
+  sasm::Semaphore empty(empty_name, static_cast<int>(capacity));
+  sasm::Semaphore full(full_name, 0);
+  sasm::Semaphore mutex(mutex_name, 1);
+
+  if (memory.get_address() == nullptr || empty.get_object() == nullptr || full.get_object() == nullptr || mutex.get_object() == nullptr)
+  {
+    std::fprintf(stderr, "failed to create shared memory / semaphores\n");
+    return 1;
+  }
+
+  Shared_State* state = new (memory.get_address()) Shared_State{};
+  state->running.store(1);
+  int process_count = producers + consumers;
+
+  for (int i = 0; i < process_count; ++i)
+  {
+    Role role = i < producers ? producer : consumer;
+    int cpu = order.empty() ? -1 : order[i % order.size()];
+
+    if (fork() == 0)
+    {
+      run_process(state, empty, full, mutex, i, role, cpu);
+      _exit(0);
+    }
+  }
+
+  while (state->ready.load() != static_cast<std::uint32_t>(process_count))
+  {
+    std::this_thread::yield();
+  }
+
+  state->go.store(1);
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  state->running.store(0);
+
+  while (wait(nullptr) > 0)
+  {
+  }
+
+  std::printf("# topology: %zu cpus, placement %s, %d producers, %d consumers, %.1f s\n", topology.size(), placement.c_str(), producers, consumers, seconds);
+  std::printf("scope,role,cpu,operations_per_second,p50_ns,p99_ns,p999_ns,voluntary_switches,involuntary_switches\n");
+
+  const char* role_names[2]{ "producer", "consumer" };
+  Process_Result totals[2]{};
+
+  for (int i = 0; i < process_count; ++i)
+  {
+    const Process_Result& result = state->results[i];
+    Process_Result& total = totals[result.role];
+
+    total.operations += result.operations;
+    total.voluntary_switches += result.voluntary_switches;
+    total.involuntary_switches += result.involuntary_switches;
+
+    for (int bucket = 0; bucket < histogram_buckets; ++bucket)
+    {
+      total.histogram[bucket] += result.histogram[bucket];
+    }
+
+    // Latency is measured on the consumer side only
+    bool has_latency = result.role == consumer;
+    std::printf("process_%d,%s,%d,%.0f,%llu,%llu,%llu,%llu,%llu\n", i, role_names[result.role], result.cpu, result.operations / seconds,
+      has_latency ? static_cast<unsigned long long>(histogram_percentile(result.histogram, 0.5)) : 0ull,
+      has_latency ? static_cast<unsigned long long>(histogram_percentile(result.histogram, 0.99)) : 0ull,
+      has_latency ? static_cast<unsigned long long>(histogram_percentile(result.histogram, 0.999)) : 0ull,
+      static_cast<unsigned long long>(result.voluntary_switches), static_cast<unsigned long long>(result.involuntary_switches));
+  }
+
+  for (std::uint32_t role = producer; role <= consumer; ++role)
+  {
+    const Process_Result& total = totals[role];
+    bool has_latency = role == consumer;
+    std::printf("total,%s,-1,%.0f,%llu,%llu,%llu,%llu,%llu\n", role_names[role], total.operations / seconds,
+      has_latency ? static_cast<unsigned long long>(histogram_percentile(total.histogram, 0.5)) : 0ull,
+      has_latency ? static_cast<unsigned long long>(histogram_percentile(total.histogram, 0.99)) : 0ull,
+      has_latency ? static_cast<unsigned long long>(histogram_percentile(total.histogram, 0.999)) : 0ull,
+      static_cast<unsigned long long>(total.voluntary_switches), static_cast<unsigned long long>(total.involuntary_switches));
+  }
+
+  // Latency histogram of all consumers, non empty buckets only
+  std::printf("\nlatency_upper_bound_ns,count\n");
+
+  for (int bucket = 0; bucket < histogram_buckets; ++bucket)
+  {
+    if (totals[consumer].histogram[bucket] != 0)
+    {
+      std::printf("%llu,%llu\n", static_cast<unsigned long long>(std::uint64_t{ 1 } << bucket), static_cast<unsigned long long>(totals[consumer].histogram[bucket]));
+    }
+  }
+
+  return 0;
+}
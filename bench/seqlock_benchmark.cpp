@@ -0,0 +1,194 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Read throughput of a ~4 KiB snapshot published through Seqlocked<T> versus a Semaphore used
+// as a mutex, as the number of reader processes grows. One writer process republishes the
+// snapshot continuously. Prints CSV.
+// Build: g++ -std=c++17 -O2 -I.. seqlock_benchmark.cpp -o seqlock_benchmark -pthread -lrt
+// Usage: seqlock_benchmark [max_readers] [seconds_per_step]
+
+#include "sasm.h"
+
+#include <sys/wait.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+  struct Snapshot
+  {
+    std::uint64_t version;
+    std::uint64_t values[510];
+    std::uint64_t checksum; // version ^ values[0] ^ values[509], catches torn reads
+  };
+
+  struct Shared_State
+  {
+    std::atomic<std::uint32_t> running;
+    std::atomic<std::uint32_t> ready;
+    Snapshot locked_snapshot; // Guarded by the semaphore
+    std::atomic<std::uint64_t> reads[256];
+    std::atomic<std::uint64_t> torn[256];
+    sasm::Seqlocked<Snapshot> seqlocked;
+  };
+
+  const char* const memory_name{ "/sasm_seqlock_benchmark" };
+  const char* const mutex_name{ "/sasm_seqlock_benchmark_mutex" };
+
+  void fill(Snapshot& snapshot, std::uint64_t version)
+  {
+    snapshot.version = version;
+
+    for (std::uint64_t& value : snapshot.values)
+    {
+      value = version * 31;
+    }
+
+    snapshot.checksum = version ^ snapshot.values[0] ^ snapshot.values[509];
+  }
+
+  bool intact(const Snapshot& snapshot)
+  {
+    return snapshot.checksum == (snapshot.version ^ snapshot.values[0] ^ snapshot.values[509]);
+  }
+
+  // Children use the parent's Semaphore (inherited through fork) and leave with _exit, since
+  // destroying a Semaphore unlinks the name
+  void writer(Shared_State* state, const sasm::Semaphore& mutex, bool use_seqlock)
+  {
+    Snapshot snapshot;
+
+    for (std::uint64_t version = 1; state->running.load(std::memory_order_relaxed); ++version)
+    {
+      fill(snapshot, version);
+
+      if (use_seqlock)
+      {
+        state->seqlocked.store(snapshot);
+      }
+      else
+      {
+        mutex.wait();
+        state->locked_snapshot = snapshot;
+        mutex.increment();
+      }
+    }
+  }
+
+  void reader(Shared_State* state, const sasm::Semaphore& mutex, int index, bool use_seqlock)
+  {
+    Snapshot snapshot;
+    std::uint64_t reads = 0;
+    std::uint64_t torn = 0;
+
+    state->ready.fetch_add(1);
+
+    while (state->running.load(std::memory_order_relaxed))
+    {
+      if (use_seqlock)
+      {
+        snapshot = state->seqlocked.load();
+      }
+      else
+      {
+        mutex.wait();
+        snapshot = state->locked_snapshot;
+        mutex.increment();
+      }
+
+      torn += intact(snapshot) ? 0 : 1;
+      ++reads;
+    }
+
+    state->reads[index].store(reads);
+    state->torn[index].store(torn);
+  }
+
+  // Runs one writer and reader_count readers for the given time, returns reads per second
+  double run(Shared_State* state, const sasm::Semaphore& mutex, int reader_count, double seconds, bool use_seqlock, std::uint64_t& torn)
+  {
+    state->running.store(1);
+    state->ready.store(0);
+
+    pid_t writer_pid = fork();
+
+    if (writer_pid == 0)
+    {
+      writer(state, mutex, use_seqlock);
+      _exit(0);
+    }
+
+    for (int i = 0; i < reader_count; ++i)
+    {
+      if (fork() == 0)
+      {
+        reader(state, mutex, i, use_seqlock);
+        _exit(0);
+      }
+    }
+
+    while (state->ready.load() != static_cast<std::uint32_t>(reader_count))
+    {
+      std::this_thread::yield();
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    state->running.store(0);
+
+    while (wait(nullptr) > 0)
+    {
+    }
+
+    std::uint64_t reads = 0;
+    torn = 0;
+
+    for (int i = 0; i < reader_count; ++i)
+    {
+      reads += state->reads[i].load();
+      torn += state->torn[i].load();
+    }
+
+    return reads / seconds;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int max_readers = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+  double seconds = argc > 2 ? std::atof(argv[2]) : 1.0;
+
+  max_readers = max_readers < 1 ? 1 : (max_readers > 256 ? 256 : max_readers);
+
+  // A crashed run can leave the mutex taken, and on Linux its count lives in name + ".sem"
+  shm_unlink(memory_name);
+  shm_unlink((std::string(mutex_name) + ".sem").c_str());
+  sasm::Shared_Memory memory(memory_name, sizeof(Shared_State));
+  sasm::Semaphore mutex(mutex_name, 1);
+
+  if (memory.get_address() == nullptr || mutex.get_object() == nullptr)
+  {
+    std::fprintf(stderr, "failed to create shared memory / semaphore\n");
+    return 1;
+  }
+
+  Shared_State* state = new (memory.get_address()) Shared_State{};
+
+  std::printf("readers,primitive,reads_per_second,torn_reads\n");
+
+  for (int readers = 1; readers <= max_readers; readers *= 2)
+  {
+    std::uint64_t torn = 0;
+    double rate = run(state, mutex, readers, seconds, true, torn);
+    std::printf("%d,seqlock,%.0f,%llu\n", readers, rate, static_cast<unsigned long long>(torn));
+
+    rate = run(state, mutex, readers, seconds, false, torn);
+    std::printf("%d,semaphore_mutex,%.0f,%llu\n", readers, rate, static_cast<unsigned long long>(torn));
+    std::fflush(stdout);
+  }
+
+  return 0;
+}
@@ -6,7 +6,23 @@
 #ifndef SEMAPHORES_AND_SHARED_MEMORY_CLASSES_H
 #define SEMAPHORES_AND_SHARED_MEMORY_CLASSES_H
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #ifdef _WIN32
 // Windows includes
@@ -14,10 +30,43 @@
 #else
 // Unix includes
 #include <fcntl.h>
+#include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <semaphore.h>
+#include <signal.h>
 #include <unistd.h>
 #include <cstring>
+#include <cerrno>
+#include <ctime>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+#ifdef __linux__
+// Linux only includes
+#include <linux/futex.h>
+#include <linux/io_uring.h>
+#include <mntent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#endif
+
+#if defined(__linux__) && defined(__cpp_impl_coroutine)
+// Coroutine reactor includes
+#include <coroutine>
+#include <exception>
+#include <map>
+#include <unordered_map>
 #endif
 
 // Define INFINITE for Unix
@@ -31,78 +80,329 @@ namespace sasm
 {
   // ********** Declarations **********
 
-  // Simple cross platform Semaphore class for Unix and Windows
+  namespace detail
+  {
+    constexpr std::size_t cache_line_size{ 64 };
+
+    // Rounds up to the next power of two (0 and 1 both become 1), 0 when that doesn't fit a size_t
+    std::size_t round_up_pow2(std::size_t value);
+
+    // offset + count * element_size into total, false if that wraps
+    bool array_end(std::size_t offset, std::size_t count, std::size_t element_size, std::size_t& total);
+
+    // Rounds up to a multiple of alignment (must be a power of two).
+    // Defined here because class layouts below use it in constant expressions.
+    constexpr std::size_t align_up(std::size_t value, std::size_t alignment)
+    {
+      return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Runs init() exactly once across every process that maps `state`.
+    // Fresh segments are zero filled, so 0 means "not initialized yet".
+    // If the initializing process dies inside init(), `state` stays "initializing" and every later
+    // caller waits forever. The initializers here are a handful of stores, so the window is tiny,
+    // but the only way out is to unlink the segment and create it again.
+    template <typename Init>
+    void initialize_once(std::atomic<std::uint32_t>& state, Init&& init);
+
+    // Spin loop hint (pause / yield instruction)
+    void cpu_relax();
+
+    // Index of the lowest set bit, value must not be 0
+    unsigned int count_trailing_zeros(std::uint32_t value);
+
+    // Minimal lock for short critical sections in shared memory, spins then yields
+    void spin_lock(std::atomic<std::uint32_t>& lock);
+    void spin_unlock(std::atomic<std::uint32_t>& lock);
+
+    // Base page size of the system
+    std::size_t system_page_size();
+
+    // Write faults every page in [address, address + size) without changing its contents
+    void touch_pages(void* address, std::size_t size, std::size_t page_size);
+
+    // Id of the calling process, and whether a process id still names a running process.
+    // Errs on the side of "alive" (no permission to query, or the id got reused).
+    std::uint32_t current_process_id();
+    bool process_alive(std::uint32_t process_id);
+
+#ifdef __linux__
+    // Mount point of a hugetlbfs whose page size is page_size, empty if there is none
+    std::string find_hugetlbfs_mount(std::size_t page_size);
+#endif
+
+    // Relaxed atomic that stays copyable, for statistics and tuning state on copyable classes
+    template <typename T>
+    struct Relaxed_Atomic
+    {
+      std::atomic<T> value{};
+
+      T load() const { return this->value.load(std::memory_order_relaxed); }
+      void store(T desired) { this->value.store(desired, std::memory_order_relaxed); }
+      void add(T amount) { this->value.fetch_add(amount, std::memory_order_relaxed); }
+
+      Relaxed_Atomic() = default;
+      Relaxed_Atomic(const Relaxed_Atomic& other) : value{ other.load() } {}
+      Relaxed_Atomic& operator=(const Relaxed_Atomic& other) { this->store(other.load()); return *this; }
+    };
+
+#ifdef __linux__
+    // Turns a relative timeout into an absolute CLOCK_MONOTONIC deadline, nullptr for INFINITE
+    const struct timespec* make_deadline(unsigned int timeout_ms, struct timespec& deadline);
+
+    // Process shared (non private) futex calls. futex_wait returns 0 or an errno value.
+    int futex_wait(std::atomic<std::uint32_t>* word, std::uint32_t expected, const struct timespec* deadline);
+    int futex_wake(std::atomic<std::uint32_t>* word, int count);
+
+    // Wakes wake_count waiters on word and moves the rest onto target, if word still holds expected.
+    // Returns 0 or an errno value (EAGAIN when word changed).
+    int futex_requeue(std::atomic<std::uint32_t>* word, std::uint32_t expected, int wake_count, std::atomic<std::uint32_t>* target);
+
+    // Not in every set of kernel headers yet
+    constexpr long sys_io_uring_setup{ 425 };
+    constexpr long sys_io_uring_enter{ 426 };
+    constexpr long sys_futex_waitv{ 449 };
+    constexpr std::uint8_t uring_op_futex_wait{ 51 };
+    constexpr std::uint8_t uring_op_futex_wake{ 52 };
+    constexpr std::uint32_t futex2_size_u32{ 0x02 };
+
+    // struct futex_waitv. Flags never include FUTEX2_PRIVATE, the words are process shared.
+    struct Futex_Waitv
+    {
+      std::uint64_t value;
+      std::uint64_t address;
+      std::uint32_t flags;
+      std::uint32_t reserved;
+    };
+#endif
+
+#ifndef _WIN32
+    // Passes a file descriptor plus a small payload over an AF_UNIX socket (SCM_RIGHTS).
+    // receive_fd returns the new descriptor, or -1 on failure.
+    bool send_fd(int socket, int fd, const void* data, std::size_t size);
+    int receive_fd(int socket, void* data, std::size_t size);
+#endif
+  } // namespace detail
+
+#ifdef __linux__
+  class Futex_Semaphore;
+#endif
+
+  // How Semaphore::wait behaves before (or instead of) sleeping in the kernel
+  enum class Wait_Policy
+  {
+    block,            // Sleep right away
+    spin,             // Spin with a pause hint up to spin_limit times, then sleep
+    spin_yield_block, // Spin, then yield the CPU a few times, then sleep
+    adaptive          // Spin for roughly as long as recent successful spins took, then sleep
+  };
+
+  // How Semaphore::wait calls were satisfied
+  struct Wait_Stats
+  {
+    std::uint64_t immediate{ 0 }; // Count was already positive
+    std::uint64_t spun{ 0 };      // Acquired while spinning or yielding
+    std::uint64_t blocked{ 0 };   // Went to the kernel (includes timeouts)
+  };
+
+  // Simple cross platform Semaphore class for Unix and Windows.
+  // On Linux the counter is a Futex_Semaphore in a small named shared memory object
+  // (name + ".sem"), so increment(count) is one atomic add plus at most one wake syscall.
+  // That object is not a sem_open() semaphore: on Linux a Semaphore does not interoperate with
+  // plain POSIX named semaphores of the same name.
+  // close() never releases waiters on any platform, the count is shared with every peer. To shut
+  // down, call release_all() first: one increment covering every process blocked in wait(). Only
+  // Linux knows how many that is; elsewhere it adds max_count, and the counts nobody took stay.
   class Semaphore
   {
     static constexpr int max_count{ 1024 };
+    static constexpr unsigned int default_spin_limit{ 2000 };
+    static constexpr unsigned int yield_limit{ 16 };
+
     std::string name;
+    Wait_Policy wait_policy{ Wait_Policy::block };
+    unsigned int spin_limit{ default_spin_limit };
+
+    // Per instance statistics and adaptive spin estimate, shared by all threads using this object
+    mutable detail::Relaxed_Atomic<std::uint64_t> immediate_count;
+    mutable detail::Relaxed_Atomic<std::uint64_t> spun_count;
+    mutable detail::Relaxed_Atomic<std::uint64_t> blocked_count;
+    mutable detail::Relaxed_Atomic<unsigned int> adaptive_spins;
 
 #ifdef _WIN32
     HANDLE object{ nullptr };
+#elif defined(__linux__)
+    Futex_Semaphore* object{ nullptr };
 #else
     sem_t* object{ nullptr };
 #endif
 
+    bool try_acquire() const;
+    bool spin_acquire() const;
+    bool block(unsigned int timeout_ms) const;
+
   public:
     // Getters
     const std::string& get_name() const;
     
 #ifdef _WIN32
     HANDLE get_object() const;
+#elif defined(__linux__)
+    Futex_Semaphore* get_object() const;
 #else
     sem_t* get_object() const;
 #endif
+    Wait_Policy get_wait_policy() const;
+    Wait_Stats get_wait_stats() const;
+
+    // spin_limit bounds the pause loop for every policy except block
+    void set_wait_policy(Wait_Policy policy, unsigned int max_spins = default_spin_limit);
+    void reset_wait_stats();
 
     void close();
     bool wait(unsigned int timeout_ms = INFINITE) const;
     bool increment(int count = 1) const;
+    bool release_all() const;
     bool create(const std::string& name, int initial_count = 0);
 
     // Constructor
     Semaphore(const std::string& name, int initial_count = 0);
 
-    // Ask compiler to generate these for us
-    Semaphore(const Semaphore&) = default;            // Copy constructor
-    Semaphore& operator=(const Semaphore&) = default; // Copy assignment
-    Semaphore(Semaphore&&) = default;                 // Move constructor
-    Semaphore& operator=(Semaphore&&) = default;      // Move assignment
+    // Owns the object (a mapping on Linux), so copying would double close it
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    // Moving leaves the source closed
+    Semaphore(Semaphore&& other) noexcept;
+    Semaphore& operator=(Semaphore&& other) noexcept;
 
     Semaphore() = default;
     ~Semaphore();
   };
 
+  // Creation options for Shared_Memory, combine with |
+  enum class Memory_Flags : unsigned int
+  {
+    none = 0,
+    huge_pages_2mb = 1u << 0,         // Explicit 2 MiB pages (hugetlbfs / SEC_LARGE_PAGES), else transparent huge pages
+    huge_pages_1gb = 1u << 1,         // Explicit 1 GiB pages (hugetlbfs), else transparent huge pages
+    transparent_huge_pages = 1u << 2, // Only ask for transparent huge pages (madvise(MADV_HUGEPAGE))
+    prefault = 1u << 3,               // Fault in every page at create() (MADV_POPULATE_WRITE, else touch each page)
+    prefault_parallel = 1u << 4,      // Like prefault, split across several threads for very large segments
+    lock_in_memory = 1u << 5,         // mlock / VirtualLock the mapping so it can't be swapped out
+    growable = 1u << 6                // Reserve a header so resize() can grow the segment for every attached process
+  };
+
+  // On Linux the first creator of a name picks the backing. A hugetlbfs backed segment leaves its
+  // file path in name + ".hugetlbfs", and every later create() of that name maps the same file,
+  // whatever huge page flags it passed (or fails, rather than map separate memory).
+
+  constexpr Memory_Flags operator|(Memory_Flags left, Memory_Flags right)
+  {
+    return static_cast<Memory_Flags>(static_cast<unsigned int>(left) | static_cast<unsigned int>(right));
+  }
+
+  constexpr bool operator&(Memory_Flags flags, Memory_Flags flag)
+  {
+    return (static_cast<unsigned int>(flags) & static_cast<unsigned int>(flag)) != 0;
+  }
+
   // Simple cross platform Shared_Memory class for Unix and Windows
   class Shared_Memory
   {
+    // Lives in front of the user data of growable segments
+    struct Growable_Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::atomic<std::uint64_t> generation; // Bumped every time the segment grows
+      std::atomic<std::uint64_t> size;       // Current mapped size, header included
+    };
+
+    static constexpr std::size_t growable_header_size{ detail::cache_line_size };
+
     std::string name;
-    std::size_t size{ 0 };
+    std::size_t size{ 0 }; // Mapped size, including the growable header
     void* address{ nullptr };
+    std::uint64_t generation{ 0 };
+    Memory_Flags flags{ Memory_Flags::none };
+    std::size_t page_size{ 0 };
+    bool transparent_huge_pages{ false };
+    bool locked{ false };
+    std::chrono::nanoseconds populate_time{ 0 };
 
 #ifdef _WIN32
     HANDLE file_mapping{ nullptr };
 #else
     int file_mapping{ -1 };
+    std::string hugetlbfs_path; // Set when backed by a hugetlbfs file instead of shm_open
 #endif
 
     void* map();
+    void populate(std::size_t offset = 0); // Prefaults / locks [offset, size)
+    void release(bool unlink);
+    std::size_t data_offset() const;
+    Growable_Header* get_header() const;
+#ifndef _WIN32
+    bool size_object(int fd);
+    void sync_header();
+    bool remap(std::size_t new_size);
+#endif
+#ifdef __linux__
+    // 1 when mapped from a hugetlbfs file, 0 to go on with the shm object, -1 on failure
+    int map_hugetlbfs(int rendezvous, std::size_t size);
+#endif
 
   public:
     // Getters
     const std::string& get_name() const;
     std::size_t get_size() const;
     void* get_address() const;
+    Memory_Flags get_flags() const;
+    bool is_locked() const;
+
+    // Time spent prefaulting and locking the mapping, in create() and every growth since
+    std::chrono::nanoseconds get_populate_time() const;
+
+    // Growth generation this process is currently mapped at (growable segments)
+    std::uint64_t get_generation() const;
 #ifdef _WIN32
     HANDLE get_file_mapping() const;
 #else
     int get_file_mapping() const;
 #endif
-    
+
+    // Page size actually backing the mapping. Transparent huge pages are best effort,
+    // so they report the base page size and set uses_transparent_huge_pages() instead.
+    std::size_t get_page_size() const;
+    bool uses_transparent_huge_pages() const;
 
     void close();
-    bool create(const std::string& name, std::size_t size);
+    bool create(const std::string& name, std::size_t size, Memory_Flags flags = Memory_Flags::none);
+
+    // Unmaps like close() but leaves the name in place for the other processes still attaching to it
+    void detach();
+
+    // Growable segments only (Unix). resize() grows the shared object and remaps locally, other
+    // processes pick the new size up on their next refresh(). Both may move get_address().
+    bool resize(std::size_t new_size);
+    bool refresh();
+
+#ifndef _WIN32
+    // Segments without a name (memfd_create on Linux), so nothing is left in /dev/shm and close()
+    // never unlinks anything. Peers get them through fork() or an AF_UNIX socket with
+    // send_to()/receive_from(), and the memory goes away with the last mapping.
+    bool create_anonymous(std::size_t size, Memory_Flags flags = Memory_Flags::none);
+
+    // Maps a descriptor received from a peer and takes ownership of it.
+    // Growable must match the creator's flags, receive_from() takes care of that.
+    bool attach(int fd, Memory_Flags flags = Memory_Flags::none);
+
+    bool send_to(int socket) const;
+    bool receive_from(int socket, Memory_Flags flags = Memory_Flags::none);
+#endif
 
     // Constructor
-    Shared_Memory(const std::string& name, std::size_t size);
+    Shared_Memory(const std::string& name, std::size_t size, Memory_Flags flags = Memory_Flags::none);
 
     // Ask compiler to generate these for us
     Shared_Memory(const Shared_Memory&) = default;            // Copy constructor
@@ -114,289 +414,6817 @@ namespace sasm
     ~Shared_Memory();
   };
 
-  // ********** Definitions **********
+#ifdef __linux__
+  // Process shared semaphore whose state is two 32-bit words, meant to be placed inside a
+  // Shared_Memory segment. Zero filled memory is a valid semaphore with a count of 0.
+  // wait() and increment() stay in user space unless a thread actually has to sleep.
+  class Futex_Semaphore
+  {
+    std::atomic<std::uint32_t> count{ 0 };
+    std::atomic<std::uint32_t> waiters{ 0 };
 
-  // Semaphore
+  public:
+    // Getters
+    std::uint32_t get_count() const;
+    std::uint32_t get_waiters() const;
+    std::atomic<std::uint32_t>* get_word();
 
-  inline const std::string& Semaphore::get_name() const
-  {
-    return this->name;
-  }
+    bool try_wait();
+    bool wait(unsigned int timeout_ms = INFINITE);
+    bool increment(int count = 1);
 
-#ifdef _WIN32
-  HANDLE Semaphore::get_object() const
-#else
-  sem_t* Semaphore::get_object() const
-#endif
-  {
-    return this->object;
-  }
+    // For event loops that sleep on get_word() themselves: increment() only enters the kernel
+    // while a waiter is registered, so register before the last count check and keep it until done
+    void add_waiter();
+    void remove_waiter();
 
-  inline void Semaphore::close()
+    // Constructor (use with placement new on shared memory)
+    explicit Futex_Semaphore(std::uint32_t initial_count = 0);
+
+    // Lives at a fixed address in shared memory
+    Futex_Semaphore(const Futex_Semaphore&) = delete;
+    Futex_Semaphore& operator=(const Futex_Semaphore&) = delete;
+  };
+
+  // Semaphore backed by an eventfd in semaphore mode, so it can sit in an epoll / poll set next to
+  // sockets and timers: the descriptor is readable while the count is above 0. Shared with other
+  // processes by fork() or by passing the descriptor with send_to() / receive_from().
+  // The descriptor is always non-blocking: create() opens it that way, and since the flag lives on
+  // the open file description shared by every process, attach() refuses a blocking one rather than
+  // change it under a peer.
+  class Event_Notifier
   {
-    if (this->object == nullptr)
-    {
-      return;
-    }
+    int fd{ -1 };
 
-    // Release any blocked threads.
-    this->increment(Semaphore::max_count);
+  public:
+    // Getters
+    int get_fd() const;
 
-#ifdef _WIN32
-    CloseHandle(this->object);
-#else
-    sem_close(this->object);
+    bool try_wait() const;
+    bool wait(unsigned int timeout_ms = INFINITE) const;
+    bool increment(int count = 1) const; // A single write, however large the count
 
-    if (!this->name.empty())
-    {
-      sem_unlink(this->name.data());
-    }
-#endif
+    void close();
+    bool create(unsigned int initial_count = 0);
+    bool attach(int fd); // Takes ownership of fd on success, which must be O_NONBLOCK
 
-    // Clear members
-    this->object = nullptr;
-    this->name.clear();
-  }
+    bool send_to(int socket) const;
+    bool receive_from(int socket);
 
-  inline bool Semaphore::wait(unsigned int timeout_ms) const
+    // Constructor
+    explicit Event_Notifier(unsigned int initial_count);
+
+    // Owns the descriptor
+    Event_Notifier(const Event_Notifier&) = delete;
+    Event_Notifier& operator=(const Event_Notifier&) = delete;
+
+    Event_Notifier() = default;
+    ~Event_Notifier();
+  };
+#endif
+
+#if defined(__linux__) && defined(__cpp_impl_coroutine)
+  // C++20 only. Lets one thread park any number of coroutines on Futex_Semaphore words (which
+  // includes every Linux Semaphore) with `co_await reactor.async_wait(semaphore, timeout_ms)`.
+  // run() sleeps in a single futex_waitv() across every watched word plus a control word, and
+  // resumes waiters in FIFO order per word as counts become available.
+  // Awaiting, and resuming, happen on the thread calling run(). Other threads get there with post().
+  class Reactor
   {
-    if (this->object == nullptr)
+  public:
+    class Wait_Awaiter;
+
+    // Fire and forget coroutine type, starts eagerly and frees itself when it finishes
+    struct Task
     {
-      return false;
-    }
+      struct promise_type
+      {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+      };
+    };
 
-#ifdef _WIN32
-    DWORD result = WaitForSingleObject(this->object, timeout_ms);
-    return result == WAIT_OBJECT_0;
-#else
-    if (timeout_ms == INFINITE)
+    class Wait_Awaiter
     {
-      return sem_wait(this->object) == 0;
-    }
-    else
+      friend class Reactor;
+
+      Reactor* reactor;
+      Futex_Semaphore* semaphore;
+      unsigned int timeout_ms;
+      bool acquired{ false };
+      std::coroutine_handle<> handle;
+      std::list<Wait_Awaiter*>::iterator queue_position;
+      std::multimap<std::chrono::steady_clock::time_point, Wait_Awaiter*>::iterator deadline_position;
+
+    public:
+      bool await_ready();
+      void await_suspend(std::coroutine_handle<> handle);
+      bool await_resume() const; // False on timeout
+
+      Wait_Awaiter(Reactor* reactor, Futex_Semaphore* semaphore, unsigned int timeout_ms);
+    };
+
+  private:
+    // futex_waitv() takes at most 128 words, one of them is the control word
+    static constexpr std::size_t max_watched_words{ 127 };
+
+    struct Watch
     {
-      struct timespec ts;
-      clock_gettime(CLOCK_REALTIME, &ts);
-      ts.tv_sec += timeout_ms / 1000;
-      ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+      std::list<Wait_Awaiter*> waiters;
+    };
 
-      if (ts.tv_nsec >= 1000000000)
-      {
-        ts.tv_sec += 1;
-        ts.tv_nsec -= 1000000000;
-      }
+    std::unordered_map<Futex_Semaphore*, Watch> watches;
+    std::multimap<std::chrono::steady_clock::time_point, Wait_Awaiter*> deadlines;
+    std::vector<std::coroutine_handle<>> ready;
 
-      return sem_timedwait(this->object, &ts) == 0;
-    }
+    // Bumped by post() and stop() to pull run() out of the kernel
+    std::atomic<std::uint32_t> control{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::mutex posted_lock;
+    std::vector<std::function<void()>> posted;
+
+    void enqueue(Wait_Awaiter* awaiter);
+    void complete(Wait_Awaiter* awaiter, bool acquired);
+    void collect_ready();
+    void sleep(std::uint32_t control_value);
+    void notify();
+
+  public:
+    Wait_Awaiter async_wait(const Semaphore& semaphore, unsigned int timeout_ms = INFINITE);
+    Wait_Awaiter async_wait(Futex_Semaphore& semaphore, unsigned int timeout_ms = INFINITE);
+
+    // Thread safe. Runs function on the reactor thread, e.g. to start a coroutine there.
+    void post(std::function<void()> function);
+
+    // Processes waits until stop(). Waiters still parked at that point stay suspended.
+    void run();
+    void stop();
+
+    Reactor() = default;
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+    ~Reactor();
+  };
 #endif
-  }
 
-  inline bool Semaphore::increment(int count) const
+#ifdef __linux__
+  // Completion based reactor for event loops built around io_uring. async_wait() only queues a
+  // submission: FUTEX_WAIT on a Futex_Semaphore word (Linux 6.7+) or POLL_ADD on an
+  // Event_Notifier, and run_once() submits the whole batch and reaps completions in one
+  // io_uring_enter(). Callbacks run on the thread calling run_once().
+  // Without io_uring futex support it falls back to epoll plus an eventfd, with a helper thread
+  // sleeping in futex_waitv() on the watched words, or on request through Backend::fallback.
+  // uses_io_uring() tells which one is active.
+  class Uring_Reactor
   {
-    if (this->object == nullptr)
-    {
-      return false;
-    }
+  public:
+    using Callback = std::function<void()>;
 
-#ifdef _WIN32
-    return ReleaseSemaphore(this->object, count, nullptr);
-#else
-    bool success = true;
+    enum class Backend
+    {
+      automatic, // io_uring when the kernel has futex support for it, else the fallback
+      fallback   // Always epoll plus an eventfd
+    };
 
-    for (int i = 0; i < count; ++i)
+  private:
+    // io_uring_sqe as of Linux 6.7, spelled out since older headers lack addr3
+    struct Submission
     {
-      if (sem_post(this->object) != 0)
-      {
-        success = false;
-      }
-    }
+      std::uint8_t opcode;
+      std::uint8_t flags;
+      std::uint16_t ioprio;
+      std::int32_t fd;
+      std::uint64_t offset; // addr2
+      std::uint64_t address;
+      std::uint32_t length;
+      std::uint32_t op_flags;
+      std::uint64_t user_data;
+      std::uint16_t buffer_index;
+      std::uint16_t personality;
+      std::uint32_t file_index;
+      std::uint64_t address3;
+      std::uint64_t pad;
+    };
 
-    return success;
-#endif
-  }
+    static_assert(sizeof(Submission) == 64, "io_uring submissions are 64 bytes");
 
-  inline bool Semaphore::create(const std::string& name, int initial_count = 0)
-  {
-    if (name.empty())
+    // futex_waitv() takes at most 128 words, one of them is the control word
+    static constexpr std::size_t max_watched_words{ 127 };
+
+    struct Operation
     {
-      return false;
-    }
+      Futex_Semaphore* semaphore; // One of these two is set
+      const Event_Notifier* notifier;
+      Callback callback;
+      int fd; // Fallback only: private dup of the notifier's descriptor for epoll
+      std::list<Operation>::iterator position;
+    };
 
-    this->name = name;
+    // Pending operations, their addresses double as user_data / epoll data
+    std::list<Operation> operations;
 
-#ifdef _WIN32
-    this->object = CreateSemaphoreA(nullptr, initial_count, LONG_MAX, name.data());
-    return this->object != nullptr;
-#else
-    this->object = sem_open(name.data(), O_CREAT, 0666, initial_count);
-    return this->object != SEM_FAILED;
+    // io_uring state
+    int ring_fd{ -1 };
+    void* sq_ring{ nullptr };
+    void* cq_ring{ nullptr };
+    std::size_t sq_ring_size{ 0 };
+    std::size_t cq_ring_size{ 0 };
+    Submission* submissions{ nullptr };
+    std::size_t submissions_size{ 0 };
+    std::atomic<std::uint32_t>* sq_head{ nullptr };
+    std::atomic<std::uint32_t>* sq_tail{ nullptr };
+    std::uint32_t* sq_array{ nullptr };
+    std::uint32_t sq_mask{ 0 };
+    std::uint32_t sq_entries{ 0 };
+    std::atomic<std::uint32_t>* cq_head{ nullptr };
+    std::atomic<std::uint32_t>* cq_tail{ nullptr };
+    struct io_uring_cqe* cqes{ nullptr };
+    std::uint32_t cq_mask{ 0 };
+    std::uint32_t unsubmitted{ 0 };
+    std::vector<Operation*> overflow; // Waits the full submission queue turned away, armed on the next run
+
+    // Fallback state
+    int epoll_fd{ -1 };
+    int event_fd{ -1 };
+    std::thread helper;
+    std::mutex futex_lock;
+    std::list<Operation*> futex_waiters; // FIFO, guarded by futex_lock
+    std::atomic<std::uint32_t> control{ 0 };
+    std::atomic<bool> stopping{ false };
+
+    bool setup_ring(unsigned int entries);
+    bool probe_futex();
+    Submission* next_submission();
+    int enter(std::uint32_t to_submit, std::uint32_t min_complete, unsigned int timeout_ms);
+    void arm(Operation* operation);
+    bool finish(Operation* operation); // try_wait and run the callback, false means re-arm
+    void helper_loop();
+    void notify_helper();
+    std::size_t run_ring(unsigned int timeout_ms);
+    std::size_t run_epoll(unsigned int timeout_ms);
+
+  public:
+    bool uses_io_uring() const;
+    int get_fd() const; // The ring or the epoll descriptor, pollable from an outer loop
+
+    void async_wait(Futex_Semaphore& semaphore, Callback callback);
+    void async_wait(const Semaphore& semaphore, Callback callback); // Ignored for an empty Semaphore
+    void async_wait(const Event_Notifier& notifier, Callback callback);
+
+    // Increments and, if anybody sleeps on the word, queues the FUTEX_WAKE with the next batch
+    // instead of making a system call of its own (a plain increment() on the fallback path)
+    bool increment(Futex_Semaphore& semaphore, int count = 1);
+
+    // Submits queued work and runs the callbacks of every wait that completed, blocking up to
+    // timeout_ms for the first one. Returns the number of callbacks run.
+    std::size_t run_once(unsigned int timeout_ms = INFINITE);
+
+    void close();
+    bool create(unsigned int entries = 256, Backend backend = Backend::automatic);
+
+    // Constructor
+    explicit Uring_Reactor(unsigned int entries, Backend backend = Backend::automatic);
+
+    Uring_Reactor(const Uring_Reactor&) = delete;
+    Uring_Reactor& operator=(const Uring_Reactor&) = delete;
+
+    Uring_Reactor() = default;
+    ~Uring_Reactor();
+  };
 #endif
-  }
 
-  inline Semaphore::Semaphore(const std::string& name, int initial_count)
+#ifdef __linux__
+  // What a Robust_Mutex lock attempt ended with
+  enum class Lock_Status
   {
-    this->create(name, initial_count);
-  }
+    acquired,
+    owner_died,      // Acquired, but the previous owner died holding it: repair, then make_consistent()
+    not_recoverable, // A previous owner_died holder unlocked without make_consistent(), unusable for good
+    timed_out,
+    busy,            // try_lock() only: someone else holds it
+    failed
+  };
 
-  inline Semaphore::~Semaphore()
+  // Process shared mutex meant to be placed inside a Shared_Memory segment, that survives a
+  // holder crashing. Built on a PTHREAD_MUTEX_ROBUST pthread mutex, so the kernel releases it
+  // through the owner's robust futex list on exit and the next locker gets owner_died. The
+  // uncontended lock is one compare-and-swap of the owner's TID into the futex word.
+  // Zero filled memory is a valid unlocked mutex, it gets set up on first use.
+  class Robust_Mutex
   {
-    this->close();
-  }
+    std::atomic<std::uint32_t> state{ 0 };
 
-  // Shared_Memory
+    // 0 consistent, 1 held after owner_died and not repaired yet, 2 not recoverable. Tracked here
+    // because glibc's trylock keeps the futex word when it reports ENOTRECOVERABLE, after which
+    // every lock attempt would block instead of failing, so a dead mutex is never handed to it.
+    std::atomic<std::uint32_t> health{ 0 };
+    pthread_mutex_t mutex;
 
-  inline const std::string& Shared_Memory::get_name() const
-  {
-    return this->name;
-  }
+    void initialize();
 
-  inline std::size_t Shared_Memory::get_size() const
-  {
-    return this->size;
-  }
+  public:
+    Lock_Status lock(unsigned int timeout_ms = INFINITE);
+    Lock_Status try_lock();
+    void unlock();
 
-  inline void* Shared_Memory::get_address() const
-  {
-    return this->address;
-  }
+    // After owner_died: marks the protected state repaired, so unlock() leaves the mutex usable
+    bool make_consistent();
 
-#ifdef _WIN32
-  inline HANDLE Shared_Memory::get_file_mapping() const
-#else
-  inline int Shared_Memory::get_file_mapping() const
+    // Constructor (use with placement new on shared memory)
+    Robust_Mutex();
+
+    // Lives at a fixed address in shared memory
+    Robust_Mutex(const Robust_Mutex&) = delete;
+    Robust_Mutex& operator=(const Robust_Mutex&) = delete;
+  };
 #endif
-  {
-    return this->file_mapping;
-  }
 
-  inline void Shared_Memory::close()
+#ifdef __linux__
+  // Reader-writer lock meant to be placed inside a Shared_Memory segment, for read mostly data.
+  // Readers count themselves in one of Slots cache line sized slots picked by the CPU they run
+  // on, so concurrent readers on different CPUs never write the same line. A writer raises the
+  // writer word, then waits on each slot's futex until it drains. Writers are preferred, new
+  // readers back off while one is waiting. Zero filled memory is a valid unlocked lock.
+  template <std::size_t Slots = 64>
+  class Shared_Rw_Lock
   {
-#ifdef _WIN32
-    if (this->file_mapping == nullptr)
-#else
-    if (this->file_mapping == -1)
-#endif
-    {
-      return;
-    }
+    static_assert(Slots > 0, "Shared_Rw_Lock needs at least one reader slot");
 
-#ifdef _WIN32
-    if (this->address != nullptr)
-    {
-      UnmapViewOfFile(this->address);
-    }
+    // 0 free, 1 held by a writer, 2 held with readers or writers asleep on it
+    alignas(detail::cache_line_size) std::atomic<std::uint32_t> writer{ 0 };
 
-    CloseHandle(this->file_mapping);
-#else
-    if (this->address != nullptr)
+    struct alignas(detail::cache_line_size) Slot
     {
-      munmap(this->address, this->size);
-    }
+      std::atomic<std::uint32_t> readers{ 0 };
+    };
 
-    close(this->file_mapping);
+    Slot slots[Slots];
+
+    void wait_for_writer();
+
+  public:
+    // Slot a reader counted itself in, pass it back to unlock_shared()
+    using Ticket = std::size_t;
+
+    Ticket lock_shared();
+    bool try_lock_shared(Ticket& ticket);
+    void unlock_shared(Ticket ticket);
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    // Constructor (use with placement new on shared memory)
+    Shared_Rw_Lock() = default;
+
+    // Lives at a fixed address in shared memory
+    Shared_Rw_Lock(const Shared_Rw_Lock&) = delete;
+    Shared_Rw_Lock& operator=(const Shared_Rw_Lock&) = delete;
+  };
+#endif
+
+#ifdef __linux__
+  class Shared_Condition_Variable;
+
+  // Process shared mutex meant to be placed inside a Shared_Memory segment: a single futex word,
+  // 0 unlocked, 1 locked, 2 locked with (possible) sleepers. Uncontended lock and unlock are one
+  // atomic each. Zero filled memory is a valid unlocked mutex. Not robust, see Robust_Mutex.
+  class Futex_Mutex
+  {
+    friend class Shared_Condition_Variable;
+
+    std::atomic<std::uint32_t> word{ 0 };
+
+    bool lock_contended(const struct timespec* deadline);
+
+  public:
+    // Getters
+    std::atomic<std::uint32_t>* get_word();
+
+    bool lock(unsigned int timeout_ms = INFINITE);
+    bool try_lock();
+    void unlock();
+
+    // Constructor (use with placement new on shared memory)
+    Futex_Mutex() = default;
+
+    // Lives at a fixed address in shared memory
+    Futex_Mutex(const Futex_Mutex&) = delete;
+    Futex_Mutex& operator=(const Futex_Mutex&) = delete;
+  };
+
+  // Process shared condition variable meant to be placed inside a Shared_Memory segment. Waiters
+  // sleep on a sequence word that every notify bumps, so a notify between unlocking and sleeping
+  // is never lost. notify_all(mutex) wakes one waiter and requeues the rest onto the mutex word
+  // (FUTEX_CMP_REQUEUE), so they get the mutex one by one instead of stampeding for it.
+  // Zero filled memory is a valid condition variable.
+  class Shared_Condition_Variable
+  {
+    std::atomic<std::uint32_t> sequence{ 0 };
+    std::atomic<std::uint32_t> waiters{ 0 };
+
+  public:
+    // Returns false on timeout. Spurious wake ups happen, re-check the predicate.
+    bool wait(Futex_Mutex& mutex, unsigned int timeout_ms = INFINITE);
+
+    // Any other lock with lock() / unlock() in the same segment. Waiters going through this
+    // overload must only be woken with notify_one() or notify_all() without a mutex.
+    template <typename Lock>
+    bool wait(Lock& lock, unsigned int timeout_ms = INFINITE);
+
+    void notify_one();
+    void notify_all();
+
+    // Caller must hold mutex, and every waiter must be waiting with that same mutex
+    void notify_all(Futex_Mutex& mutex);
+
+    // Constructor (use with placement new on shared memory)
+    Shared_Condition_Variable() = default;
+
+    // Lives at a fixed address in shared memory
+    Shared_Condition_Variable(const Shared_Condition_Variable&) = delete;
+    Shared_Condition_Variable& operator=(const Shared_Condition_Variable&) = delete;
+  };
+
+  // Process shared event meant to be placed inside a Shared_Memory segment. A manual reset event
+  // stays set and releases every waiter until reset(). An auto reset event lets exactly one waiter
+  // through per set() and clears itself. Zero filled memory is an unset auto reset event.
+  class Shared_Event
+  {
+    std::atomic<std::uint32_t> state{ 0 };
+    std::atomic<std::uint32_t> waiters{ 0 };
+    std::uint32_t manual_reset{ 0 };
+
+    bool try_consume();
+
+  public:
+    // Getters
+    bool is_set() const;
+    bool is_manual_reset() const;
+
+    bool wait(unsigned int timeout_ms = INFINITE);
+    void set();
+    void reset();
+
+    // Constructor (use with placement new on shared memory)
+    explicit Shared_Event(bool manual_reset = false, bool initially_set = false);
+
+    // Lives at a fixed address in shared memory
+    Shared_Event(const Shared_Event&) = delete;
+    Shared_Event& operator=(const Shared_Event&) = delete;
+  };
+#endif
+
+#ifdef __linux__
+  // Reusable barrier for a fixed number of processes, meant to be placed inside a Shared_Memory
+  // segment. The last process to arrive starts the next generation and wakes everybody with a
+  // single futex wake on the generation word. Construct it once (placement new), before use.
+  class Shared_Barrier
+  {
+    std::atomic<std::uint32_t> arrived{ 0 };
+    std::atomic<std::uint32_t> generation{ 0 }; // Its parity is the barrier's sense
+    std::uint32_t participants;
+
+  public:
+    // Getters
+    std::uint32_t get_participants() const;
+    std::uint32_t get_generation() const;
+
+    // Returns true in exactly one process per generation (the last one in), like PTHREAD_BARRIER_SERIAL_THREAD
+    bool arrive_and_wait();
+
+    // Constructor (use with placement new on shared memory)
+    explicit Shared_Barrier(std::uint32_t participants);
+
+    // Lives at a fixed address in shared memory
+    Shared_Barrier(const Shared_Barrier&) = delete;
+    Shared_Barrier& operator=(const Shared_Barrier&) = delete;
+  };
+
+  // One shot countdown latch meant to be placed inside a Shared_Memory segment. Waiters sleep on
+  // the count itself and the count_down() that reaches 0 wakes all of them with one futex wake.
+  // Construct it once (placement new), before use.
+  class Shared_Latch
+  {
+    std::atomic<std::uint32_t> count;
+
+  public:
+    // Getters
+    std::uint32_t get_count() const;
+
+    void count_down(std::uint32_t amount = 1);
+    bool try_wait() const;
+    bool wait(unsigned int timeout_ms = INFINITE);
+    bool arrive_and_wait(std::uint32_t amount = 1, unsigned int timeout_ms = INFINITE);
+
+    // Constructor (use with placement new on shared memory)
+    explicit Shared_Latch(std::uint32_t count);
+
+    // Lives at a fixed address in shared memory
+    Shared_Latch(const Shared_Latch&) = delete;
+    Shared_Latch& operator=(const Shared_Latch&) = delete;
+  };
+#endif
+
+#ifdef __linux__
+  // N counting semaphores in a single named Shared_Memory segment, one cache line each, instead
+  // of one shared memory object (and one file descriptor plus mapping) per Semaphore. get(index)
+  // hands out Handles, a pointer and an index, with the same wait/increment API as Semaphore.
+  class Semaphore_Array
+  {
+    struct Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::uint64_t size;
+    };
+
+    struct alignas(detail::cache_line_size) Slot
+    {
+      Futex_Semaphore semaphore;
+    };
+
+    static constexpr std::size_t slots_offset{ detail::align_up(sizeof(Header), detail::cache_line_size) };
+
+    Shared_Memory memory;
+    Header* header{ nullptr };
+    Slot* slots{ nullptr };
+
+  public:
+    // Cheap to copy, valid while the owning Semaphore_Array stays open
+    class Handle
+    {
+      Futex_Semaphore* semaphore{ nullptr };
+      std::size_t index{ 0 };
+
+      friend class Semaphore_Array;
+
+    public:
+      // Getters
+      std::size_t get_index() const;
+      std::uint32_t get_count() const;
+      Futex_Semaphore* get_object() const;
+
+      bool try_wait() const;
+      bool wait(unsigned int timeout_ms = INFINITE) const;
+      bool increment(int count = 1) const;
+
+      explicit operator bool() const;
+      Handle() = default;
+    };
+
+    // Getters
+    const Shared_Memory& get_shared_memory() const;
+    std::size_t size() const;
+    Handle get(std::size_t index) const; // Empty Handle when out of range
+    Handle operator[](std::size_t index) const;
+
+    void close();
+    bool create(const std::string& name, std::size_t size, std::uint32_t initial_count = 0);
+
+    // Constructor
+    Semaphore_Array(const std::string& name, std::size_t size, std::uint32_t initial_count = 0);
+
+    // Owns the mapping, so copying would double close it
+    Semaphore_Array(const Semaphore_Array&) = delete;
+    Semaphore_Array& operator=(const Semaphore_Array&) = delete;
+
+    Semaphore_Array() = default;
+    ~Semaphore_Array();
+  };
+#endif
+
+  // Lock-free single producer / single consumer ring living in a Shared_Memory segment.
+  // Both sides call create() with the same name and capacity; the first one initializes it.
+  template <typename T>
+  class Spsc_Ring
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Spsc_Ring<T> requires a trivially copyable T");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Spsc_Ring needs lock-free 64-bit atomics");
+
+    struct Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::uint64_t capacity;
+      alignas(detail::cache_line_size) std::atomic<std::uint64_t> head; // Next slot to write (producer)
+      alignas(detail::cache_line_size) std::atomic<std::uint64_t> tail; // Next slot to read (consumer)
+    };
+
+    static constexpr std::size_t slots_offset{ detail::align_up(sizeof(Header), detail::cache_line_size) };
+
+    Shared_Memory memory;
+    Header* header{ nullptr };
+    T* slots{ nullptr };
+    std::uint64_t mask{ 0 };
+
+    // Process local copies of the other side's index, refreshed only when the ring looks full/empty
+    alignas(detail::cache_line_size) std::uint64_t cached_tail{ 0 };
+    alignas(detail::cache_line_size) std::uint64_t cached_head{ 0 };
+
+  public:
+    // Getters
+    const Shared_Memory& get_shared_memory() const;
+    std::size_t capacity() const;
+    std::size_t size() const;
+    bool empty() const;
+
+    void close();
+    bool try_push(const T& value);
+    bool try_pop(T& value);
+    bool create(const std::string& name, std::size_t capacity);
+
+    // Constructor
+    Spsc_Ring(const std::string& name, std::size_t capacity);
+
+    // Owns the mapping, so copying would double close it
+    Spsc_Ring(const Spsc_Ring&) = delete;
+    Spsc_Ring& operator=(const Spsc_Ring&) = delete;
+
+    Spsc_Ring() = default;
+    ~Spsc_Ring();
+  };
+
+  // Bounded lock-free multi producer / multi consumer queue living in a Shared_Memory segment.
+  // Every slot carries its own sequence number, so producers and consumers only contend on
+  // the enqueue/dequeue cursors and never take a global lock. Each slot takes at least a cache
+  // line, so neighbouring slots written by different processes don't false share. That costs
+  // memory for small T (a capacity of 1024 ints takes 64 KiB).
+  template <typename T>
+  class Mpmc_Queue
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Mpmc_Queue<T> requires a trivially copyable T");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Mpmc_Queue needs lock-free 64-bit atomics");
+
+    struct alignas(detail::cache_line_size) Cell
+    {
+      std::atomic<std::uint64_t> sequence;
+      T data;
+    };
+
+    struct Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::uint64_t capacity;
+      alignas(detail::cache_line_size) std::atomic<std::uint64_t> enqueue_pos;
+      alignas(detail::cache_line_size) std::atomic<std::uint64_t> dequeue_pos;
+    };
+
+    static constexpr std::size_t cells_offset{ detail::align_up(sizeof(Header), detail::cache_line_size) };
+
+    Shared_Memory memory;
+    Header* header{ nullptr };
+    Cell* cells{ nullptr };
+    std::uint64_t mask{ 0 };
+
+  public:
+    // Getters
+    const Shared_Memory& get_shared_memory() const;
+    std::size_t capacity() const;
+    std::size_t size() const;
+    bool empty() const;
+
+    void close();
+    bool try_push(const T& value);
+    bool try_pop(T& value);
+    bool create(const std::string& name, std::size_t capacity);
+
+    // Constructor
+    Mpmc_Queue(const std::string& name, std::size_t capacity);
+
+    // Owns the mapping, so copying would double close it
+    Mpmc_Queue(const Mpmc_Queue&) = delete;
+    Mpmc_Queue& operator=(const Mpmc_Queue&) = delete;
+
+    Mpmc_Queue() = default;
+    ~Mpmc_Queue();
+  };
+
+  // Pointer that stores the distance to its target instead of an address, so it stays valid
+  // in every process no matter where the segment is mapped. Converting is a single add.
+  // A zero filled Offset_Ptr is null (which also means it can't point at itself).
+  template <typename T>
+  class Offset_Ptr
+  {
+    std::ptrdiff_t offset{ 0 };
+
+    void set(const T* pointer);
+
+  public:
+    T* get() const;
+    T& operator*() const;
+    T* operator->() const;
+    explicit operator bool() const;
+
+    Offset_Ptr& operator=(const T* pointer);
+    Offset_Ptr& operator=(const Offset_Ptr& other);
+
+    bool operator==(const Offset_Ptr& other) const;
+    bool operator!=(const Offset_Ptr& other) const;
+
+    // Constructor
+    Offset_Ptr(const T* pointer);
+    Offset_Ptr(const Offset_Ptr& other);
+
+    Offset_Ptr() = default;
+  };
+
+  // Heap allocator living in a Shared_Memory segment. Hands out segment relative offsets.
+  // Small blocks come from per size class lock-free free lists, larger ones from a
+  // boundary tagged first-fit list that coalesces neighbours on free. On Linux the large list
+  // is guarded by a Robust_Mutex: if a process dies holding it, the next one rebuilds the list
+  // from the boundary tags (a block the dead process was allocating or freeing may leak).
+  // Elsewhere it is a plain spin lock, and a holder dying there blocks every peer.
+  class Shared_Arena
+  {
+  public:
+    using Offset = std::uint64_t;
+    static constexpr Offset null_offset{ 0 };
+    static constexpr std::size_t alignment{ 16 }; // Of every payload
+
+  private:
+    static constexpr std::size_t size_class_count{ 8 };   // 16 .. 2048 bytes
+    static constexpr std::size_t max_small_size{ 2048 };
+    static constexpr std::size_t chunk_size{ 64 * 1024 }; // Carved into small blocks on refill, less once space runs short
+
+    // Tagged free list head: low bits hold offset / alignment, high bits an ABA counter
+    static constexpr unsigned int tag_shift{ 40 };
+    static constexpr std::uint64_t index_mask{ (std::uint64_t{ 1 } << tag_shift) - 1 };
+
+    enum Block_Kind : std::uint32_t
+    {
+      small_block = 1,
+      large_block = 2,
+      chunk_block = 3 // Large block that was split into small blocks, never freed
+    };
+
+    // Precedes every block. Large blocks also end with a copy of their size (the footer).
+    struct Block_Header
+    {
+      std::uint64_t size;  // Whole block for large blocks, size class index for small ones
+      std::uint32_t kind;
+      std::uint32_t free;
+    };
+
+    // Links kept in the payload of free blocks
+    struct Large_Links
+    {
+      Offset previous;
+      Offset next;
+    };
+
+    struct Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::uint64_t capacity;
+      std::atomic<Offset> root;
+      alignas(detail::cache_line_size) std::atomic<std::uint64_t> small_free[size_class_count];
+#ifdef __linux__
+      alignas(detail::cache_line_size) Robust_Mutex large_lock;
+#else
+      alignas(detail::cache_line_size) std::atomic<std::uint32_t> large_lock;
+#endif
+      Offset bump;       // End of the carved region, guarded by large_lock
+      Offset large_free; // Head of the large free list, guarded by large_lock
+    };
+
+    static constexpr std::size_t data_offset{ detail::align_up(sizeof(Header), detail::cache_line_size) };
+
+    // Smallest large block, its links and footer have to fit once it's free
+    static constexpr std::size_t min_large_block{ detail::align_up(sizeof(Block_Header) + sizeof(Large_Links) + sizeof(std::uint64_t), alignment) };
+
+    Shared_Memory memory;
+    Header* header{ nullptr };
+    unsigned char* base{ nullptr };
+
+    Block_Header* block_at(Offset block) const;
+    std::atomic<std::uint64_t>* small_link(Offset block) const;
+    Large_Links* large_links(Offset block) const;
+    void set_footer(Offset block, std::uint64_t size);
+
+    static std::size_t size_class(std::size_t size);
+    static std::size_t class_size(std::size_t index);
+
+    Offset pop_small(std::size_t index);
+    void push_small(std::size_t index, Offset first, Offset last);
+    Offset refill_small(std::size_t index);
+
+    bool lock_large();
+    void unlock_large();
+    void repair_large();
+    void unlink_large(Offset block);
+    void insert_large(Offset block);
+    Offset allocate_large(std::size_t block_size, Block_Kind kind);
+    void free_large(Offset block);
+
+  public:
+    // Getters
+    const Shared_Memory& get_shared_memory() const;
+    std::size_t get_capacity() const;
+
+    // Offset of an application chosen root object, so other processes can find their way in
+    Offset get_root() const;
+    void set_root(Offset offset);
+
+    void* to_pointer(Offset offset) const;
+    Offset to_offset(const void* pointer) const;
+
+    template <typename T>
+    T* get(Offset offset) const;
+
+    // Returns null_offset when the arena is exhausted. Payloads are 16 byte aligned.
+    Offset allocate(std::size_t size);
+
+    // Offsets that aren't allocated blocks (double frees, foreign pointers) assert in debug builds
+    // and are ignored otherwise, the lists are shared with every process
+    void deallocate(Offset offset);
+
+    void close();
+    bool create(const std::string& name, std::size_t size, Memory_Flags flags = Memory_Flags::none);
+
+    // Constructor
+    Shared_Arena(const std::string& name, std::size_t size, Memory_Flags flags = Memory_Flags::none);
+
+    // Owns the mapping, so copying would double close it
+    Shared_Arena(const Shared_Arena&) = delete;
+    Shared_Arena& operator=(const Shared_Arena&) = delete;
+
+    Shared_Arena() = default;
+    ~Shared_Arena();
+  };
+
+  // std::pmr::memory_resource that bump allocates out of a Shared_Memory segment, for data that
+  // is built once and then only read. Deallocation is a no-op. Several processes may allocate
+  // concurrently. Note that std::pmr containers keep raw pointers (including to this resource),
+  // so they are only usable in processes that map the segment at the same address, e.g. after fork().
+  class Shared_Monotonic_Resource : public std::pmr::memory_resource
+  {
+    struct Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::uint64_t capacity;
+      std::atomic<std::uint64_t> bump;
+    };
+
+    static constexpr std::size_t data_offset{ detail::align_up(sizeof(Header), detail::cache_line_size) };
+
+    Shared_Memory memory;
+    Header* header{ nullptr };
+    unsigned char* base{ nullptr };
+
+  protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+  public:
+    // Getters
+    const Shared_Memory& get_shared_memory() const;
+    std::size_t get_capacity() const;
+    std::size_t get_used() const;
+
+    // Forgets every allocation, for all processes. Only safe once nobody uses them anymore.
+    void reset();
+
+    void close();
+    bool create(const std::string& name, std::size_t size, Memory_Flags flags = Memory_Flags::none);
+
+    // Constructor
+    Shared_Monotonic_Resource(const std::string& name, std::size_t size, Memory_Flags flags = Memory_Flags::none);
+
+    // Owns the mapping, so copying would double close it
+    Shared_Monotonic_Resource(const Shared_Monotonic_Resource&) = delete;
+    Shared_Monotonic_Resource& operator=(const Shared_Monotonic_Resource&) = delete;
+
+    Shared_Monotonic_Resource() = default;
+    ~Shared_Monotonic_Resource();
+  };
+
+  // std::pmr::memory_resource backed by a Shared_Arena, for data that is allocated and freed
+  // continuously. The same raw pointer caveat as Shared_Monotonic_Resource applies.
+  class Shared_Pool_Resource : public std::pmr::memory_resource
+  {
+    Shared_Arena arena;
+
+  protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+  public:
+    // Getters
+    Shared_Arena& get_arena();
+
+    void close();
+    bool create(const std::string& name, std::size_t size, Memory_Flags flags = Memory_Flags::none);
+
+    // Constructor
+    Shared_Pool_Resource(const std::string& name, std::size_t size, Memory_Flags flags = Memory_Flags::none);
+
+    // Owns the mapping, so copying would double close it
+    Shared_Pool_Resource(const Shared_Pool_Resource&) = delete;
+    Shared_Pool_Resource& operator=(const Shared_Pool_Resource&) = delete;
+
+    Shared_Pool_Resource() = default;
+    ~Shared_Pool_Resource();
+  };
+
+  // Fixed capacity open addressing hash map living in a Shared_Memory segment, SwissTable style:
+  // one control byte per slot, probed 16 at a time with SSE2 where available.
+  // Lookups never write shared memory (values are read under a per-slot sequence lock).
+  // Updates and erases take the slot's lock only. A new key claims the first tombstone or empty
+  // slot on its probe sequence with a CAS, then checks no concurrent insert of the same key
+  // claimed another one before publishing, so erased slots are reused by any key.
+  // Tombstones are never turned back into empty slots, and lookups of absent keys (and inserts)
+  // only stop at an empty one. After enough erases without matching inserts every probe walks
+  // the whole table, O(capacity); rebuild() clears the tombstones out again.
+  template <typename K, typename V, typename Hash = std::hash<K>>
+  class Shared_Hash_Map
+  {
+    static_assert(std::is_trivially_copyable<K>::value, "Shared_Hash_Map keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<V>::value, "Shared_Hash_Map values must be trivially copyable");
+
+    static constexpr std::size_t group_size{ 16 };
+
+    // Control byte states, zero filled memory is an empty table
+    static constexpr std::uint8_t ctrl_empty{ 0x00 };
+    static constexpr std::uint8_t ctrl_busy{ 0x01 };    // Claimed, key still being written
+    static constexpr std::uint8_t ctrl_deleted{ 0x02 }; // Tombstone
+    static constexpr std::uint8_t ctrl_pending{ 0x03 }; // Key and value written, insert checking for a duplicate
+    static constexpr std::uint8_t ctrl_full{ 0x80 };    // Or'ed with 7 bits of the hash
+
+    struct Slot
+    {
+      std::atomic<std::uint32_t> version; // Odd while the value is being written
+      K key;
+      V value;
+    };
+
+    struct Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::uint64_t capacity;
+      alignas(detail::cache_line_size) std::atomic<std::uint64_t> size;
+    };
+
+    static constexpr std::size_t ctrl_offset{ detail::align_up(sizeof(Header), detail::cache_line_size) };
+
+    Shared_Memory memory;
+    Header* header{ nullptr };
+    std::atomic<std::uint8_t>* ctrl{ nullptr };
+    Slot* slots{ nullptr };
+    std::size_t group_mask{ 0 };
+    Hash hasher;
+
+    std::uint64_t hash(const K& key) const;
+    static std::uint32_t match_group(const std::atomic<std::uint8_t>* group, std::uint8_t value);
+    static void lock_slot(Slot& slot);
+    static void unlock_slot(Slot& slot);
+
+    // Compares the key (and copies the value out, when asked) in one consistent snapshot of a
+    // slot published with h2. Tombstones get new keys, so a key read outside it may be torn.
+    static bool read_slot(const Slot& slot, const std::atomic<std::uint8_t>& state, std::uint8_t h2, const K& key, V* value);
+
+    // Index of the slot at position (0 .. capacity() - 1) of a probe sequence: groups in
+    // triangular order, slots in order within a group
+    std::size_t probe_slot(std::uint64_t hash, std::size_t position) const;
+
+    // Slot index publishing key, or capacity() when absent
+    std::size_t find_slot(const K& key, std::uint8_t h2, std::uint64_t hash, V* value = nullptr) const;
+
+    // After claiming own for key: false when another slot holds (or is claiming, earlier on the
+    // sequence) the same key. Claims later on the sequence are taken out.
+    bool claim_is_unique(std::size_t own, const K& key, std::uint8_t h2, std::uint64_t hash);
+
+  public:
+    // Getters
+    const Shared_Memory& get_shared_memory() const;
+    std::size_t capacity() const;
+    std::size_t size() const;
+
+    bool find(const K& key, V& value) const;
+    bool contains(const K& key) const;
+
+    // Returns false only when the table is full
+    bool insert_or_assign(const K& key, const V& value);
+    bool erase(const K& key);
+
+    // Reinserts every entry into a table without tombstones. Not concurrent: no other process
+    // or thread may use the map meanwhile.
+    void rebuild();
+
+    void close();
+    bool create(const std::string& name, std::size_t capacity, Memory_Flags flags = Memory_Flags::none);
+
+    // Constructor
+    Shared_Hash_Map(const std::string& name, std::size_t capacity, Memory_Flags flags = Memory_Flags::none);
+
+    // Owns the mapping, so copying would double close it
+    Shared_Hash_Map(const Shared_Hash_Map&) = delete;
+    Shared_Hash_Map& operator=(const Shared_Hash_Map&) = delete;
+
+    Shared_Hash_Map() = default;
+    ~Shared_Hash_Map();
+  };
+
+  // Sequence lock around a trivially copyable value, meant to be placed inside a Shared_Memory
+  // segment. Readers never write shared memory: they copy the value and retry if a writer was
+  // active meanwhile. Writers are serialized by the sequence word itself.
+  // Zero filled memory is a valid Seqlocked<T> holding a zero filled T.
+  template <typename T>
+  class Seqlocked
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlocked<T> requires a trivially copyable T");
+
+    alignas(detail::cache_line_size) std::atomic<std::uint32_t> sequence{ 0 }; // Odd while a write is in progress
+    alignas(detail::cache_line_size) T value{};
+
+  public:
+    // Getters
+    std::uint32_t get_sequence() const;
+
+    // Single attempt, false if a write was in progress or raced with the copy
+    bool try_load(T& out) const;
+    T load() const;
+    void store(const T& desired);
+
+    // Constructor (use with placement new on shared memory)
+    explicit Seqlocked(const T& initial);
+
+    // Lives at a fixed address in shared memory
+    Seqlocked(const Seqlocked&) = delete;
+    Seqlocked& operator=(const Seqlocked&) = delete;
+
+    Seqlocked() = default;
+  };
+
+  // Single producer / multi consumer broadcast ring living in a Shared_Memory segment.
+  // Every message is written into the ring once and read in place by every consumer.
+  // Each consumer owns a cursor on its own cache line, the producer only waits for the
+  // slowest joined consumer (and never blocks when nobody has joined).
+  template <typename T>
+  class Broadcast_Ring
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Broadcast_Ring<T> requires a trivially copyable T");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Broadcast_Ring needs lock-free 64-bit atomics");
+
+    struct alignas(detail::cache_line_size) Consumer
+    {
+      std::atomic<std::uint32_t> owner;  // Joined process id, 0 while free, lets the producer evict it if it dies
+      std::atomic<std::uint64_t> cursor; // Next sequence this consumer reads
+    };
+
+    struct Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::uint64_t capacity;
+      std::uint64_t max_consumers;
+      alignas(detail::cache_line_size) std::atomic<std::uint64_t> published; // Next sequence the producer writes
+    };
+
+    static constexpr std::size_t consumers_offset{ detail::align_up(sizeof(Header), detail::cache_line_size) };
+
+    Shared_Memory memory;
+    Header* header{ nullptr };
+    Consumer* consumers{ nullptr };
+    T* slots{ nullptr };
+    std::uint64_t mask{ 0 };
+
+    // Producer side: slowest cursor seen at the last scan
+    std::uint64_t cached_min{ 0 };
+
+    // Consumer side: claimed Consumer slot, valid while joined
+    std::size_t consumer_index{ 0 };
+    bool joined{ false };
+
+    std::uint64_t scan_min_cursor() const;
+
+  public:
+    // Getters
+    const Shared_Memory& get_shared_memory() const;
+    std::size_t capacity() const;
+    std::size_t max_consumers() const;
+    std::size_t get_consumer_id() const; // Slot claimed by join(), only meaningful while joined
+
+    // Producer side
+    T* claim();      // Slot to fill in place, nullptr when the slowest consumer is a full lap behind
+    void publish();  // Makes the claimed slot visible to every consumer
+    bool try_publish(const T& value);
+
+    // A consumer that dies without leave() would hold the producer back forever. claim() calls
+    // evict_dead() before reporting a full ring, which frees slots whose process has exited.
+    // evict() frees a slot unconditionally, for supervisors that know a reader is gone (for example
+    // one in another pid namespace). Evicting a live consumer lets the producer overwrite what it reads.
+    std::size_t evict_dead();
+    bool evict(std::size_t consumer_id);
+
+    // Consumer side. join() starts at the next message published.
+    bool join();
+    void leave();
+    std::size_t lag() const;
+    const T* peek() const; // Next unread message in place, nullptr when caught up
+    void advance();        // Releases the message returned by peek()
+    bool try_read(T& value);
+
+    void close();
+    bool create(const std::string& name, std::size_t capacity, std::size_t max_consumers);
+
+    // Constructor
+    Broadcast_Ring(const std::string& name, std::size_t capacity, std::size_t max_consumers);
+
+    // Owns the mapping, so copying would double close it
+    Broadcast_Ring(const Broadcast_Ring&) = delete;
+    Broadcast_Ring& operator=(const Broadcast_Ring&) = delete;
+
+    Broadcast_Ring() = default;
+    ~Broadcast_Ring();
+  };
+
+  // Recycles pre-created, prefaulted Shared_Memory segments instead of creating one per payload.
+  // Segments are grouped in size buckets. Free lists live in a named control segment, so any
+  // process that create()s the pool by name can acquire() a segment and hand its Handle to another
+  // process, which then resolves it with get_address(). Every process maps every segment up front,
+  // so acquire() and release() are a single lock-free pop or push.
+  class Shared_Memory_Pool
+  {
+  public:
+    using Handle = std::uint32_t;
+    static constexpr Handle null_handle{ 0xFFFFFFFFu };
+    static constexpr std::size_t max_buckets{ 16 };
+    static constexpr std::size_t max_segments_per_bucket{ std::size_t{ 1 } << 24 };
+
+  private:
+    // Tagged free list head: low half is segment index + 1 (0 = empty), high half an ABA counter
+    struct alignas(detail::cache_line_size) Bucket
+    {
+      std::atomic<std::uint64_t> head;
+      std::atomic<std::uint32_t> available;
+    };
+
+    struct Header
+    {
+      std::atomic<std::uint32_t> state;
+      std::atomic<std::uint32_t> attached; // Processes that have the pool open, 0 once it's being torn down
+      std::uint32_t bucket_count;
+      std::uint32_t segments_per_bucket;
+      std::uint64_t sizes[max_buckets];
+      Bucket buckets[max_buckets];
+    };
+
+    static constexpr std::size_t links_offset{ detail::align_up(sizeof(Header), detail::cache_line_size) };
+
+    // Link of a segment somebody holds, never a next index + 1
+    static constexpr std::uint32_t in_use_link{ 0xFFFFFFFFu };
+
+    Shared_Memory control;
+    Header* header{ nullptr };
+    std::atomic<std::uint32_t>* links{ nullptr }; // Next free segment index + 1, per segment
+    std::vector<std::unique_ptr<Shared_Memory>> segments; // This process' mappings, by bucket then index
+    bool joined{ false }; // Counted in Header::attached
+
+    std::size_t segment_index(Handle handle) const;
+
+    // Handle names an existing bucket and segment of this pool
+    bool valid(Handle handle) const;
+
+  public:
+    // Getters
+    std::size_t get_bucket_count() const;
+    std::size_t get_bucket_size(std::size_t bucket) const;
+    std::size_t get_available(std::size_t bucket) const;
+
+    // Smallest free segment of at least size bytes, null_handle when every fitting bucket is empty
+    Handle acquire(std::size_t size);
+
+    // A handle that isn't acquired (or not from this pool) asserts in debug builds, else is ignored
+    void release(Handle handle);
+
+    void* get_address(Handle handle) const;
+    std::size_t get_size(Handle handle) const;
+
+    // The last process to close the pool unlinks every segment, the others only unmap.
+    // create() fails rather than join a pool whose last process is already closing it.
+    void close();
+
+    // bucket_sizes must be ascending. Segments are named name + "." + bucket + "." + index.
+    bool create(const std::string& name, const std::vector<std::size_t>& bucket_sizes, std::size_t segments_per_bucket,
+      Memory_Flags flags = Memory_Flags::prefault);
+
+    // Constructor
+    Shared_Memory_Pool(const std::string& name, const std::vector<std::size_t>& bucket_sizes, std::size_t segments_per_bucket,
+      Memory_Flags flags = Memory_Flags::prefault);
+
+    // Owns the mappings, so copying would double close them
+    Shared_Memory_Pool(const Shared_Memory_Pool&) = delete;
+    Shared_Memory_Pool& operator=(const Shared_Memory_Pool&) = delete;
+
+    Shared_Memory_Pool() = default;
+    ~Shared_Memory_Pool();
+  };
+
+  // ********** Definitions **********
+
+  // detail
+
+  inline std::size_t detail::round_up_pow2(std::size_t value)
+  {
+    if (value > SIZE_MAX / 2 + 1)
+    {
+      return 0;
+    }
+
+    std::size_t result = 1;
+
+    while (result < value)
+    {
+      result <<= 1;
+    }
+
+    return result;
+  }
+
+  inline bool detail::array_end(std::size_t offset, std::size_t count, std::size_t element_size, std::size_t& total)
+  {
+    if (element_size != 0 && count > (SIZE_MAX - offset) / element_size)
+    {
+      return false;
+    }
+
+    total = offset + count * element_size;
+    return true;
+  }
+
+  inline void detail::cpu_relax()
+  {
+#if defined(_WIN32)
+    YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+  }
+
+  inline unsigned int detail::count_trailing_zeros(std::uint32_t value)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(value));
+#endif
+  }
+
+  inline void detail::spin_lock(std::atomic<std::uint32_t>& lock)
+  {
+    for (unsigned int spins = 0; lock.exchange(1, std::memory_order_acquire) != 0; ++spins)
+    {
+      while (lock.load(std::memory_order_relaxed) != 0)
+      {
+        if (spins++ < 100)
+        {
+          detail::cpu_relax();
+        }
+        else
+        {
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+  inline void detail::spin_unlock(std::atomic<std::uint32_t>& lock)
+  {
+    lock.store(0, std::memory_order_release);
+  }
+
+  inline std::size_t detail::system_page_size()
+  {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+  }
+
+  inline void detail::touch_pages(void* address, std::size_t size, std::size_t page_size)
+  {
+    unsigned char* bytes = static_cast<unsigned char*>(address);
+
+    for (std::size_t offset = 0; offset < size; offset += page_size)
+    {
+      // Atomic or with 0 forces a write fault and can't race with peers writing the same byte
+#ifdef _WIN32
+      _InterlockedOr8(reinterpret_cast<volatile char*>(bytes + offset), 0);
+#else
+      __atomic_fetch_or(bytes + offset, 0, __ATOMIC_RELAXED);
+#endif
+    }
+  }
+
+  inline std::uint32_t detail::current_process_id()
+  {
+#ifdef _WIN32
+    return static_cast<std::uint32_t>(GetCurrentProcessId());
+#else
+    return static_cast<std::uint32_t>(getpid());
+#endif
+  }
+
+  inline bool detail::process_alive(std::uint32_t process_id)
+  {
+#ifdef _WIN32
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, process_id);
+
+    if (process == nullptr)
+    {
+      return GetLastError() != ERROR_INVALID_PARAMETER;
+    }
+
+    bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#else
+    // EPERM means it exists but belongs to someone else
+    return kill(static_cast<pid_t>(process_id), 0) == 0 || errno != ESRCH;
+#endif
+  }
+
+#ifdef __linux__
+  inline std::string detail::find_hugetlbfs_mount(std::size_t page_size)
+  {
+    std::string result;
+    FILE* mounts = setmntent("/proc/mounts", "r");
+
+    if (mounts == nullptr)
+    {
+      return result;
+    }
+
+    // hugetlbfs reports its page size as the block size
+    while (struct mntent* entry = getmntent(mounts))
+    {
+      struct statfs info;
+
+      if (std::strcmp(entry->mnt_type, "hugetlbfs") == 0 && statfs(entry->mnt_dir, &info) == 0 && static_cast<std::size_t>(info.f_bsize) == page_size)
+      {
+        result = entry->mnt_dir;
+        break;
+      }
+    }
+
+    endmntent(mounts);
+    return result;
+  }
+#endif
+
+  template <typename Init>
+  void detail::initialize_once(std::atomic<std::uint32_t>& state, Init&& init)
+  {
+    constexpr std::uint32_t uninitialized = 0;
+    constexpr std::uint32_t initializing = 1;
+    constexpr std::uint32_t ready = 2;
+
+    std::uint32_t expected = uninitialized;
+
+    if (state.compare_exchange_strong(expected, initializing, std::memory_order_acquire))
+    {
+      init();
+      state.store(ready, std::memory_order_release);
+      return;
+    }
+
+    // Someone else is (or was) initializing it
+    while (state.load(std::memory_order_acquire) != ready)
+    {
+      std::this_thread::yield();
+    }
+  }
+
+#ifdef __linux__
+  inline const struct timespec* detail::make_deadline(unsigned int timeout_ms, struct timespec& deadline)
+  {
+    if (timeout_ms == INFINITE)
+    {
+      return nullptr;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    return &deadline;
+  }
+
+  inline int detail::futex_wait(std::atomic<std::uint32_t>* word, std::uint32_t expected, const struct timespec* deadline)
+  {
+    // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline, so retries don't stretch the timeout
+    long result = syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAIT_BITSET, expected, deadline, nullptr, FUTEX_BITSET_MATCH_ANY);
+    return result == 0 ? 0 : errno;
+  }
+
+  inline int detail::futex_wake(std::atomic<std::uint32_t>* word, int count)
+  {
+    long result = syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+    return result < 0 ? 0 : static_cast<int>(result);
+  }
+
+  inline int detail::futex_requeue(std::atomic<std::uint32_t>* word, std::uint32_t expected, int wake_count, std::atomic<std::uint32_t>* target)
+  {
+    // The requeue limit travels in the timeout argument
+    long result = syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_CMP_REQUEUE, wake_count,
+      reinterpret_cast<const struct timespec*>(static_cast<std::uintptr_t>(INT32_MAX)), reinterpret_cast<std::uint32_t*>(target), expected);
+    return result < 0 ? errno : 0;
+  }
+#endif
+
+#ifndef _WIN32
+  inline bool detail::send_fd(int socket, int fd, const void* data, std::size_t size)
+  {
+    // At least one byte of real data has to go along with the descriptor
+    unsigned char empty = 0;
+    struct iovec io{ size == 0 ? &empty : const_cast<void*>(data), size == 0 ? 1 : size };
+
+    alignas(struct cmsghdr) unsigned char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    ssize_t sent;
+
+    do
+    {
+      sent = sendmsg(socket, &message, 0);
+    } while (sent == -1 && errno == EINTR);
+
+    return sent == static_cast<ssize_t>(io.iov_len);
+  }
+
+  inline int detail::receive_fd(int socket, void* data, std::size_t size)
+  {
+    unsigned char empty = 0;
+    struct iovec io{ size == 0 ? &empty : data, size == 0 ? 1 : size };
+
+    alignas(struct cmsghdr) unsigned char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    int flags = 0;
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+    do
+    {
+      received = recvmsg(socket, &message, flags);
+    } while (received == -1 && errno == EINTR);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+
+    if (received <= 0 || header == nullptr || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+    {
+      return -1;
+    }
+
+    int fd;
+    std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+
+    // A short read means a malformed message, don't leak the descriptor
+    if (received != static_cast<ssize_t>(io.iov_len) || (message.msg_flags & MSG_CTRUNC))
+    {
+      ::close(fd);
+      return -1;
+    }
+
+    return fd;
+  }
+#endif
+
+  // Semaphore
+
+  inline const std::string& Semaphore::get_name() const
+  {
+    return this->name;
+  }
+
+#ifdef _WIN32
+  inline HANDLE Semaphore::get_object() const
+#elif defined(__linux__)
+  inline Futex_Semaphore* Semaphore::get_object() const
+#else
+  inline sem_t* Semaphore::get_object() const
+#endif
+  {
+    return this->object;
+  }
+
+  inline void Semaphore::close()
+  {
+    if (this->object == nullptr)
+    {
+      return;
+    }
+
+#ifdef _WIN32
+    CloseHandle(this->object);
+#elif defined(__linux__)
+    munmap(this->object, sizeof(Futex_Semaphore));
+
+    if (!this->name.empty())
+    {
+      shm_unlink((this->name + ".sem").data());
+    }
+#else
+    sem_close(this->object);
 
     if (!this->name.empty())
     {
-      shm_unlink(this->name.data());
+      sem_unlink(this->name.data());
+    }
+#endif
+
+    // Clear members
+    this->object = nullptr;
+    this->name.clear();
+  }
+
+  inline Wait_Policy Semaphore::get_wait_policy() const
+  {
+    return this->wait_policy;
+  }
+
+  inline Wait_Stats Semaphore::get_wait_stats() const
+  {
+    Wait_Stats stats;
+    stats.immediate = this->immediate_count.load();
+    stats.spun = this->spun_count.load();
+    stats.blocked = this->blocked_count.load();
+    return stats;
+  }
+
+  inline void Semaphore::set_wait_policy(Wait_Policy policy, unsigned int max_spins)
+  {
+    this->wait_policy = policy;
+    this->spin_limit = max_spins;
+    this->adaptive_spins.store(0);
+  }
+
+  inline void Semaphore::reset_wait_stats()
+  {
+    this->immediate_count.store(0);
+    this->spun_count.store(0);
+    this->blocked_count.store(0);
+  }
+
+  inline bool Semaphore::try_acquire() const
+  {
+#ifdef _WIN32
+    return WaitForSingleObject(this->object, 0) == WAIT_OBJECT_0;
+#elif defined(__linux__)
+    return this->object->try_wait();
+#else
+    return sem_trywait(this->object) == 0;
+#endif
+  }
+
+  inline bool Semaphore::spin_acquire() const
+  {
+    unsigned int limit = this->spin_limit;
+
+    if (this->wait_policy == Wait_Policy::adaptive)
+    {
+      // Allow some slack over the running average so the estimate can grow again
+      unsigned int estimate = this->adaptive_spins.load();
+      limit = estimate * 2 + 16 < limit ? estimate * 2 + 16 : limit;
+    }
+
+    for (unsigned int i = 0; i < limit; ++i)
+    {
+      detail::cpu_relax();
+
+      if (this->try_acquire())
+      {
+        if (this->wait_policy == Wait_Policy::adaptive)
+        {
+          unsigned int estimate = this->adaptive_spins.load();
+          this->adaptive_spins.store(estimate + (static_cast<int>(i) - static_cast<int>(estimate)) / 8);
+        }
+
+        return true;
+      }
+    }
+
+    if (this->wait_policy == Wait_Policy::adaptive)
+    {
+      // Waits are currently longer than we're willing to spin, back off
+      unsigned int estimate = this->adaptive_spins.load();
+      this->adaptive_spins.store(estimate - estimate / 8);
+    }
+
+    if (this->wait_policy == Wait_Policy::spin_yield_block)
+    {
+      for (unsigned int i = 0; i < Semaphore::yield_limit; ++i)
+      {
+        std::this_thread::yield();
+
+        if (this->try_acquire())
+        {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  inline bool Semaphore::wait(unsigned int timeout_ms) const
+  {
+    if (this->object == nullptr)
+    {
+      return false;
+    }
+
+    if (this->try_acquire())
+    {
+      this->immediate_count.add(1);
+      return true;
+    }
+
+    if (this->wait_policy != Wait_Policy::block && timeout_ms != 0)
+    {
+      // Only read the clock when there is a timeout to honour
+      auto start = timeout_ms == INFINITE ? std::chrono::steady_clock::time_point{} : std::chrono::steady_clock::now();
+
+      if (this->spin_acquire())
+      {
+        this->spun_count.add(1);
+        return true;
+      }
+
+      // Spinning and yielding count against the timeout
+      if (timeout_ms != INFINITE)
+      {
+        auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        timeout_ms = static_cast<unsigned int>(spent) < timeout_ms ? timeout_ms - static_cast<unsigned int>(spent) : 0;
+      }
+    }
+
+    this->blocked_count.add(1);
+    return this->block(timeout_ms);
+  }
+
+  inline bool Semaphore::block(unsigned int timeout_ms) const
+  {
+#ifdef _WIN32
+    DWORD result = WaitForSingleObject(this->object, timeout_ms);
+    return result == WAIT_OBJECT_0;
+#elif defined(__linux__)
+    return this->object->wait(timeout_ms);
+#else
+    if (timeout_ms == INFINITE)
+    {
+      return sem_wait(this->object) == 0;
+    }
+    else
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += timeout_ms / 1000;
+      ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+
+      if (ts.tv_nsec >= 1000000000)
+      {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+      }
+
+      return sem_timedwait(this->object, &ts) == 0;
+    }
+#endif
+  }
+
+  inline bool Semaphore::increment(int count) const
+  {
+    if (this->object == nullptr)
+    {
+      return false;
+    }
+
+#ifdef _WIN32
+    return ReleaseSemaphore(this->object, count, nullptr);
+#elif defined(__linux__)
+    // Single atomic add, then at most one FUTEX_WAKE for up to `count` waiters
+    return this->object->increment(count);
+#else
+    bool success = true;
+
+    for (int i = 0; i < count; ++i)
+    {
+      if (sem_post(this->object) != 0)
+      {
+        success = false;
+      }
+    }
+
+    return success;
+#endif
+  }
+
+  inline bool Semaphore::release_all() const
+  {
+    if (this->object == nullptr)
+    {
+      return false;
+    }
+
+#ifdef __linux__
+    // Waiters register before they sleep, so this covers everyone asleep right now
+    std::uint32_t waiters = this->object->get_waiters();
+    return waiters == 0 || this->increment(static_cast<int>(waiters));
+#else
+    return this->increment(Semaphore::max_count);
+#endif
+  }
+
+  inline bool Semaphore::create(const std::string& name, int initial_count)
+  {
+    if (name.empty())
+    {
+      return false;
+    }
+
+    this->name = name;
+
+#ifdef _WIN32
+    this->object = CreateSemaphoreA(nullptr, initial_count, LONG_MAX, name.data());
+    return this->object != nullptr;
+#elif defined(__linux__)
+    std::string object_name = name + ".sem";
+
+    // Only the process that actually creates the object applies initial_count, like sem_open
+    int fd = shm_open(object_name.data(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    bool created = fd != -1;
+
+    if (!created)
+    {
+      fd = shm_open(object_name.data(), O_CREAT | O_RDWR, 0666);
+    }
+
+    if (fd == -1)
+    {
+      this->name.clear();
+      return false;
+    }
+
+    // Harmless if it already has this size. Fresh pages are zero, which is a valid empty semaphore.
+    if (ftruncate(fd, sizeof(Futex_Semaphore)) == -1)
+    {
+      ::close(fd);
+      this->name.clear();
+      return false;
+    }
+
+    void* address = mmap(nullptr, sizeof(Futex_Semaphore), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (address == MAP_FAILED)
+    {
+      this->name.clear();
+      return false;
+    }
+
+    this->object = static_cast<Futex_Semaphore*>(address);
+
+    if (created && initial_count > 0)
+    {
+      this->object->increment(initial_count);
+    }
+
+    return true;
+#else
+    this->object = sem_open(name.data(), O_CREAT, 0666, initial_count);
+    return this->object != SEM_FAILED;
+#endif
+  }
+
+  inline Semaphore::Semaphore(const std::string& name, int initial_count)
+  {
+    this->create(name, initial_count);
+  }
+
+  inline Semaphore::Semaphore(Semaphore&& other) noexcept
+    : name{ std::move(other.name) }, wait_policy{ other.wait_policy }, spin_limit{ other.spin_limit },
+      immediate_count{ other.immediate_count }, spun_count{ other.spun_count }, blocked_count{ other.blocked_count },
+      adaptive_spins{ other.adaptive_spins }, object{ other.object }
+  {
+    other.object = nullptr;
+    other.name.clear();
+  }
+
+  inline Semaphore& Semaphore::operator=(Semaphore&& other) noexcept
+  {
+    if (this != &other)
+    {
+      this->close();
+      this->name = std::move(other.name);
+      this->wait_policy = other.wait_policy;
+      this->spin_limit = other.spin_limit;
+      this->immediate_count = other.immediate_count;
+      this->spun_count = other.spun_count;
+      this->blocked_count = other.blocked_count;
+      this->adaptive_spins = other.adaptive_spins;
+      this->object = other.object;
+      other.object = nullptr;
+      other.name.clear();
+    }
+
+    return *this;
+  }
+
+  inline Semaphore::~Semaphore()
+  {
+    this->close();
+  }
+
+  // Shared_Memory
+
+  inline const std::string& Shared_Memory::get_name() const
+  {
+    return this->name;
+  }
+
+  inline std::size_t Shared_Memory::get_size() const
+  {
+    return this->size == 0 ? 0 : this->size - this->data_offset();
+  }
+
+  inline void* Shared_Memory::get_address() const
+  {
+    if (this->address == nullptr)
+    {
+      return nullptr;
+    }
+
+    return static_cast<unsigned char*>(this->address) + this->data_offset();
+  }
+
+  inline Memory_Flags Shared_Memory::get_flags() const
+  {
+    return this->flags;
+  }
+
+  inline std::size_t Shared_Memory::get_page_size() const
+  {
+    return this->page_size;
+  }
+
+  inline bool Shared_Memory::uses_transparent_huge_pages() const
+  {
+    return this->transparent_huge_pages;
+  }
+
+  inline bool Shared_Memory::is_locked() const
+  {
+    return this->locked;
+  }
+
+  inline std::chrono::nanoseconds Shared_Memory::get_populate_time() const
+  {
+    return this->populate_time;
+  }
+
+  inline std::uint64_t Shared_Memory::get_generation() const
+  {
+    return this->generation;
+  }
+
+  inline std::size_t Shared_Memory::data_offset() const
+  {
+    return (this->flags & Memory_Flags::growable) ? Shared_Memory::growable_header_size : 0;
+  }
+
+  inline Shared_Memory::Growable_Header* Shared_Memory::get_header() const
+  {
+    if (this->address == nullptr || !(this->flags & Memory_Flags::growable))
+    {
+      return nullptr;
+    }
+
+    return static_cast<Growable_Header*>(this->address);
+  }
+
+#ifdef _WIN32
+  inline HANDLE Shared_Memory::get_file_mapping() const
+#else
+  inline int Shared_Memory::get_file_mapping() const
+#endif
+  {
+    return this->file_mapping;
+  }
+
+  inline void Shared_Memory::close()
+  {
+    this->release(true);
+  }
+
+  inline void Shared_Memory::detach()
+  {
+    this->release(false);
+  }
+
+  inline void Shared_Memory::release(bool unlink)
+  {
+#ifdef _WIN32
+    if (this->file_mapping == nullptr)
+#else
+    if (this->file_mapping == -1)
+#endif
+    {
+      return;
+    }
+
+#ifdef _WIN32
+    if (this->address != nullptr)
+    {
+      if (this->locked)
+      {
+        VirtualUnlock(this->address, this->size);
+      }
+
+      UnmapViewOfFile(this->address);
+    }
+
+    // Sections go away with their last handle, there is no name to remove
+    (void)unlink;
+    CloseHandle(this->file_mapping);
+#else
+    if (this->address != nullptr)
+    {
+      munmap(this->address, this->size);
+    }
+
+    ::close(this->file_mapping);
+
+    if (unlink && !this->hugetlbfs_path.empty())
+    {
+      ::unlink(this->hugetlbfs_path.data());
+      shm_unlink((this->name + ".hugetlbfs").data());
+    }
+
+    if (unlink && !this->name.empty())
+    {
+      shm_unlink(this->name.data());
+    }
+
+    this->hugetlbfs_path.clear();
+#endif
+
+    // Finally clear members
+    this->name.clear();
+    this->size = 0;
+    this->address = nullptr;
+    this->flags = Memory_Flags::none;
+    this->page_size = 0;
+    this->transparent_huge_pages = false;
+    this->locked = false;
+    this->populate_time = std::chrono::nanoseconds{ 0 };
+    this->generation = 0;
+
+#ifdef _WIN32
+    this->file_mapping = nullptr;
+#else
+    this->file_mapping = -1;
+#endif
+  }
+
+  inline void* Shared_Memory::map()
+  {
+#ifdef _WIN32
+    if (this->file_mapping == nullptr)
+#else
+    if (this->file_mapping == -1)
+#endif
+    {
+      return nullptr;
+    }
+
+    if (this->size == 0)
+    {
+      return nullptr;
+    }
+
+#ifdef _WIN32
+    DWORD access = FILE_MAP_ALL_ACCESS;
+
+    if (this->page_size != detail::system_page_size())
+    {
+      access |= FILE_MAP_LARGE_PAGES;
+    }
+
+    void* address = MapViewOfFile(this->file_mapping, access, 0, 0, this->size);
+
+    if (address == nullptr)
+    {
+      CloseHandle(this->file_mapping); // Cleanup handle
+      this->file_mapping = nullptr;
+    }
+
+    return address;
+#else
+    void* address = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, this->file_mapping, 0);
+
+    if (address == MAP_FAILED)
+    {
+      ::close(this->file_mapping); // Cleanup file descriptor
+      this->file_mapping = -1;
+      return nullptr;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (this->transparent_huge_pages)
+    {
+      // Only a hint, the kernel may still use base pages
+      madvise(address, this->size, MADV_HUGEPAGE);
+    }
+#endif
+
+    return address;
+#endif
+  }
+
+  inline void Shared_Memory::populate(std::size_t offset)
+  {
+    bool parallel = this->flags & Memory_Flags::prefault_parallel;
+    bool prefault = parallel || (this->flags & Memory_Flags::prefault);
+    bool lock = this->flags & Memory_Flags::lock_in_memory;
+
+    if ((!prefault && !lock) || offset >= this->size)
+    {
+      return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (prefault)
+    {
+      std::size_t step = this->page_size;
+
+      auto populate_range = [step](unsigned char* begin, std::size_t length)
+      {
+#if defined(__linux__) && defined(MADV_POPULATE_WRITE)
+        // One call per range, and unlike MAP_POPULATE it doesn't silently skip failures
+        if (madvise(begin, length, MADV_POPULATE_WRITE) == 0)
+        {
+          return;
+        }
+#endif
+        detail::touch_pages(begin, length, step);
+      };
+
+      unsigned char* base = static_cast<unsigned char*>(this->address) + offset;
+      std::size_t total = this->size - offset;
+      std::size_t thread_count = 1;
+
+      if (parallel)
+      {
+        // At least 16 MiB per thread, otherwise thread start up costs more than it saves
+        constexpr std::size_t min_chunk = std::size_t{ 16 } << 20;
+        std::size_t hardware_threads = std::thread::hardware_concurrency();
+        thread_count = total / min_chunk;
+        thread_count = thread_count < hardware_threads ? thread_count : hardware_threads;
+        thread_count = thread_count == 0 ? 1 : thread_count;
+      }
+
+      if (thread_count == 1)
+      {
+        populate_range(base, total);
+      }
+      else
+      {
+        std::size_t page_count = total / step;
+        std::size_t pages_per_thread = (page_count + thread_count - 1) / thread_count;
+        std::vector<std::thread> threads;
+
+        for (std::size_t i = 0; i < thread_count; ++i)
+        {
+          std::size_t first = i * pages_per_thread * step;
+
+          if (first >= total)
+          {
+            break;
+          }
+
+          std::size_t length = pages_per_thread * step;
+          length = first + length > total ? total - first : length;
+          threads.emplace_back(populate_range, base + first, length);
+        }
+
+        for (std::thread& thread : threads)
+        {
+          thread.join();
+        }
+      }
+    }
+
+    if (lock)
+    {
+      // Best effort, limited by RLIMIT_MEMLOCK / the working set size. Growing only locks the
+      // new tail, the segment stays locked as a whole only if every part did.
+      void* begin = static_cast<unsigned char*>(this->address) + offset;
+      bool tail_locked;
+#ifdef _WIN32
+      tail_locked = VirtualLock(begin, this->size - offset) != 0;
+#else
+      tail_locked = mlock(begin, this->size - offset) == 0;
+#endif
+      this->locked = tail_locked && (offset == 0 || this->locked);
+    }
+
+    this->populate_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+  }
+
+  inline bool Shared_Memory::create(const std::string& name, std::size_t size, Memory_Flags flags)
+  {
+    if (name.empty())
+    {
+      return false;
+    }
+
+    if (size == 0)
+    {
+      return false;
+    }
+
+    constexpr std::size_t huge_2mb = std::size_t{ 2 } << 20;
+    bool wants_huge_pages = (flags & Memory_Flags::huge_pages_2mb) || (flags & Memory_Flags::huge_pages_1gb);
+
+    this->name = name;
+    this->flags = flags;
+    this->size = size + this->data_offset();
+    this->page_size = detail::system_page_size();
+    this->transparent_huge_pages = false;
+    this->locked = false;
+    this->populate_time = std::chrono::nanoseconds{ 0 };
+    this->generation = 0;
+
+    // From here on size means the mapped size
+    size = this->size;
+
+#ifdef _WIN32
+    // Large pages need SeLockMemoryPrivilege, silently fall back to normal pages without it
+    if (wants_huge_pages && GetLargePageMinimum() != 0)
+    {
+      std::size_t large_page = GetLargePageMinimum();
+      std::size_t rounded = detail::align_up(size, large_page);
+      this->file_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE | SEC_COMMIT | SEC_LARGE_PAGES,
+        static_cast<DWORD>(static_cast<std::uint64_t>(rounded) >> 32), static_cast<DWORD>(rounded), name.data());
+
+      if (this->file_mapping != nullptr)
+      {
+        this->size = rounded;
+        this->page_size = large_page;
+      }
+    }
+
+    if (this->file_mapping == nullptr)
+    {
+      this->file_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(static_cast<std::uint64_t>(size) >> 32), static_cast<DWORD>(size), name.data());
+    }
+
+    // return this->file_mapping != nullptr;
+#else
+    int shm_fd = shm_open(name.data(), O_CREAT | O_RDWR, 0666);
+
+    if (shm_fd == -1)
+    {
+      return false;
+    }
+
+#ifdef __linux__
+    // The shm object is where every creator meets, whatever flags it passed. The lock makes
+    // the choice of backing once, so peers never map different memory under the same name.
+    flock(shm_fd, LOCK_EX);
+    int hugetlbfs = this->map_hugetlbfs(shm_fd, size);
+
+    if (hugetlbfs != 0)
+    {
+      // Only the (now empty) rendezvous object is left behind under the name itself
+      ::close(shm_fd);
+
+      if (hugetlbfs < 0)
+      {
+        this->name.clear();
+        return false;
+      }
+
+      this->sync_header();
+      this->populate();
+      return true;
+    }
+
+    // No explicit huge pages available, ask for transparent ones on a 2 MiB rounded segment
+    if (wants_huge_pages || (flags & Memory_Flags::transparent_huge_pages))
+    {
+      this->size = detail::align_up(size, huge_2mb);
+      this->transparent_huge_pages = true;
+    }
+#endif
+
+    if (!this->size_object(shm_fd))
+    {
+      ::close(shm_fd);
+      shm_unlink(name.data());
+      return false;
+    }
+
+#ifdef __linux__
+    // Growable segments keep the lock until sync_header() has published the size
+    if (!(flags & Memory_Flags::growable))
+    {
+      flock(shm_fd, LOCK_UN);
+    }
+#endif
+
+    this->file_mapping = shm_fd;
+    // return true;
+#endif
+
+    // Now map to memory
+    this->address = this->map();
+
+    if (this->address == nullptr)
+    {
+      return false;
+    }
+
+#ifdef _WIN32
+    if (Growable_Header* header = this->get_header())
+    {
+      detail::initialize_once(header->state, [&]
+      {
+        header->size.store(this->size, std::memory_order_relaxed);
+      });
+    }
+#else
+    this->sync_header();
+#endif
+
+    this->populate();
+    return true;
+  }
+
+#ifdef __linux__
+  inline int Shared_Memory::map_hugetlbfs(int rendezvous, std::size_t size)
+  {
+    std::string redirect_name = this->name + ".hugetlbfs";
+    std::string path;
+    bool creator = false;
+
+    // Someone already picked a hugetlbfs file, follow it whatever our own flags say
+    int redirect = shm_open(redirect_name.data(), O_RDONLY, 0);
+
+    if (redirect != -1)
+    {
+      char buffer[4096];
+      ssize_t length = read(redirect, buffer, sizeof(buffer));
+      ::close(redirect);
+
+      if (length <= 0)
+      {
+        return -1;
+      }
+
+      path.assign(buffer, static_cast<std::size_t>(length));
+    }
+    else
+    {
+      bool wants_huge_pages = (this->flags & Memory_Flags::huge_pages_2mb) || (this->flags & Memory_Flags::huge_pages_1gb);
+      struct stat info;
+
+      // Peers already put their data in the shm object itself
+      if (!wants_huge_pages || fstat(rendezvous, &info) != 0 || info.st_size != 0)
+      {
+        return 0;
+      }
+
+      std::size_t huge_size = (this->flags & Memory_Flags::huge_pages_1gb) ? std::size_t{ 1 } << 30 : std::size_t{ 2 } << 20;
+      std::string mount = detail::find_hugetlbfs_mount(huge_size);
+
+      if (mount.empty())
+      {
+        return 0;
+      }
+
+      path = mount + "/" + (this->name[0] == '/' ? this->name.substr(1) : this->name);
+      creator = true;
+    }
+
+    int huge_fd = open(path.data(), creator ? O_CREAT | O_RDWR : O_RDWR, 0666);
+    struct statfs info;
+
+    // hugetlbfs reports its page size as the block size, attachers learn it from there
+    if (huge_fd != -1 && fstatfs(huge_fd, &info) == 0)
+    {
+      this->page_size = static_cast<std::size_t>(info.f_bsize);
+      this->size = detail::align_up(size, this->page_size);
+
+      if (this->size_object(huge_fd))
+      {
+        this->file_mapping = huge_fd;
+        huge_fd = -1;
+
+        // Fails with ENOMEM when the huge page pool is too small
+        this->address = this->map();
+      }
+    }
+
+    if (huge_fd != -1)
+    {
+      ::close(huge_fd);
+    }
+
+    if (this->address != nullptr && creator)
+    {
+      redirect = shm_open(redirect_name.data(), O_CREAT | O_TRUNC | O_WRONLY, 0666);
+
+      if (redirect == -1 || write(redirect, path.data(), path.size()) != static_cast<ssize_t>(path.size()))
+      {
+        munmap(this->address, this->size);
+        ::close(this->file_mapping);
+        this->address = nullptr;
+        this->file_mapping = -1;
+        shm_unlink(redirect_name.data());
+      }
+
+      if (redirect != -1)
+      {
+        ::close(redirect);
+      }
+    }
+
+    if (this->address != nullptr)
+    {
+      this->hugetlbfs_path = path;
+      return 1;
+    }
+
+    this->size = size;
+    this->page_size = detail::system_page_size();
+
+    // Peers are already on the hugetlbfs file, a separate shm object would silently split the segment
+    if (!creator)
+    {
+      return -1;
+    }
+
+    // Nobody else can have opened it yet, we still hold the rendezvous lock
+    ::unlink(path.data());
+    return 0;
+  }
+#endif
+
+#ifndef _WIN32
+  inline bool Shared_Memory::size_object(int fd)
+  {
+    if (!(this->flags & Memory_Flags::growable))
+    {
+      // Never shrink, peers may already use the object at its current size. On Linux create()
+      // already holds the lock on the name's shm object, fd may be a hugetlbfs file instead.
+#ifndef __linux__
+      flock(fd, LOCK_EX);
+#endif
+      struct stat info;
+      bool sized = fstat(fd, &info) == 0 && (static_cast<std::size_t>(info.st_size) >= this->size || ftruncate(fd, this->size) == 0);
+#ifndef __linux__
+      flock(fd, LOCK_UN);
+#endif
+      return sized;
+    }
+
+    // Growable segments are only ever grown, and under the lock so concurrent creators can't shrink them.
+    // The lock stays held until sync_header() has published the size.
+    flock(fd, LOCK_EX);
+    struct stat info;
+
+    if (fstat(fd, &info) != 0)
+    {
+      flock(fd, LOCK_UN);
+      return false;
+    }
+
+    // Someone already grew it past what we asked for, attach at the current size
+    if (static_cast<std::size_t>(info.st_size) >= this->size)
+    {
+      this->size = static_cast<std::size_t>(info.st_size);
+      return true;
+    }
+
+    if (ftruncate(fd, this->size) != 0)
+    {
+      flock(fd, LOCK_UN);
+      return false;
+    }
+
+    return true;
+  }
+
+  inline void Shared_Memory::sync_header()
+  {
+    Growable_Header* header = this->get_header();
+
+    if (header == nullptr)
+    {
+      return;
+    }
+
+    detail::initialize_once(header->state, [&]
+    {
+      header->size.store(this->size, std::memory_order_relaxed);
+    });
+
+    // We may have just grown a segment created smaller by someone else
+    if (header->size.load(std::memory_order_relaxed) < this->size)
+    {
+      header->size.store(this->size, std::memory_order_relaxed);
+      header->generation.fetch_add(1, std::memory_order_release);
+    }
+
+    this->generation = header->generation.load(std::memory_order_acquire);
+    flock(this->file_mapping, LOCK_UN);
+  }
+
+  inline bool Shared_Memory::remap(std::size_t new_size)
+  {
+#ifdef __linux__
+    void* address = mremap(this->address, this->size, new_size, MREMAP_MAYMOVE);
+#else
+    void* address = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->file_mapping, 0);
+
+    if (address != MAP_FAILED)
+    {
+      munmap(this->address, this->size);
+    }
+#endif
+
+    if (address == MAP_FAILED)
+    {
+      return false;
+    }
+
+#ifdef __linux__
+    // mremap keeps the old pages resident and locked, only the grown tail needs work
+    std::size_t populated = this->size < new_size ? this->size : new_size;
+#else
+    std::size_t populated = 0;
+#endif
+
+    this->address = address;
+    this->size = new_size;
+
+#ifdef MADV_HUGEPAGE
+    if (this->transparent_huge_pages)
+    {
+      madvise(this->address, this->size, MADV_HUGEPAGE);
+    }
+#endif
+
+    this->populate(populated);
+    return true;
+  }
+#endif
+
+  inline bool Shared_Memory::resize(std::size_t new_size)
+  {
+    Growable_Header* header = this->get_header();
+
+    if (header == nullptr)
+    {
+      return false;
+    }
+
+#ifdef _WIN32
+    // Pagefile backed sections can't grow
+    return new_size <= this->get_size();
+#else
+    constexpr std::size_t huge_2mb = std::size_t{ 2 } << 20;
+    std::size_t granularity = this->transparent_huge_pages ? huge_2mb : this->page_size;
+    new_size = detail::align_up(new_size + this->data_offset(), granularity);
+
+    flock(this->file_mapping, LOCK_EX);
+
+    // Never shrink, peers may still be using the tail
+    if (new_size > header->size.load(std::memory_order_relaxed))
+    {
+      if (ftruncate(this->file_mapping, new_size) != 0)
+      {
+        flock(this->file_mapping, LOCK_UN);
+        return false;
+      }
+
+      header->size.store(new_size, std::memory_order_relaxed);
+      header->generation.fetch_add(1, std::memory_order_release);
+    }
+
+    flock(this->file_mapping, LOCK_UN);
+    return this->refresh();
+#endif
+  }
+
+  inline bool Shared_Memory::refresh()
+  {
+    Growable_Header* header = this->get_header();
+
+    if (header == nullptr)
+    {
+      return this->address != nullptr;
+    }
+
+#ifdef _WIN32
+    return true;
+#else
+    // The common case is a single load that matches
+    std::uint64_t generation = header->generation.load(std::memory_order_acquire);
+
+    if (generation == this->generation)
+    {
+      return true;
+    }
+
+    std::size_t new_size = static_cast<std::size_t>(header->size.load(std::memory_order_relaxed));
+
+    if (new_size != this->size && !this->remap(new_size))
+    {
+      return false;
+    }
+
+    this->generation = generation;
+    return true;
+#endif
+  }
+
+#ifndef _WIN32
+  inline bool Shared_Memory::create_anonymous(std::size_t size, Memory_Flags flags)
+  {
+    if (size == 0)
+    {
+      return false;
+    }
+
+    bool wants_huge_pages = (flags & Memory_Flags::huge_pages_2mb) || (flags & Memory_Flags::huge_pages_1gb);
+
+    this->name.clear();
+    this->flags = flags;
+    this->size = size + this->data_offset();
+    this->page_size = detail::system_page_size();
+    this->transparent_huge_pages = false;
+    this->locked = false;
+    this->populate_time = std::chrono::nanoseconds{ 0 };
+    this->generation = 0;
+
+    // From here on size means the mapped size
+    size = this->size;
+
+#ifdef __linux__
+    // Sealable so peers can rely on the size, see below
+    unsigned int memfd_flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+
+#ifdef MFD_HUGETLB
+    if (wants_huge_pages)
+    {
+      constexpr std::size_t huge_2mb = std::size_t{ 2 } << 20;
+      constexpr std::size_t huge_1gb = std::size_t{ 1 } << 30;
+      bool gigantic = flags & Memory_Flags::huge_pages_1gb;
+      // log2 of the page size in bits 26..31 (MFD_HUGE_2MB / MFD_HUGE_1GB, not exported by every libc)
+      unsigned int huge_page_bits = (gigantic ? 30u : 21u) << 26;
+      int huge_fd = memfd_create("sasm", memfd_flags | MFD_HUGETLB | huge_page_bits);
+      this->page_size = gigantic ? huge_1gb : huge_2mb;
+      this->size = detail::align_up(size, this->page_size);
+
+      if (huge_fd != -1 && this->size_object(huge_fd))
+      {
+        this->file_mapping = huge_fd;
+
+        // Fails with ENOMEM when the huge page pool is too small, map() closes the descriptor then
+        this->address = this->map();
+
+        if (this->address != nullptr)
+        {
+          this->sync_header();
+          this->populate();
+          return true;
+        }
+      }
+      else if (huge_fd != -1)
+      {
+        ::close(huge_fd);
+      }
+
+      this->size = size;
+      this->page_size = detail::system_page_size();
+    }
+#endif
+
+    // No explicit huge pages available, ask for transparent ones on a 2 MiB rounded segment
+    if (wants_huge_pages || (flags & Memory_Flags::transparent_huge_pages))
+    {
+      this->size = detail::align_up(size, std::size_t{ 2 } << 20);
+      this->transparent_huge_pages = true;
+    }
+
+    int fd = memfd_create("sasm", memfd_flags);
+#else
+    // No memfd here, use a unique shm object and unlink it right away so only the descriptor keeps it alive
+    static std::atomic<std::uint32_t> counter{ 0 };
+    int fd = -1;
+
+    for (int attempt = 0; fd == -1 && attempt < 16; ++attempt)
+    {
+      std::string temporary = "/sasm-" + std::to_string(getpid()) + "-" + std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+      fd = shm_open(temporary.data(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+      if (fd != -1)
+      {
+        shm_unlink(temporary.data());
+      }
+      else if (errno != EEXIST)
+      {
+        break;
+      }
+    }
+#endif
+
+    if (fd == -1)
+    {
+      return false;
+    }
+
+    if (!this->size_object(fd))
+    {
+      ::close(fd);
+      return false;
+    }
+
+#if defined(__linux__) && defined(F_ADD_SEALS)
+    // Nobody can shrink the segment under a peer's mapping (SIGBUS), fixed size ones can't grow either
+    int seals = F_SEAL_SHRINK | ((flags & Memory_Flags::growable) ? 0 : F_SEAL_GROW);
+    fcntl(fd, F_ADD_SEALS, seals);
+#endif
+
+    this->file_mapping = fd;
+    this->address = this->map();
+
+    if (this->address == nullptr)
+    {
+      return false;
+    }
+
+    this->sync_header();
+    this->populate();
+    return true;
+  }
+
+  inline bool Shared_Memory::attach(int fd, Memory_Flags flags)
+  {
+    if (fd == -1)
+    {
+      return false;
+    }
+
+    // Growable segments are sized under the lock, sync_header() releases it
+    if (flags & Memory_Flags::growable)
+    {
+      flock(fd, LOCK_EX);
+    }
+
+    struct stat info;
+    std::size_t header_size = (flags & Memory_Flags::growable) ? Shared_Memory::growable_header_size : 0;
+
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) <= header_size)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    this->name.clear();
+    this->flags = flags;
+    this->size = static_cast<std::size_t>(info.st_size);
+    this->locked = false;
+    this->populate_time = std::chrono::nanoseconds{ 0 };
+    this->generation = 0;
+
+    // hugetlbfs reports its page size as the block size
+    std::size_t base_page = detail::system_page_size();
+    std::size_t block_size = static_cast<std::size_t>(info.st_blksize);
+    this->page_size = block_size > base_page ? block_size : base_page;
+
+    bool wants_huge_pages = (flags & Memory_Flags::huge_pages_2mb) || (flags & Memory_Flags::huge_pages_1gb);
+    this->transparent_huge_pages = this->page_size == base_page && (wants_huge_pages || (flags & Memory_Flags::transparent_huge_pages));
+
+    this->file_mapping = fd;
+    this->address = this->map();
+
+    if (this->address == nullptr)
+    {
+      return false;
+    }
+
+    this->sync_header();
+    this->populate();
+    return true;
+  }
+
+  inline bool Shared_Memory::send_to(int socket) const
+  {
+    if (this->file_mapping == -1)
+    {
+      return false;
+    }
+
+    // The creator's flags travel along so the receiver maps the same layout
+    unsigned int flags = static_cast<unsigned int>(this->flags);
+    return detail::send_fd(socket, this->file_mapping, &flags, sizeof(flags));
+  }
+
+  inline bool Shared_Memory::receive_from(int socket, Memory_Flags flags)
+  {
+    unsigned int sent = 0;
+    int fd = detail::receive_fd(socket, &sent, sizeof(sent));
+
+    if (fd == -1)
+    {
+      return false;
+    }
+
+    // Layout comes from the creator, prefaulting and locking are up to this process
+    constexpr unsigned int local = static_cast<unsigned int>(Memory_Flags::prefault | Memory_Flags::prefault_parallel | Memory_Flags::lock_in_memory);
+    Memory_Flags combined = static_cast<Memory_Flags>((sent & ~local) | (static_cast<unsigned int>(flags) & local));
+
+    return this->attach(fd, combined);
+  }
+#endif
+
+  inline Shared_Memory::Shared_Memory(const std::string& name, std::size_t size, Memory_Flags flags)
+  {
+    this->create(name, size, flags);
+  }
+
+  inline Shared_Memory::~Shared_Memory()
+  {
+    this->close();
+  }
+
+#ifdef __linux__
+  // Futex_Semaphore
+
+  inline std::uint32_t Futex_Semaphore::get_count() const
+  {
+    return this->count.load(std::memory_order_relaxed);
+  }
+
+  inline std::uint32_t Futex_Semaphore::get_waiters() const
+  {
+    return this->waiters.load(std::memory_order_seq_cst);
+  }
+
+  inline std::atomic<std::uint32_t>* Futex_Semaphore::get_word()
+  {
+    return &this->count;
+  }
+
+  inline bool Futex_Semaphore::try_wait()
+  {
+    std::uint32_t current = this->count.load(std::memory_order_relaxed);
+
+    while (current > 0)
+    {
+      if (this->count.compare_exchange_weak(current, current - 1, std::memory_order_acquire, std::memory_order_relaxed))
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  inline bool Futex_Semaphore::wait(unsigned int timeout_ms)
+  {
+    if (this->try_wait())
+    {
+      return true;
+    }
+
+    if (timeout_ms == 0)
+    {
+      return false;
+    }
+
+    struct timespec deadline_storage;
+    const struct timespec* deadline = detail::make_deadline(timeout_ms, deadline_storage);
+
+    // Announce ourselves before re-checking, increment() checks waiters after adding to count
+    this->waiters.fetch_add(1, std::memory_order_seq_cst);
+    bool acquired = false;
+
+    for (;;)
+    {
+      if (this->try_wait())
+      {
+        acquired = true;
+        break;
+      }
+
+      if (detail::futex_wait(&this->count, 0, deadline) == ETIMEDOUT)
+      {
+        acquired = this->try_wait();
+        break;
+      }
+    }
+
+    this->waiters.fetch_sub(1, std::memory_order_relaxed);
+    return acquired;
+  }
+
+  inline bool Futex_Semaphore::increment(int count)
+  {
+    if (count <= 0)
+    {
+      return false;
+    }
+
+    this->count.fetch_add(static_cast<std::uint32_t>(count), std::memory_order_seq_cst);
+
+    // Only enter the kernel when somebody is (about to be) asleep
+    if (this->waiters.load(std::memory_order_seq_cst) != 0)
+    {
+      detail::futex_wake(&this->count, count);
+    }
+
+    return true;
+  }
+
+  inline void Futex_Semaphore::add_waiter()
+  {
+    this->waiters.fetch_add(1, std::memory_order_seq_cst);
+  }
+
+  inline void Futex_Semaphore::remove_waiter()
+  {
+    this->waiters.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  inline Futex_Semaphore::Futex_Semaphore(std::uint32_t initial_count)
+    : count{ initial_count }
+  {
+  }
+
+  // Event_Notifier
+
+  inline int Event_Notifier::get_fd() const
+  {
+    return this->fd;
+  }
+
+  inline bool Event_Notifier::try_wait() const
+  {
+    std::uint64_t value;
+    ssize_t result;
+
+    // Non-blocking descriptor, in semaphore mode every successful read takes exactly 1
+    do
+    {
+      result = read(this->fd, &value, sizeof(value));
+    } while (result == -1 && errno == EINTR);
+
+    return result == sizeof(value);
+  }
+
+  inline bool Event_Notifier::wait(unsigned int timeout_ms) const
+  {
+    if (this->fd == -1)
+    {
+      return false;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    // Another waiter may win the count between poll() and read(), so go around again
+    for (;;)
+    {
+      if (this->try_wait())
+      {
+        return true;
+      }
+
+      int remaining = -1;
+
+      if (timeout_ms != INFINITE)
+      {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+        if (left <= 0)
+        {
+          return this->try_wait();
+        }
+
+        remaining = static_cast<int>(left);
+      }
+
+      struct pollfd entry{ this->fd, POLLIN, 0 };
+
+      if (poll(&entry, 1, remaining) == -1 && errno != EINTR)
+      {
+        return false;
+      }
+    }
+  }
+
+  inline bool Event_Notifier::increment(int count) const
+  {
+    if (this->fd == -1 || count <= 0)
+    {
+      return false;
+    }
+
+    std::uint64_t value = static_cast<std::uint64_t>(count);
+    ssize_t result;
+
+    do
+    {
+      result = write(this->fd, &value, sizeof(value));
+    } while (result == -1 && errno == EINTR);
+
+    return result == sizeof(value);
+  }
+
+  inline void Event_Notifier::close()
+  {
+    if (this->fd != -1)
+    {
+      ::close(this->fd);
+      this->fd = -1;
+    }
+  }
+
+  inline bool Event_Notifier::create(unsigned int initial_count)
+  {
+    this->close();
+    this->fd = eventfd(initial_count, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+    return this->fd != -1;
+  }
+
+  inline bool Event_Notifier::attach(int fd)
+  {
+    this->close();
+
+    // wait() relies on reads never sleeping
+    int status_flags = fd == -1 ? -1 : fcntl(fd, F_GETFL);
+
+    if (status_flags == -1 || (status_flags & O_NONBLOCK) == 0)
+    {
+      return false;
+    }
+
+    this->fd = fd;
+    return true;
+  }
+
+  inline bool Event_Notifier::send_to(int socket) const
+  {
+    return this->fd != -1 && detail::send_fd(socket, this->fd, nullptr, 0);
+  }
+
+  inline bool Event_Notifier::receive_from(int socket)
+  {
+    int received = detail::receive_fd(socket, nullptr, 0);
+
+    if (this->attach(received))
+    {
+      return true;
+    }
+
+    if (received != -1)
+    {
+      ::close(received);
+    }
+
+    return false;
+  }
+
+  inline Event_Notifier::Event_Notifier(unsigned int initial_count)
+  {
+    this->create(initial_count);
+  }
+
+  inline Event_Notifier::~Event_Notifier()
+  {
+    this->close();
+  }
+#endif
+
+#if defined(__linux__) && defined(__cpp_impl_coroutine)
+  // Reactor
+
+  inline bool Reactor::Wait_Awaiter::await_ready()
+  {
+    // Fast path, no suspension when the count is already there
+    this->acquired = this->semaphore != nullptr && this->semaphore->try_wait();
+    return this->acquired || this->semaphore == nullptr || this->timeout_ms == 0;
+  }
+
+  inline void Reactor::Wait_Awaiter::await_suspend(std::coroutine_handle<> handle)
+  {
+    this->handle = handle;
+    this->reactor->enqueue(this);
+  }
+
+  inline bool Reactor::Wait_Awaiter::await_resume() const
+  {
+    return this->acquired;
+  }
+
+  inline Reactor::Wait_Awaiter::Wait_Awaiter(Reactor* reactor, Futex_Semaphore* semaphore, unsigned int timeout_ms)
+    : reactor{ reactor }, semaphore{ semaphore }, timeout_ms{ timeout_ms }
+  {
+  }
+
+  inline void Reactor::enqueue(Wait_Awaiter* awaiter)
+  {
+    auto inserted = this->watches.try_emplace(awaiter->semaphore);
+
+    // First waiter on this word, from now on increment() has to wake us. The next pass of
+    // run() re-checks the count before sleeping, so an increment in between isn't lost.
+    if (inserted.second)
+    {
+      awaiter->semaphore->add_waiter();
+    }
+
+    Watch& watch = inserted.first->second;
+    awaiter->queue_position = watch.waiters.insert(watch.waiters.end(), awaiter);
+    awaiter->deadline_position = this->deadlines.end();
+
+    if (awaiter->timeout_ms != INFINITE)
+    {
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(awaiter->timeout_ms);
+      awaiter->deadline_position = this->deadlines.emplace(deadline, awaiter);
+    }
+  }
+
+  inline void Reactor::complete(Wait_Awaiter* awaiter, bool acquired)
+  {
+    awaiter->acquired = acquired;
+    this->watches[awaiter->semaphore].waiters.erase(awaiter->queue_position);
+
+    if (awaiter->deadline_position != this->deadlines.end())
+    {
+      this->deadlines.erase(awaiter->deadline_position);
+    }
+
+    this->ready.push_back(awaiter->handle);
+  }
+
+  inline void Reactor::collect_ready()
+  {
+    // Hand out whatever count is available, oldest waiter first
+    for (auto& entry : this->watches)
+    {
+      std::list<Wait_Awaiter*>& waiters = entry.second.waiters;
+
+      while (!waiters.empty() && entry.first->try_wait())
+      {
+        this->complete(waiters.front(), true);
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    while (!this->deadlines.empty() && this->deadlines.begin()->first <= now)
+    {
+      this->complete(this->deadlines.begin()->second, false);
+    }
+
+    for (auto it = this->watches.begin(); it != this->watches.end();)
+    {
+      if (it->second.waiters.empty())
+      {
+        it->first->remove_waiter();
+        it = this->watches.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+  inline void Reactor::sleep(std::uint32_t control_value)
+  {
+    detail::Futex_Waitv words[max_watched_words + 1];
+    std::size_t count = 0;
+    words[count++] = detail::Futex_Waitv{ control_value, reinterpret_cast<std::uintptr_t>(&this->control), detail::futex2_size_u32, 0 };
+
+    // Sleep until a watched count leaves 0. futex_waitv() returns right away if one already has.
+    for (auto& entry : this->watches)
+    {
+      if (count == max_watched_words + 1)
+      {
+        break;
+      }
+
+      words[count++] = detail::Futex_Waitv{ 0, reinterpret_cast<std::uintptr_t>(entry.first->get_word()), detail::futex2_size_u32, 0 };
+    }
+
+    struct timespec deadline_storage;
+    const struct timespec* deadline = nullptr;
+
+    if (!this->deadlines.empty())
+    {
+      auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(this->deadlines.begin()->first.time_since_epoch()).count();
+      deadline_storage.tv_sec = static_cast<time_t>(since_epoch / 1000000000);
+      deadline_storage.tv_nsec = static_cast<long>(since_epoch % 1000000000);
+      deadline = &deadline_storage;
+    }
+
+    // More words than one call can watch: poll the overflow every millisecond
+    if (count == max_watched_words + 1 && this->watches.size() > max_watched_words)
+    {
+      detail::make_deadline(1, deadline_storage);
+      deadline = &deadline_storage;
+    }
+
+    // steady_clock is CLOCK_MONOTONIC on Linux
+    syscall(detail::sys_futex_waitv, words, count, 0, deadline, CLOCK_MONOTONIC);
+  }
+
+  inline void Reactor::notify()
+  {
+    this->control.fetch_add(1, std::memory_order_seq_cst);
+    detail::futex_wake(&this->control, 1);
+  }
+
+  inline Reactor::Wait_Awaiter Reactor::async_wait(const Semaphore& semaphore, unsigned int timeout_ms)
+  {
+    return Wait_Awaiter{ this, semaphore.get_object(), timeout_ms };
+  }
+
+  inline Reactor::Wait_Awaiter Reactor::async_wait(Futex_Semaphore& semaphore, unsigned int timeout_ms)
+  {
+    return Wait_Awaiter{ this, &semaphore, timeout_ms };
+  }
+
+  inline void Reactor::post(std::function<void()> function)
+  {
+    {
+      std::lock_guard<std::mutex> guard(this->posted_lock);
+      this->posted.push_back(std::move(function));
+    }
+
+    this->notify();
+  }
+
+  inline void Reactor::run()
+  {
+    std::vector<std::function<void()>> functions;
+    std::vector<std::coroutine_handle<>> resuming;
+
+    while (!this->stopping.load(std::memory_order_acquire))
+    {
+      // Read before looking for work, a post() after this changes the word and voids the sleep
+      std::uint32_t control_value = this->control.load(std::memory_order_seq_cst);
+
+      {
+        std::lock_guard<std::mutex> guard(this->posted_lock);
+        functions.swap(this->posted);
+      }
+
+      for (std::function<void()>& function : functions)
+      {
+        function();
+      }
+
+      this->collect_ready();
+      resuming.swap(this->ready);
+
+      // Resumed coroutines may await again, which only queues them for the next pass
+      for (std::coroutine_handle<> handle : resuming)
+      {
+        handle.resume();
+      }
+
+      bool busy = !functions.empty() || !resuming.empty();
+      functions.clear();
+      resuming.clear();
+
+      if (!busy)
+      {
+        this->sleep(control_value);
+      }
+    }
+
+    this->stopping.store(false, std::memory_order_relaxed);
+  }
+
+  inline void Reactor::stop()
+  {
+    this->stopping.store(true, std::memory_order_release);
+    this->notify();
+  }
+
+  inline Reactor::~Reactor()
+  {
+    for (auto& entry : this->watches)
+    {
+      entry.first->remove_waiter();
+    }
+  }
+#endif
+
+#ifdef __linux__
+  // Uring_Reactor
+
+  inline bool Uring_Reactor::setup_ring(unsigned int entries)
+  {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(detail::sys_io_uring_setup, entries, &params));
+
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    this->ring_fd = fd;
+
+    // Timed waits need IORING_ENTER_EXT_ARG (5.11), far older than the futex opcodes anyway
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+    {
+      return false;
+    }
+
+    this->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+    this->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    std::size_t ring_size = this->sq_ring_size > this->cq_ring_size ? this->sq_ring_size : this->cq_ring_size;
+    this->sq_ring_size = this->cq_ring_size = ring_size;
+
+    void* ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+    if (ring == MAP_FAILED)
+    {
+      return false;
+    }
+
+    // One mapping holds both rings
+    this->sq_ring = ring;
+    this->cq_ring = ring;
+    this->submissions_size = params.sq_entries * sizeof(Submission);
+    void* submissions = mmap(nullptr, this->submissions_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (submissions == MAP_FAILED)
+    {
+      return false;
+    }
+
+    unsigned char* base = static_cast<unsigned char*>(ring);
+    this->submissions = static_cast<Submission*>(submissions);
+    this->sq_head = reinterpret_cast<std::atomic<std::uint32_t>*>(base + params.sq_off.head);
+    this->sq_tail = reinterpret_cast<std::atomic<std::uint32_t>*>(base + params.sq_off.tail);
+    this->sq_array = reinterpret_cast<std::uint32_t*>(base + params.sq_off.array);
+    this->sq_mask = *reinterpret_cast<std::uint32_t*>(base + params.sq_off.ring_mask);
+    this->sq_entries = params.sq_entries;
+    this->cq_head = reinterpret_cast<std::atomic<std::uint32_t>*>(base + params.cq_off.head);
+    this->cq_tail = reinterpret_cast<std::atomic<std::uint32_t>*>(base + params.cq_off.tail);
+    this->cqes = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+    this->cq_mask = *reinterpret_cast<std::uint32_t*>(base + params.cq_off.ring_mask);
+    return true;
+  }
+
+  inline bool Uring_Reactor::probe_futex()
+  {
+    // A FUTEX_WAIT on a word that doesn't hold the expected value fails with EAGAIN right away,
+    // kernels without the opcode answer EINVAL
+    std::atomic<std::uint32_t> word{ 1 };
+    Submission* submission = this->next_submission();
+
+    if (submission == nullptr)
+    {
+      return false;
+    }
+
+    submission->opcode = detail::uring_op_futex_wait;
+    submission->fd = static_cast<std::int32_t>(detail::futex2_size_u32);
+    submission->address = reinterpret_cast<std::uintptr_t>(&word);
+    submission->offset = 0;
+    submission->address3 = FUTEX_BITSET_MATCH_ANY;
+
+    if (this->enter(this->unsubmitted, 1, INFINITE) < 0)
+    {
+      return false;
+    }
+
+    std::uint32_t head = this->cq_head->load(std::memory_order_relaxed);
+
+    if (head == this->cq_tail->load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    int result = this->cqes[head & this->cq_mask].res;
+    this->cq_head->store(head + 1, std::memory_order_release);
+    return result == -EAGAIN;
+  }
+
+  inline Uring_Reactor::Submission* Uring_Reactor::next_submission()
+  {
+    std::uint32_t tail = this->sq_tail->load(std::memory_order_relaxed);
+
+    // Full, hand the batch to the kernel first (without SQPOLL it consumes everything right away)
+    if (tail - this->sq_head->load(std::memory_order_acquire) == this->sq_entries)
+    {
+      this->enter(this->unsubmitted, 0, 0);
+
+      if (tail - this->sq_head->load(std::memory_order_acquire) == this->sq_entries)
+      {
+        return nullptr;
+      }
+    }
+
+    // The kernel only reads the queue inside io_uring_enter() on this thread, so publishing
+    // the tail before the caller fills the entry in is fine
+    std::uint32_t index = tail & this->sq_mask;
+    Submission* submission = &this->submissions[index];
+    std::memset(submission, 0, sizeof(Submission));
+    this->sq_array[index] = index;
+    this->sq_tail->store(tail + 1, std::memory_order_release);
+    ++this->unsubmitted;
+    return submission;
+  }
+
+  inline int Uring_Reactor::enter(std::uint32_t to_submit, std::uint32_t min_complete, unsigned int timeout_ms)
+  {
+    struct
+    {
+      std::int64_t seconds;
+      std::int64_t nanoseconds;
+    } timeout{ timeout_ms / 1000, (timeout_ms % 1000) * std::int64_t{ 1000000 } };
+
+    struct io_uring_getevents_arg argument;
+    std::memset(&argument, 0, sizeof(argument));
+    argument.ts = reinterpret_cast<std::uintptr_t>(&timeout);
+
+    unsigned int flags = min_complete != 0 ? IORING_ENTER_GETEVENTS : 0;
+    bool timed = min_complete != 0 && timeout_ms != INFINITE;
+    flags |= timed ? IORING_ENTER_EXT_ARG : 0;
+
+    long result = syscall(detail::sys_io_uring_enter, this->ring_fd, to_submit, min_complete, flags,
+      timed ? static_cast<void*>(&argument) : nullptr, timed ? sizeof(argument) : 0);
+
+    // Timeouts and signals still consumed what was submitted
+    if (result >= 0)
+    {
+      this->unsubmitted -= static_cast<std::uint32_t>(result) < this->unsubmitted ? static_cast<std::uint32_t>(result) : this->unsubmitted;
+      return static_cast<int>(result);
+    }
+
+    return -errno;
+  }
+
+  inline void Uring_Reactor::arm(Operation* operation)
+  {
+    if (this->ring_fd != -1)
+    {
+      Submission* submission = this->next_submission();
+
+      // The kernel didn't take the queued batch either, retry before the next wait
+      if (submission == nullptr)
+      {
+        this->overflow.push_back(operation);
+        return;
+      }
+
+      submission->user_data = reinterpret_cast<std::uintptr_t>(operation);
+
+      if (operation->semaphore != nullptr)
+      {
+        // Sleeps while the count is 0, completes with EAGAIN if it isn't by submission time
+        submission->opcode = detail::uring_op_futex_wait;
+        submission->fd = static_cast<std::int32_t>(detail::futex2_size_u32);
+        submission->address = reinterpret_cast<std::uintptr_t>(operation->semaphore->get_word());
+        submission->offset = 0;
+        submission->address3 = FUTEX_BITSET_MATCH_ANY;
+      }
+      else
+      {
+        submission->opcode = IORING_OP_POLL_ADD;
+        submission->fd = operation->notifier->get_fd();
+        submission->op_flags = POLLIN;
+      }
+
+      return;
+    }
+
+    if (operation->semaphore != nullptr)
+    {
+      {
+        std::lock_guard<std::mutex> guard(this->futex_lock);
+        this->futex_waiters.push_back(operation);
+      }
+
+      this->notify_helper();
+      return;
+    }
+
+    // Several waits on one notifier each need their own epoll registration, so each gets a dup
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = operation;
+
+    if (operation->fd == -1)
+    {
+      operation->fd = fcntl(operation->notifier->get_fd(), F_DUPFD_CLOEXEC, 0);
+      epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, operation->fd, &event);
+    }
+    else
+    {
+      epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, operation->fd, &event);
+    }
+  }
+
+  inline bool Uring_Reactor::finish(Operation* operation)
+  {
+    bool acquired = operation->semaphore != nullptr ? operation->semaphore->try_wait() : operation->notifier->try_wait();
+
+    if (!acquired)
+    {
+      return false;
+    }
+
+    if (operation->semaphore != nullptr)
+    {
+      operation->semaphore->remove_waiter();
+    }
+
+    if (operation->fd != -1)
+    {
+      epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, operation->fd, nullptr);
+      ::close(operation->fd);
+    }
+
+    // The callback may queue new waits, so the operation goes first
+    Callback callback = std::move(operation->callback);
+    this->operations.erase(operation->position);
+    callback();
+    return true;
+  }
+
+  inline void Uring_Reactor::helper_loop()
+  {
+    std::vector<detail::Futex_Waitv> words;
+    std::vector<Futex_Semaphore*> semaphores;
+
+    while (!this->stopping.load(std::memory_order_acquire))
+    {
+      std::uint32_t control_value = this->control.load(std::memory_order_seq_cst);
+      semaphores.clear();
+
+      {
+        std::lock_guard<std::mutex> guard(this->futex_lock);
+
+        for (Operation* operation : this->futex_waiters)
+        {
+          if (std::find(semaphores.begin(), semaphores.end(), operation->semaphore) == semaphores.end())
+          {
+            semaphores.push_back(operation->semaphore);
+          }
+        }
+      }
+
+      if (semaphores.empty())
+      {
+        detail::futex_wait(&this->control, control_value, nullptr);
+        continue;
+      }
+
+      words.clear();
+      words.push_back(detail::Futex_Waitv{ control_value, reinterpret_cast<std::uintptr_t>(&this->control), detail::futex2_size_u32, 0 });
+
+      for (std::size_t i = 0; i < semaphores.size() && i < Uring_Reactor::max_watched_words; ++i)
+      {
+        words.push_back(detail::Futex_Waitv{ 0, reinterpret_cast<std::uintptr_t>(semaphores[i]->get_word()), detail::futex2_size_u32, 0 });
+      }
+
+      // More words than one call can watch: poll the overflow every millisecond, like Reactor
+      struct timespec deadline_storage;
+      const struct timespec* deadline = nullptr;
+
+      if (semaphores.size() > Uring_Reactor::max_watched_words)
+      {
+        deadline = detail::make_deadline(1, deadline_storage);
+      }
+
+      syscall(detail::sys_futex_waitv, words.data(), words.size(), 0, deadline, CLOCK_MONOTONIC);
+
+      bool available = false;
+
+      for (Futex_Semaphore* semaphore : semaphores)
+      {
+        available = available || semaphore->get_count() != 0;
+      }
+
+      // Wake the epoll loop, then stay put until it has handed the counts out (it bumps control)
+      if (available)
+      {
+        std::uint64_t one = 1;
+        ssize_t written = write(this->event_fd, &one, sizeof(one));
+        (void)written;
+        detail::futex_wait(&this->control, control_value, nullptr);
+      }
+    }
+  }
+
+  inline void Uring_Reactor::notify_helper()
+  {
+    this->control.fetch_add(1, std::memory_order_seq_cst);
+    detail::futex_wake(&this->control, 1);
+  }
+
+  inline std::size_t Uring_Reactor::run_ring(unsigned int timeout_ms)
+  {
+    // arm() puts them back if the queue is still full
+    std::vector<Operation*> retry;
+    retry.swap(this->overflow);
+
+    for (Operation* operation : retry)
+    {
+      this->arm(operation);
+    }
+
+    if (this->operations.empty())
+    {
+      // Nothing to wait for, just flush queued wakes
+      if (this->unsubmitted != 0)
+      {
+        this->enter(this->unsubmitted, 0, 0);
+      }
+
+      return 0;
+    }
+
+    // Don't sleep on the kernel while waits it hasn't seen yet are left over
+    bool pending = this->cq_head->load(std::memory_order_relaxed) != this->cq_tail->load(std::memory_order_acquire) || !this->overflow.empty();
+    this->enter(this->unsubmitted, pending ? 0 : 1, timeout_ms);
+
+    std::vector<Operation*> completed;
+    std::uint32_t head = this->cq_head->load(std::memory_order_relaxed);
+    std::uint32_t tail = this->cq_tail->load(std::memory_order_acquire);
+
+    for (; head != tail; ++head)
+    {
+      // Wakes carry no operation
+      if (std::uint64_t user_data = this->cqes[head & this->cq_mask].user_data)
+      {
+        completed.push_back(reinterpret_cast<Operation*>(static_cast<std::uintptr_t>(user_data)));
+      }
+    }
+
+    this->cq_head->store(tail, std::memory_order_release);
+    std::size_t callbacks = 0;
+
+    // Whatever the result (woken, EAGAIN, spurious), the count decides. Losers go back to sleep.
+    for (Operation* operation : completed)
+    {
+      if (this->finish(operation))
+      {
+        ++callbacks;
+      }
+      else
+      {
+        this->arm(operation);
+      }
+    }
+
+    return callbacks;
+  }
+
+  inline std::size_t Uring_Reactor::run_epoll(unsigned int timeout_ms)
+  {
+    struct epoll_event events[64];
+    int count = epoll_wait(this->epoll_fd, events, 64, timeout_ms == INFINITE ? -1 : static_cast<int>(timeout_ms));
+    std::size_t callbacks = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+      Operation* operation = static_cast<Operation*>(events[i].data.ptr);
+
+      if (operation != nullptr)
+      {
+        if (this->finish(operation))
+        {
+          ++callbacks;
+        }
+        else
+        {
+          this->arm(operation);
+        }
+
+        continue;
+      }
+
+      std::uint64_t value;
+      ssize_t read_size = read(this->event_fd, &value, sizeof(value));
+      (void)read_size;
+
+      // Hand counts out oldest first, callbacks run outside the lock since they may queue waits
+      std::vector<Operation*> acquired;
+
+      {
+        std::lock_guard<std::mutex> guard(this->futex_lock);
+
+        for (auto it = this->futex_waiters.begin(); it != this->futex_waiters.end();)
+        {
+          if ((*it)->semaphore->try_wait())
+          {
+            acquired.push_back(*it);
+            it = this->futex_waiters.erase(it);
+          }
+          else
+          {
+            ++it;
+          }
+        }
+      }
+
+      // Lets the helper go back to sleep on the words
+      this->notify_helper();
+
+      for (Operation* waiter : acquired)
+      {
+        waiter->semaphore->remove_waiter();
+        Callback callback = std::move(waiter->callback);
+        this->operations.erase(waiter->position);
+        callback();
+        ++callbacks;
+      }
+    }
+
+    return callbacks;
+  }
+
+  inline bool Uring_Reactor::uses_io_uring() const
+  {
+    return this->ring_fd != -1;
+  }
+
+  inline int Uring_Reactor::get_fd() const
+  {
+    return this->ring_fd != -1 ? this->ring_fd : this->epoll_fd;
+  }
+
+  inline void Uring_Reactor::async_wait(Futex_Semaphore& semaphore, Callback callback)
+  {
+    this->operations.push_back(Operation{ &semaphore, nullptr, std::move(callback), -1, {} });
+    Operation* operation = &this->operations.back();
+    operation->position = std::prev(this->operations.end());
+
+    // Registered before the kernel compares the word, so increment() wakes us from then on
+    semaphore.add_waiter();
+    this->arm(operation);
+  }
+
+  inline void Uring_Reactor::async_wait(const Semaphore& semaphore, Callback callback)
+  {
+    // Nothing to wait on, the callback could never run
+    if (semaphore.get_object() == nullptr)
+    {
+      return;
+    }
+
+    this->async_wait(*semaphore.get_object(), std::move(callback));
+  }
+
+  inline void Uring_Reactor::async_wait(const Event_Notifier& notifier, Callback callback)
+  {
+    this->operations.push_back(Operation{ nullptr, &notifier, std::move(callback), -1, {} });
+    Operation* operation = &this->operations.back();
+    operation->position = std::prev(this->operations.end());
+    this->arm(operation);
+  }
+
+  inline bool Uring_Reactor::increment(Futex_Semaphore& semaphore, int count)
+  {
+    if (this->ring_fd == -1 || count <= 0)
+    {
+      return semaphore.increment(count);
+    }
+
+    semaphore.get_word()->fetch_add(static_cast<std::uint32_t>(count), std::memory_order_seq_cst);
+
+    if (semaphore.get_waiters() == 0)
+    {
+      return true;
+    }
+
+    Submission* submission = this->next_submission();
+
+    if (submission == nullptr)
+    {
+      detail::futex_wake(semaphore.get_word(), count);
+      return true;
+    }
+
+    submission->opcode = detail::uring_op_futex_wake;
+    submission->fd = static_cast<std::int32_t>(detail::futex2_size_u32);
+    submission->address = reinterpret_cast<std::uintptr_t>(semaphore.get_word());
+    submission->offset = static_cast<std::uint64_t>(count);
+    submission->address3 = FUTEX_BITSET_MATCH_ANY;
+    return true;
+  }
+
+  inline std::size_t Uring_Reactor::run_once(unsigned int timeout_ms)
+  {
+    if (this->ring_fd != -1)
+    {
+      return this->run_ring(timeout_ms);
+    }
+
+    return this->epoll_fd != -1 ? this->run_epoll(timeout_ms) : 0;
+  }
+
+  inline void Uring_Reactor::close()
+  {
+    if (this->helper.joinable())
+    {
+      this->stopping.store(true, std::memory_order_release);
+      this->notify_helper();
+      this->helper.join();
+      this->stopping.store(false, std::memory_order_relaxed);
+    }
+
+    for (Operation& operation : this->operations)
+    {
+      if (operation.semaphore != nullptr)
+      {
+        operation.semaphore->remove_waiter();
+      }
+
+      if (operation.fd != -1)
+      {
+        ::close(operation.fd);
+      }
+    }
+
+    this->operations.clear();
+    this->futex_waiters.clear();
+    this->overflow.clear();
+
+    if (this->submissions != nullptr)
+    {
+      munmap(this->submissions, this->submissions_size);
+    }
+
+    if (this->sq_ring != nullptr)
+    {
+      munmap(this->sq_ring, this->sq_ring_size);
+    }
+
+    // Closing the ring cancels whatever is still in flight
+    for (int* fd : { &this->ring_fd, &this->epoll_fd, &this->event_fd })
+    {
+      if (*fd != -1)
+      {
+        ::close(*fd);
+        *fd = -1;
+      }
+    }
+
+    this->sq_ring = nullptr;
+    this->cq_ring = nullptr;
+    this->submissions = nullptr;
+    this->unsubmitted = 0;
+  }
+
+  inline bool Uring_Reactor::create(unsigned int entries, Backend backend)
+  {
+    this->close();
+
+    if (backend == Backend::automatic && this->setup_ring(entries) && this->probe_futex())
+    {
+      return true;
+    }
+
+    // No io_uring, a kernel older than 6.7, or the caller asked for the fallback
+    this->close();
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    this->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    struct epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+
+    if (this->epoll_fd == -1 || this->event_fd == -1 || epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->event_fd, &event) != 0)
+    {
+      this->close();
+      return false;
+    }
+
+    this->helper = std::thread(&Uring_Reactor::helper_loop, this);
+    return true;
+  }
+
+  inline Uring_Reactor::Uring_Reactor(unsigned int entries, Backend backend)
+  {
+    this->create(entries, backend);
+  }
+
+  inline Uring_Reactor::~Uring_Reactor()
+  {
+    this->close();
+  }
+#endif
+
+#ifdef __linux__
+  // Robust_Mutex
+
+  inline void Robust_Mutex::initialize()
+  {
+    // One load once set up, the rest is for the first user of a fresh segment
+    if (this->state.load(std::memory_order_acquire) == 2)
+    {
+      return;
+    }
+
+    detail::initialize_once(this->state, [&]
+    {
+      pthread_mutexattr_t attributes;
+      pthread_mutexattr_init(&attributes);
+      pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init(&this->mutex, &attributes);
+      pthread_mutexattr_destroy(&attributes);
+    });
+  }
+
+  inline Lock_Status Robust_Mutex::lock(unsigned int timeout_ms)
+  {
+    if (timeout_ms == 0)
+    {
+      Lock_Status status = this->try_lock();
+      return status == Lock_Status::busy ? Lock_Status::timed_out : status;
+    }
+
+    this->initialize();
+
+    if (this->health.load(std::memory_order_acquire) == 2)
+    {
+      return Lock_Status::not_recoverable;
+    }
+
+    int result;
+
+    if (timeout_ms == INFINITE)
+    {
+      result = pthread_mutex_lock(&this->mutex);
+    }
+    else
+    {
+      struct timespec deadline;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+      detail::make_deadline(timeout_ms, deadline);
+      result = pthread_mutex_clocklock(&this->mutex, CLOCK_MONOTONIC, &deadline);
+#else
+      // Older C libraries only take CLOCK_REALTIME deadlines
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += timeout_ms / 1000;
+      deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+
+      if (deadline.tv_nsec >= 1000000000)
+      {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+      }
+
+      result = pthread_mutex_timedlock(&this->mutex, &deadline);
+#endif
+    }
+
+    switch (result)
+    {
+    case 0:
+      return Lock_Status::acquired;
+    case EOWNERDEAD:
+      this->health.store(1, std::memory_order_relaxed);
+      return Lock_Status::owner_died;
+    case ENOTRECOVERABLE:
+      return Lock_Status::not_recoverable;
+    case ETIMEDOUT:
+      return Lock_Status::timed_out;
+    default:
+      return Lock_Status::failed;
+    }
+  }
+
+  inline Lock_Status Robust_Mutex::try_lock()
+  {
+    this->initialize();
+
+    if (this->health.load(std::memory_order_acquire) == 2)
+    {
+      return Lock_Status::not_recoverable;
+    }
+
+    switch (pthread_mutex_trylock(&this->mutex))
+    {
+    case 0:
+      return Lock_Status::acquired;
+    case EOWNERDEAD:
+      this->health.store(1, std::memory_order_relaxed);
+      return Lock_Status::owner_died;
+    case ENOTRECOVERABLE:
+      return Lock_Status::not_recoverable;
+    case EBUSY:
+      return Lock_Status::busy;
+    default:
+      return Lock_Status::failed;
+    }
+  }
+
+  inline void Robust_Mutex::unlock()
+  {
+    // Unlocking without make_consistent() makes the mutex unusable for good, publish that first
+    if (this->health.load(std::memory_order_relaxed) == 1)
+    {
+      this->health.store(2, std::memory_order_release);
+    }
+
+    pthread_mutex_unlock(&this->mutex);
+  }
+
+  inline bool Robust_Mutex::make_consistent()
+  {
+    if (pthread_mutex_consistent(&this->mutex) != 0)
+    {
+      return false;
+    }
+
+    this->health.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  inline Robust_Mutex::Robust_Mutex()
+  {
+    this->initialize();
+  }
+#endif
+
+#ifdef __linux__
+  // Shared_Rw_Lock
+
+  template <std::size_t Slots>
+  void Shared_Rw_Lock<Slots>::wait_for_writer()
+  {
+    std::uint32_t current = this->writer.load(std::memory_order_relaxed);
+
+    while (current != 0)
+    {
+      // Mark the word so unlock() knows to wake us
+      if (current == 2 || this->writer.compare_exchange_weak(current, 2, std::memory_order_relaxed))
+      {
+        detail::futex_wait(&this->writer, 2, nullptr);
+      }
+
+      current = this->writer.load(std::memory_order_relaxed);
+    }
+  }
+
+  template <std::size_t Slots>
+  typename Shared_Rw_Lock<Slots>::Ticket Shared_Rw_Lock<Slots>::lock_shared()
+  {
+    int cpu = sched_getcpu();
+    Ticket ticket = static_cast<Ticket>(cpu < 0 ? 0 : cpu) % Slots;
+
+    while (!this->try_lock_shared(ticket))
+    {
+      this->wait_for_writer();
+    }
+
+    return ticket;
+  }
+
+  template <std::size_t Slots>
+  bool Shared_Rw_Lock<Slots>::try_lock_shared(Ticket& ticket)
+  {
+    ticket %= Slots;
+    std::atomic<std::uint32_t>& readers = this->slots[ticket].readers;
+
+    // Count ourselves first, then look for a writer. The writer does the opposite, so with
+    // both sequentially consistent at least one of us sees the other.
+    readers.fetch_add(1, std::memory_order_seq_cst);
+
+    if (this->writer.load(std::memory_order_seq_cst) == 0)
+    {
+      return true;
+    }
+
+    this->unlock_shared(ticket);
+    return false;
+  }
+
+  template <std::size_t Slots>
+  void Shared_Rw_Lock<Slots>::unlock_shared(Ticket ticket)
+  {
+    std::atomic<std::uint32_t>& readers = this->slots[ticket % Slots].readers;
+
+    // Last reader out of a slot a writer may be draining wakes it
+    if (readers.fetch_sub(1, std::memory_order_seq_cst) == 1 && this->writer.load(std::memory_order_seq_cst) != 0)
+    {
+      detail::futex_wake(&readers, 1);
+    }
+  }
+
+  template <std::size_t Slots>
+  void Shared_Rw_Lock<Slots>::lock()
+  {
+    std::uint32_t expected = 0;
+
+    // Uncontended: a single CAS. Contended writers always mark the word so nobody sleeps through an unlock.
+    if (!this->writer.compare_exchange_strong(expected, 1, std::memory_order_seq_cst))
+    {
+      while (this->writer.exchange(2, std::memory_order_seq_cst) != 0)
+      {
+        detail::futex_wait(&this->writer, 2, nullptr);
+      }
+    }
+
+    // Readers already inside finish, new ones back off
+    for (Slot& slot : this->slots)
+    {
+      std::uint32_t readers = slot.readers.load(std::memory_order_seq_cst);
+
+      while (readers != 0)
+      {
+        detail::futex_wait(&slot.readers, readers, nullptr);
+        readers = slot.readers.load(std::memory_order_seq_cst);
+      }
+    }
+  }
+
+  template <std::size_t Slots>
+  bool Shared_Rw_Lock<Slots>::try_lock()
+  {
+    std::uint32_t expected = 0;
+
+    if (!this->writer.compare_exchange_strong(expected, 1, std::memory_order_seq_cst))
+    {
+      return false;
+    }
+
+    for (Slot& slot : this->slots)
+    {
+      if (slot.readers.load(std::memory_order_seq_cst) != 0)
+      {
+        this->unlock();
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  template <std::size_t Slots>
+  void Shared_Rw_Lock<Slots>::unlock()
+  {
+    // Backed off readers and queued writers all sleep on the writer word
+    if (this->writer.exchange(0, std::memory_order_seq_cst) == 2)
+    {
+      detail::futex_wake(&this->writer, INT32_MAX);
+    }
+  }
+#endif
+
+#ifdef __linux__
+  // Futex_Mutex
+
+  inline bool Futex_Mutex::lock_contended(const struct timespec* deadline)
+  {
+    // Whoever gets it out of here leaves 2 behind, so its unlock wakes the next sleeper
+    while (this->word.exchange(2, std::memory_order_acquire) != 0)
+    {
+      if (detail::futex_wait(&this->word, 2, deadline) == ETIMEDOUT)
+      {
+        return this->word.exchange(2, std::memory_order_acquire) == 0;
+      }
+    }
+
+    return true;
+  }
+
+  inline std::atomic<std::uint32_t>* Futex_Mutex::get_word()
+  {
+    return &this->word;
+  }
+
+  inline bool Futex_Mutex::lock(unsigned int timeout_ms)
+  {
+    if (this->try_lock())
+    {
+      return true;
+    }
+
+    if (timeout_ms == 0)
+    {
+      return false;
+    }
+
+    struct timespec deadline_storage;
+    return this->lock_contended(detail::make_deadline(timeout_ms, deadline_storage));
+  }
+
+  inline bool Futex_Mutex::try_lock()
+  {
+    std::uint32_t expected = 0;
+    return this->word.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  inline void Futex_Mutex::unlock()
+  {
+    // Only enter the kernel when somebody may be asleep
+    if (this->word.exchange(0, std::memory_order_release) == 2)
+    {
+      detail::futex_wake(&this->word, 1);
+    }
+  }
+
+  // Shared_Condition_Variable
+
+  inline bool Shared_Condition_Variable::wait(Futex_Mutex& mutex, unsigned int timeout_ms)
+  {
+    struct timespec deadline_storage;
+    const struct timespec* deadline = detail::make_deadline(timeout_ms, deadline_storage);
+
+    std::uint32_t sequence = this->sequence.load(std::memory_order_relaxed);
+    this->waiters.fetch_add(1, std::memory_order_seq_cst);
+    mutex.unlock();
+
+    bool timed_out = detail::futex_wait(&this->sequence, sequence, deadline) == ETIMEDOUT;
+    this->waiters.fetch_sub(1, std::memory_order_relaxed);
+
+    // We may have been requeued onto the mutex word, so relock as a contended locker.
+    // Doesn't time out, the caller expects to own the mutex again either way.
+    mutex.lock_contended(nullptr);
+    return !timed_out;
+  }
+
+  template <typename Lock>
+  bool Shared_Condition_Variable::wait(Lock& lock, unsigned int timeout_ms)
+  {
+    struct timespec deadline_storage;
+    const struct timespec* deadline = detail::make_deadline(timeout_ms, deadline_storage);
+
+    std::uint32_t sequence = this->sequence.load(std::memory_order_relaxed);
+    this->waiters.fetch_add(1, std::memory_order_seq_cst);
+    lock.unlock();
+
+    bool timed_out = detail::futex_wait(&this->sequence, sequence, deadline) == ETIMEDOUT;
+    this->waiters.fetch_sub(1, std::memory_order_relaxed);
+    lock.lock();
+    return !timed_out;
+  }
+
+  inline void Shared_Condition_Variable::notify_one()
+  {
+    this->sequence.fetch_add(1, std::memory_order_seq_cst);
+
+    if (this->waiters.load(std::memory_order_seq_cst) != 0)
+    {
+      detail::futex_wake(&this->sequence, 1);
+    }
+  }
+
+  inline void Shared_Condition_Variable::notify_all()
+  {
+    this->sequence.fetch_add(1, std::memory_order_seq_cst);
+
+    if (this->waiters.load(std::memory_order_seq_cst) != 0)
+    {
+      detail::futex_wake(&this->sequence, INT32_MAX);
+    }
+  }
+
+  inline void Shared_Condition_Variable::notify_all(Futex_Mutex& mutex)
+  {
+    std::uint32_t sequence = this->sequence.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+    if (this->waiters.load(std::memory_order_seq_cst) == 0)
+    {
+      return;
+    }
+
+    // We hold the mutex, mark it contended so our unlock wakes the first requeued waiter
+    mutex.word.store(2, std::memory_order_relaxed);
+
+    // Fails with EAGAIN if another notify moved the sequence on, then just wake everybody
+    if (detail::futex_requeue(&this->sequence, sequence, 1, &mutex.word) == EAGAIN)
+    {
+      detail::futex_wake(&this->sequence, INT32_MAX);
+    }
+  }
+
+  // Shared_Event
+
+  inline bool Shared_Event::try_consume()
+  {
+    if (this->manual_reset)
+    {
+      return this->state.load(std::memory_order_acquire) != 0;
+    }
+
+    std::uint32_t expected = 1;
+    return this->state.compare_exchange_strong(expected, 0, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  inline bool Shared_Event::is_set() const
+  {
+    return this->state.load(std::memory_order_acquire) != 0;
+  }
+
+  inline bool Shared_Event::is_manual_reset() const
+  {
+    return this->manual_reset != 0;
+  }
+
+  inline bool Shared_Event::wait(unsigned int timeout_ms)
+  {
+    if (this->try_consume())
+    {
+      return true;
+    }
+
+    if (timeout_ms == 0)
+    {
+      return false;
+    }
+
+    struct timespec deadline_storage;
+    const struct timespec* deadline = detail::make_deadline(timeout_ms, deadline_storage);
+
+    // Same handshake as Futex_Semaphore: announce, re-check, sleep while unset
+    this->waiters.fetch_add(1, std::memory_order_seq_cst);
+    bool signaled = false;
+
+    for (;;)
+    {
+      if (this->try_consume())
+      {
+        signaled = true;
+        break;
+      }
+
+      if (detail::futex_wait(&this->state, 0, deadline) == ETIMEDOUT)
+      {
+        signaled = this->try_consume();
+        break;
+      }
+    }
+
+    this->waiters.fetch_sub(1, std::memory_order_relaxed);
+    return signaled;
+  }
+
+  inline void Shared_Event::set()
+  {
+    this->state.store(1, std::memory_order_seq_cst);
+
+    if (this->waiters.load(std::memory_order_seq_cst) != 0)
+    {
+      // Auto reset lets one through, waking more would only have them race for it
+      detail::futex_wake(&this->state, this->manual_reset ? INT32_MAX : 1);
+    }
+  }
+
+  inline void Shared_Event::reset()
+  {
+    this->state.store(0, std::memory_order_release);
+  }
+
+  inline Shared_Event::Shared_Event(bool manual_reset, bool initially_set)
+    : state{ initially_set ? 1u : 0u }, manual_reset{ manual_reset ? 1u : 0u }
+  {
+  }
+#endif
+
+#ifdef __linux__
+  // Shared_Barrier
+
+  inline std::uint32_t Shared_Barrier::get_participants() const
+  {
+    return this->participants;
+  }
+
+  inline std::uint32_t Shared_Barrier::get_generation() const
+  {
+    return this->generation.load(std::memory_order_acquire);
+  }
+
+  inline bool Shared_Barrier::arrive_and_wait()
+  {
+    // Read before arriving, the last arrival can't move it on until we've counted ourselves
+    std::uint32_t generation = this->generation.load(std::memory_order_acquire);
+
+    if (this->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == this->participants)
+    {
+      // Reset first: nobody can arrive for the next generation before it's published
+      this->arrived.store(0, std::memory_order_relaxed);
+      this->generation.fetch_add(1, std::memory_order_release);
+      detail::futex_wake(&this->generation, INT32_MAX);
+      return true;
+    }
+
+    while (this->generation.load(std::memory_order_acquire) == generation)
+    {
+      detail::futex_wait(&this->generation, generation, nullptr);
+    }
+
+    return false;
+  }
+
+  inline Shared_Barrier::Shared_Barrier(std::uint32_t participants)
+    : participants{ participants == 0 ? 1 : participants }
+  {
+  }
+
+  // Shared_Latch
+
+  inline std::uint32_t Shared_Latch::get_count() const
+  {
+    return this->count.load(std::memory_order_acquire);
+  }
+
+  inline void Shared_Latch::count_down(std::uint32_t amount)
+  {
+    std::uint32_t current = this->count.load(std::memory_order_relaxed);
+
+    // Saturate at 0 rather than wrap around
+    do
+    {
+      if (current == 0)
+      {
+        return;
+      }
+    } while (!this->count.compare_exchange_weak(current, current > amount ? current - amount : 0, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    if (current <= amount)
+    {
+      detail::futex_wake(&this->count, INT32_MAX);
+    }
+  }
+
+  inline bool Shared_Latch::try_wait() const
+  {
+    return this->count.load(std::memory_order_acquire) == 0;
+  }
+
+  inline bool Shared_Latch::wait(unsigned int timeout_ms)
+  {
+    struct timespec deadline_storage;
+    const struct timespec* deadline = detail::make_deadline(timeout_ms, deadline_storage);
+    std::uint32_t current = this->count.load(std::memory_order_acquire);
+
+    // Intermediate count downs change the word too, those just send us around again
+    while (current != 0)
+    {
+      if (timeout_ms == 0 || detail::futex_wait(&this->count, current, deadline) == ETIMEDOUT)
+      {
+        return this->try_wait();
+      }
+
+      current = this->count.load(std::memory_order_acquire);
+    }
+
+    return true;
+  }
+
+  inline bool Shared_Latch::arrive_and_wait(std::uint32_t amount, unsigned int timeout_ms)
+  {
+    this->count_down(amount);
+    return this->wait(timeout_ms);
+  }
+
+  inline Shared_Latch::Shared_Latch(std::uint32_t count)
+    : count{ count }
+  {
+  }
+#endif
+
+#ifdef __linux__
+  // Semaphore_Array::Handle
+
+  inline std::size_t Semaphore_Array::Handle::get_index() const
+  {
+    return this->index;
+  }
+
+  inline std::uint32_t Semaphore_Array::Handle::get_count() const
+  {
+    return this->semaphore == nullptr ? 0 : this->semaphore->get_count();
+  }
+
+  inline Futex_Semaphore* Semaphore_Array::Handle::get_object() const
+  {
+    return this->semaphore;
+  }
+
+  inline bool Semaphore_Array::Handle::try_wait() const
+  {
+    return this->semaphore != nullptr && this->semaphore->try_wait();
+  }
+
+  inline bool Semaphore_Array::Handle::wait(unsigned int timeout_ms) const
+  {
+    return this->semaphore != nullptr && this->semaphore->wait(timeout_ms);
+  }
+
+  inline bool Semaphore_Array::Handle::increment(int count) const
+  {
+    return this->semaphore != nullptr && this->semaphore->increment(count);
+  }
+
+  inline Semaphore_Array::Handle::operator bool() const
+  {
+    return this->semaphore != nullptr;
+  }
+
+  // Semaphore_Array
+
+  inline const Shared_Memory& Semaphore_Array::get_shared_memory() const
+  {
+    return this->memory;
+  }
+
+  inline std::size_t Semaphore_Array::size() const
+  {
+    return this->header == nullptr ? 0 : static_cast<std::size_t>(this->header->size);
+  }
+
+  inline Semaphore_Array::Handle Semaphore_Array::get(std::size_t index) const
+  {
+    Handle handle;
+
+    if (index < this->size())
+    {
+      handle.semaphore = &this->slots[index].semaphore;
+      handle.index = index;
+    }
+
+    return handle;
+  }
+
+  inline Semaphore_Array::Handle Semaphore_Array::operator[](std::size_t index) const
+  {
+    return this->get(index);
+  }
+
+  inline void Semaphore_Array::close()
+  {
+    this->memory.close();
+    this->header = nullptr;
+    this->slots = nullptr;
+  }
+
+  inline bool Semaphore_Array::create(const std::string& name, std::size_t size, std::uint32_t initial_count)
+  {
+    if (size == 0)
+    {
+      return false;
+    }
+
+    if (!this->memory.create(name, Semaphore_Array::slots_offset + size * sizeof(Slot)))
+    {
+      this->close();
+      return false;
+    }
+
+    unsigned char* base = static_cast<unsigned char*>(this->memory.get_address());
+    this->header = reinterpret_cast<Header*>(base);
+    this->slots = reinterpret_cast<Slot*>(base + Semaphore_Array::slots_offset);
+
+    // Zero filled slots already are semaphores with a count of 0
+    detail::initialize_once(this->header->state, [&]
+    {
+      this->header->size = size;
+
+      if (initial_count != 0)
+      {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+          new (&this->slots[i].semaphore) Futex_Semaphore(initial_count);
+        }
+      }
+    });
+
+    // Attached to an array that was created with a different size. Only detach, the name still
+    // belongs to whoever created it.
+    if (this->header->size != size)
+    {
+      this->memory.detach();
+      this->close();
+      return false;
+    }
+
+    return true;
+  }
+
+  inline Semaphore_Array::Semaphore_Array(const std::string& name, std::size_t size, std::uint32_t initial_count)
+  {
+    this->create(name, size, initial_count);
+  }
+
+  inline Semaphore_Array::~Semaphore_Array()
+  {
+    this->close();
+  }
+#endif
+
+  // Spsc_Ring
+
+  template <typename T>
+  const Shared_Memory& Spsc_Ring<T>::get_shared_memory() const
+  {
+    return this->memory;
+  }
+
+  template <typename T>
+  std::size_t Spsc_Ring<T>::capacity() const
+  {
+    return static_cast<std::size_t>(this->mask + 1);
+  }
+
+  template <typename T>
+  std::size_t Spsc_Ring<T>::size() const
+  {
+    if (this->header == nullptr)
+    {
+      return 0;
+    }
+
+    std::uint64_t tail = this->header->tail.load(std::memory_order_acquire);
+    std::uint64_t head = this->header->head.load(std::memory_order_acquire);
+    return static_cast<std::size_t>(head - tail);
+  }
+
+  template <typename T>
+  bool Spsc_Ring<T>::empty() const
+  {
+    return this->size() == 0;
+  }
+
+  template <typename T>
+  void Spsc_Ring<T>::close()
+  {
+    this->memory.close();
+    this->header = nullptr;
+    this->slots = nullptr;
+    this->mask = 0;
+    this->cached_tail = 0;
+    this->cached_head = 0;
+  }
+
+  template <typename T>
+  bool Spsc_Ring<T>::try_push(const T& value)
+  {
+    if (this->header == nullptr)
+    {
+      return false;
+    }
+
+    std::uint64_t head = this->header->head.load(std::memory_order_relaxed);
+
+    // Only touch the consumer's cache line when our cached view says we're full
+    if (head - this->cached_tail > this->mask)
+    {
+      this->cached_tail = this->header->tail.load(std::memory_order_acquire);
+
+      if (head - this->cached_tail > this->mask)
+      {
+        return false;
+      }
+    }
+
+    this->slots[head & this->mask] = value;
+    this->header->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename T>
+  bool Spsc_Ring<T>::try_pop(T& value)
+  {
+    if (this->header == nullptr)
+    {
+      return false;
+    }
+
+    std::uint64_t tail = this->header->tail.load(std::memory_order_relaxed);
+
+    // Only touch the producer's cache line when our cached view says we're empty
+    if (tail == this->cached_head)
+    {
+      this->cached_head = this->header->head.load(std::memory_order_acquire);
+
+      if (tail == this->cached_head)
+      {
+        return false;
+      }
+    }
+
+    value = this->slots[tail & this->mask];
+    this->header->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename T>
+  bool Spsc_Ring<T>::create(const std::string& name, std::size_t capacity)
+  {
+    if (capacity == 0)
+    {
+      return false;
+    }
+
+    capacity = detail::round_up_pow2(capacity);
+    std::size_t size = 0;
+
+    if (capacity == 0 || !detail::array_end(slots_offset, capacity, sizeof(T), size) || !this->memory.create(name, size))
+    {
+      this->close();
+      return false;
+    }
+
+    unsigned char* base = static_cast<unsigned char*>(this->memory.get_address());
+    this->header = reinterpret_cast<Header*>(base);
+    this->slots = reinterpret_cast<T*>(base + slots_offset);
+
+    detail::initialize_once(this->header->state, [&]
+    {
+      this->header->capacity = capacity;
+      this->header->head.store(0, std::memory_order_relaxed);
+      this->header->tail.store(0, std::memory_order_relaxed);
+    });
+
+    // Attached to a ring that was created with a different capacity. Only detach, the name
+    // still belongs to whoever created it.
+    if (this->header->capacity != capacity)
+    {
+      this->memory.detach();
+      this->close();
+      return false;
+    }
+
+    this->mask = capacity - 1;
+    this->cached_tail = this->header->tail.load(std::memory_order_acquire);
+    this->cached_head = this->header->head.load(std::memory_order_acquire);
+    return true;
+  }
+
+  template <typename T>
+  Spsc_Ring<T>::Spsc_Ring(const std::string& name, std::size_t capacity)
+  {
+    this->create(name, capacity);
+  }
+
+  template <typename T>
+  Spsc_Ring<T>::~Spsc_Ring()
+  {
+    this->close();
+  }
+
+  // Mpmc_Queue
+
+  template <typename T>
+  const Shared_Memory& Mpmc_Queue<T>::get_shared_memory() const
+  {
+    return this->memory;
+  }
+
+  template <typename T>
+  std::size_t Mpmc_Queue<T>::capacity() const
+  {
+    return static_cast<std::size_t>(this->mask + 1);
+  }
+
+  template <typename T>
+  std::size_t Mpmc_Queue<T>::size() const
+  {
+    if (this->header == nullptr)
+    {
+      return 0;
+    }
+
+    // Only a snapshot while other processes are active
+    std::uint64_t dequeue_pos = this->header->dequeue_pos.load(std::memory_order_acquire);
+    std::uint64_t enqueue_pos = this->header->enqueue_pos.load(std::memory_order_acquire);
+    return enqueue_pos > dequeue_pos ? static_cast<std::size_t>(enqueue_pos - dequeue_pos) : 0;
+  }
+
+  template <typename T>
+  bool Mpmc_Queue<T>::empty() const
+  {
+    return this->size() == 0;
+  }
+
+  template <typename T>
+  void Mpmc_Queue<T>::close()
+  {
+    this->memory.close();
+    this->header = nullptr;
+    this->cells = nullptr;
+    this->mask = 0;
+  }
+
+  template <typename T>
+  bool Mpmc_Queue<T>::try_push(const T& value)
+  {
+    if (this->header == nullptr)
+    {
+      return false;
+    }
+
+    Cell* cell;
+    std::uint64_t pos = this->header->enqueue_pos.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+      cell = &this->cells[pos & this->mask];
+      std::uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+      std::int64_t diff = static_cast<std::int64_t>(sequence - pos);
+
+      if (diff == 0)
+      {
+        // Slot is free for this lap, try to claim it
+        if (this->header->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        // Slot still holds last lap's value, queue is full
+        return false;
+      }
+      else
+      {
+        pos = this->header->enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->data = value;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename T>
+  bool Mpmc_Queue<T>::try_pop(T& value)
+  {
+    if (this->header == nullptr)
+    {
+      return false;
+    }
+
+    Cell* cell;
+    std::uint64_t pos = this->header->dequeue_pos.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+      cell = &this->cells[pos & this->mask];
+      std::uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+      std::int64_t diff = static_cast<std::int64_t>(sequence - (pos + 1));
+
+      if (diff == 0)
+      {
+        // Slot has been published for this lap, try to claim it
+        if (this->header->dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        // Producer hasn't published this slot yet, queue is empty
+        return false;
+      }
+      else
+      {
+        pos = this->header->dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    value = cell->data;
+    cell->sequence.store(pos + this->mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename T>
+  bool Mpmc_Queue<T>::create(const std::string& name, std::size_t capacity)
+  {
+    // The sequence scheme needs at least two slots to tell "full" from "published"
+    if (capacity < 2)
+    {
+      capacity = 2;
+    }
+
+    capacity = detail::round_up_pow2(capacity);
+    std::size_t size = 0;
+
+    if (capacity == 0 || !detail::array_end(cells_offset, capacity, sizeof(Cell), size) || !this->memory.create(name, size))
+    {
+      this->close();
+      return false;
+    }
+
+    unsigned char* base = static_cast<unsigned char*>(this->memory.get_address());
+    this->header = reinterpret_cast<Header*>(base);
+    this->cells = reinterpret_cast<Cell*>(base + cells_offset);
+
+    detail::initialize_once(this->header->state, [&]
+    {
+      this->header->capacity = capacity;
+      this->header->enqueue_pos.store(0, std::memory_order_relaxed);
+      this->header->dequeue_pos.store(0, std::memory_order_relaxed);
+
+      for (std::size_t i = 0; i < capacity; ++i)
+      {
+        this->cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    });
+
+    // Attached to a queue that was created with a different capacity. Only detach, the name
+    // still belongs to whoever created it.
+    if (this->header->capacity != capacity)
+    {
+      this->memory.detach();
+      this->close();
+      return false;
+    }
+
+    this->mask = capacity - 1;
+    return true;
+  }
+
+  template <typename T>
+  Mpmc_Queue<T>::Mpmc_Queue(const std::string& name, std::size_t capacity)
+  {
+    this->create(name, capacity);
+  }
+
+  template <typename T>
+  Mpmc_Queue<T>::~Mpmc_Queue()
+  {
+    this->close();
+  }
+
+  // Offset_Ptr
+
+  template <typename T>
+  void Offset_Ptr<T>::set(const T* pointer)
+  {
+    this->offset = pointer == nullptr ? 0 : reinterpret_cast<const unsigned char*>(pointer) - reinterpret_cast<const unsigned char*>(this);
+  }
+
+  template <typename T>
+  T* Offset_Ptr<T>::get() const
+  {
+    if (this->offset == 0)
+    {
+      return nullptr;
+    }
+
+    return reinterpret_cast<T*>(const_cast<unsigned char*>(reinterpret_cast<const unsigned char*>(this)) + this->offset);
+  }
+
+  template <typename T>
+  T& Offset_Ptr<T>::operator*() const
+  {
+    return *this->get();
+  }
+
+  template <typename T>
+  T* Offset_Ptr<T>::operator->() const
+  {
+    return this->get();
+  }
+
+  template <typename T>
+  Offset_Ptr<T>::operator bool() const
+  {
+    return this->offset != 0;
+  }
+
+  template <typename T>
+  Offset_Ptr<T>& Offset_Ptr<T>::operator=(const T* pointer)
+  {
+    this->set(pointer);
+    return *this;
+  }
+
+  template <typename T>
+  Offset_Ptr<T>& Offset_Ptr<T>::operator=(const Offset_Ptr& other)
+  {
+    // Re-base on our own address, copying the raw offset would point somewhere else
+    this->set(other.get());
+    return *this;
+  }
+
+  template <typename T>
+  bool Offset_Ptr<T>::operator==(const Offset_Ptr& other) const
+  {
+    return this->get() == other.get();
+  }
+
+  template <typename T>
+  bool Offset_Ptr<T>::operator!=(const Offset_Ptr& other) const
+  {
+    return this->get() != other.get();
+  }
+
+  template <typename T>
+  Offset_Ptr<T>::Offset_Ptr(const T* pointer)
+  {
+    this->set(pointer);
+  }
+
+  template <typename T>
+  Offset_Ptr<T>::Offset_Ptr(const Offset_Ptr& other)
+  {
+    this->set(other.get());
+  }
+
+  // Shared_Arena
+
+  inline Shared_Arena::Block_Header* Shared_Arena::block_at(Offset block) const
+  {
+    return reinterpret_cast<Block_Header*>(this->base + block);
+  }
+
+  inline std::atomic<std::uint64_t>* Shared_Arena::small_link(Offset block) const
+  {
+    return reinterpret_cast<std::atomic<std::uint64_t>*>(this->base + block + sizeof(Block_Header));
+  }
+
+  inline Shared_Arena::Large_Links* Shared_Arena::large_links(Offset block) const
+  {
+    return reinterpret_cast<Large_Links*>(this->base + block + sizeof(Block_Header));
+  }
+
+  inline void Shared_Arena::set_footer(Offset block, std::uint64_t size)
+  {
+    *reinterpret_cast<std::uint64_t*>(this->base + block + size - sizeof(std::uint64_t)) = size;
+  }
+
+  inline std::size_t Shared_Arena::size_class(std::size_t size)
+  {
+    std::size_t index = 0;
+
+    while (Shared_Arena::class_size(index) < size)
+    {
+      ++index;
+    }
+
+    return index;
+  }
+
+  inline std::size_t Shared_Arena::class_size(std::size_t index)
+  {
+    return Shared_Arena::alignment << index;
+  }
+
+  inline Shared_Arena::Offset Shared_Arena::pop_small(std::size_t index)
+  {
+    std::atomic<std::uint64_t>& list = this->header->small_free[index];
+    std::uint64_t head = list.load(std::memory_order_acquire);
+
+    while ((head & Shared_Arena::index_mask) != 0)
+    {
+      Offset block = (head & Shared_Arena::index_mask) * Shared_Arena::alignment;
+
+      // The block may be popped and reused under us, the tag makes the CAS fail in that case.
+      // Memory is never returned to the system, so the read itself is always safe.
+      std::uint64_t next = this->small_link(block)->load(std::memory_order_relaxed);
+      std::uint64_t tag = (head >> Shared_Arena::tag_shift) + 1;
+
+      if (list.compare_exchange_weak(head, next | (tag << Shared_Arena::tag_shift), std::memory_order_acquire, std::memory_order_acquire))
+      {
+        this->block_at(block)->free = 0;
+        return block;
+      }
+    }
+
+    return Shared_Arena::null_offset;
+  }
+
+  inline void Shared_Arena::push_small(std::size_t index, Offset first, Offset last)
+  {
+    std::atomic<std::uint64_t>& list = this->header->small_free[index];
+    std::uint64_t head = list.load(std::memory_order_relaxed);
+    std::uint64_t tag;
+
+    do
+    {
+      this->small_link(last)->store(head & Shared_Arena::index_mask, std::memory_order_relaxed);
+      tag = (head >> Shared_Arena::tag_shift) + 1;
+    } while (!list.compare_exchange_weak(head, (first / Shared_Arena::alignment) | (tag << Shared_Arena::tag_shift), std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  inline Shared_Arena::Offset Shared_Arena::refill_small(std::size_t index)
+  {
+    std::size_t block_size = sizeof(Block_Header) + Shared_Arena::class_size(index);
+    std::size_t min_chunk = detail::align_up(sizeof(Block_Header) + block_size + sizeof(std::uint64_t), Shared_Arena::alignment);
+    min_chunk = min_chunk < Shared_Arena::min_large_block ? Shared_Arena::min_large_block : min_chunk;
+    std::size_t size = Shared_Arena::chunk_size;
+    Offset chunk = this->allocate_large(size, chunk_block);
+
+    // Fragmented or nearly full, settle for smaller chunks down to a single block
+    while (chunk == Shared_Arena::null_offset && size > min_chunk)
+    {
+      size = size / 2 > min_chunk ? detail::align_up(size / 2, Shared_Arena::alignment) : min_chunk;
+      chunk = this->allocate_large(size, chunk_block);
+    }
+
+    if (chunk == Shared_Arena::null_offset)
+    {
+      return Shared_Arena::null_offset;
+    }
+
+    // Carve the chunk's payload (splitting may have left it a little larger than asked for),
+    // keep the first block and publish the rest as one chain
+    Offset first = chunk + sizeof(Block_Header);
+    std::size_t count = (this->block_at(chunk)->size - sizeof(Block_Header) - sizeof(std::uint64_t)) / block_size;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      Offset block = first + i * block_size;
+      this->block_at(block)->size = index;
+      this->block_at(block)->kind = small_block;
+      this->block_at(block)->free = i == 0 ? 0 : 1;
+
+      if (i + 1 < count)
+      {
+        this->small_link(block)->store((block + block_size) / Shared_Arena::alignment, std::memory_order_relaxed);
+      }
+    }
+
+    if (count > 1)
+    {
+      this->push_small(index, first + block_size, first + (count - 1) * block_size);
+    }
+
+    return first;
+  }
+
+  inline bool Shared_Arena::lock_large()
+  {
+#ifdef __linux__
+    Lock_Status status = this->header->large_lock.lock();
+
+    if (status == Lock_Status::owner_died)
+    {
+      // The owner died halfway through a split or a merge, the boundary tags are still usable
+      this->repair_large();
+      this->header->large_lock.make_consistent();
+      return true;
+    }
+
+    return status == Lock_Status::acquired;
+#else
+    detail::spin_lock(this->header->large_lock);
+    return true;
+#endif
+  }
+
+  inline void Shared_Arena::unlock_large()
+  {
+#ifdef __linux__
+    this->header->large_lock.unlock();
+#else
+    detail::spin_unlock(this->header->large_lock);
+#endif
+  }
+
+  inline void Shared_Arena::repair_large()
+  {
+    Offset block = Shared_Arena::data_offset;
+    Offset run = Shared_Arena::null_offset; // First block of the current run of free blocks
+    this->header->large_free = Shared_Arena::null_offset;
+
+    // Walk every block in address order, rebuilding the free list and merging neighbours as we go
+    while (block < this->header->bump)
+    {
+      Block_Header* block_header = this->block_at(block);
+      std::uint64_t size = block_header->size;
+      bool is_block = block_header->kind == large_block || block_header->kind == chunk_block;
+
+      // Headers are written before bump moves, so a bad one can only be the fresh space the dead
+      // process was carving. Nothing past it was handed out.
+      if (!is_block || size < Shared_Arena::min_large_block || size % Shared_Arena::alignment != 0 || size > this->header->bump - block)
+      {
+        this->header->bump = block;
+        break;
+      }
+
+      bool is_free = block_header->kind == large_block && block_header->free;
+
+      if (is_free && run == Shared_Arena::null_offset)
+      {
+        run = block;
+      }
+      else if (!is_free && run != Shared_Arena::null_offset)
+      {
+        this->block_at(run)->size = block - run;
+        this->set_footer(run, block - run);
+        this->insert_large(run);
+        run = Shared_Arena::null_offset;
+      }
+
+      block += size;
+    }
+
+    // Like free_large(), a free tail goes back to the carved region's end
+    if (run != Shared_Arena::null_offset)
+    {
+      this->header->bump = run;
+    }
+  }
+
+  inline void Shared_Arena::unlink_large(Offset block)
+  {
+    Large_Links* links = this->large_links(block);
+
+    if (links->previous != Shared_Arena::null_offset)
+    {
+      this->large_links(links->previous)->next = links->next;
+    }
+    else
+    {
+      this->header->large_free = links->next;
+    }
+
+    if (links->next != Shared_Arena::null_offset)
+    {
+      this->large_links(links->next)->previous = links->previous;
+    }
+  }
+
+  inline void Shared_Arena::insert_large(Offset block)
+  {
+    Large_Links* links = this->large_links(block);
+    links->previous = Shared_Arena::null_offset;
+    links->next = this->header->large_free;
+
+    if (links->next != Shared_Arena::null_offset)
+    {
+      this->large_links(links->next)->previous = block;
+    }
+
+    this->header->large_free = block;
+  }
+
+  inline Shared_Arena::Offset Shared_Arena::allocate_large(std::size_t block_size, Block_Kind kind)
+  {
+    Offset result = Shared_Arena::null_offset;
+
+    if (!this->lock_large())
+    {
+      return result;
+    }
+
+    // First fit from the free list
+    for (Offset block = this->header->large_free; block != Shared_Arena::null_offset; block = this->large_links(block)->next)
+    {
+      std::size_t available = this->block_at(block)->size;
+
+      if (available < block_size)
+      {
+        continue;
+      }
+
+      this->unlink_large(block);
+
+      // Split off the tail when it's big enough to stand on its own
+      if (available - block_size >= Shared_Arena::min_large_block)
+      {
+        Offset rest = block + block_size;
+        this->block_at(rest)->size = available - block_size;
+        this->block_at(rest)->kind = large_block;
+        this->block_at(rest)->free = 1;
+        this->set_footer(rest, available - block_size);
+        this->insert_large(rest);
+        available = block_size;
+      }
+
+      this->block_at(block)->size = available;
+      result = block;
+      break;
+    }
+
+    // Otherwise carve fresh space. The header goes first, repair_large() relies on it.
+    if (result == Shared_Arena::null_offset && block_size <= this->header->capacity - this->header->bump)
+    {
+      result = this->header->bump;
+      this->block_at(result)->size = block_size;
+      this->block_at(result)->kind = kind;
+      this->block_at(result)->free = 0;
+      this->header->bump += block_size;
+    }
+
+    if (result != Shared_Arena::null_offset)
+    {
+      this->block_at(result)->kind = kind;
+      this->block_at(result)->free = 0;
+      this->set_footer(result, this->block_at(result)->size);
+    }
+
+    this->unlock_large();
+    return result;
+  }
+
+  inline void Shared_Arena::free_large(Offset block)
+  {
+    // Can only fail on a broken mutex, the block leaks rather than corrupt the list
+    if (!this->lock_large())
+    {
+      return;
+    }
+
+    std::uint64_t size = this->block_at(block)->size;
+
+    // Merge with the following block. Merged headers are wiped so a stale offset fails deallocate()'s check.
+    Offset next = block + size;
+
+    if (next < this->header->bump && this->block_at(next)->kind == large_block && this->block_at(next)->free)
+    {
+      this->unlink_large(next);
+      size += this->block_at(next)->size;
+      this->block_at(next)->kind = 0;
+    }
+
+    // Merge with the preceding block, found through its footer
+    if (block > Shared_Arena::data_offset)
+    {
+      std::uint64_t previous_size = *reinterpret_cast<std::uint64_t*>(this->base + block - sizeof(std::uint64_t));
+      Offset previous = block - previous_size;
+
+      if (this->block_at(previous)->kind == large_block && this->block_at(previous)->free)
+      {
+        this->unlink_large(previous);
+        this->block_at(block)->kind = 0;
+        block = previous;
+        size += previous_size;
+      }
+    }
+
+    // Hand the tail of the carved region back instead of keeping it on the list
+    if (block + size == this->header->bump)
+    {
+      this->header->bump = block;
+    }
+    else
+    {
+      this->block_at(block)->size = size;
+      this->block_at(block)->kind = large_block;
+      this->block_at(block)->free = 1;
+      this->set_footer(block, size);
+      this->insert_large(block);
+    }
+
+    this->unlock_large();
+  }
+
+  inline const Shared_Memory& Shared_Arena::get_shared_memory() const
+  {
+    return this->memory;
+  }
+
+  inline std::size_t Shared_Arena::get_capacity() const
+  {
+    return this->header == nullptr ? 0 : static_cast<std::size_t>(this->header->capacity - Shared_Arena::data_offset);
+  }
+
+  inline Shared_Arena::Offset Shared_Arena::get_root() const
+  {
+    return this->header == nullptr ? Shared_Arena::null_offset : this->header->root.load(std::memory_order_acquire);
+  }
+
+  inline void Shared_Arena::set_root(Offset offset)
+  {
+    if (this->header != nullptr)
+    {
+      this->header->root.store(offset, std::memory_order_release);
+    }
+  }
+
+  inline void* Shared_Arena::to_pointer(Offset offset) const
+  {
+    return offset == Shared_Arena::null_offset ? nullptr : this->base + offset;
+  }
+
+  inline Shared_Arena::Offset Shared_Arena::to_offset(const void* pointer) const
+  {
+    return pointer == nullptr ? Shared_Arena::null_offset : static_cast<Offset>(static_cast<const unsigned char*>(pointer) - this->base);
+  }
+
+  template <typename T>
+  T* Shared_Arena::get(Offset offset) const
+  {
+    return static_cast<T*>(this->to_pointer(offset));
+  }
+
+  inline Shared_Arena::Offset Shared_Arena::allocate(std::size_t size)
+  {
+    if (this->header == nullptr)
+    {
+      return Shared_Arena::null_offset;
+    }
+
+    Offset block;
+
+    if (size <= Shared_Arena::max_small_size)
+    {
+      std::size_t index = Shared_Arena::size_class(size);
+      block = this->pop_small(index);
+
+      if (block == Shared_Arena::null_offset)
+      {
+        block = this->refill_small(index);
+      }
+    }
+    else if (size > this->header->capacity)
+    {
+      // Could never fit, and the block size computed below would wrap around
+      block = Shared_Arena::null_offset;
+    }
+    else
+    {
+      // Links must fit in the payload once the block is freed
+      std::size_t payload = size < sizeof(Large_Links) ? sizeof(Large_Links) : size;
+      block = this->allocate_large(detail::align_up(sizeof(Block_Header) + payload + sizeof(std::uint64_t), Shared_Arena::alignment), large_block);
+    }
+
+    return block == Shared_Arena::null_offset ? block : block + sizeof(Block_Header);
+  }
+
+  inline void Shared_Arena::deallocate(Offset offset)
+  {
+    if (this->header == nullptr || offset == Shared_Arena::null_offset)
+    {
+      return;
+    }
+
+    bool in_range = offset >= Shared_Arena::data_offset + sizeof(Block_Header) && offset < this->header->capacity && offset % Shared_Arena::alignment == 0;
+    Offset block = offset - sizeof(Block_Header);
+    Block_Header* block_header = in_range ? this->block_at(block) : nullptr;
+
+    bool allocated = block_header != nullptr && !block_header->free &&
+      ((block_header->kind == small_block && block_header->size < Shared_Arena::size_class_count) ||
+       (block_header->kind == large_block && block < this->header->bump));
+
+    assert(allocated && "Shared_Arena::deallocate: double free or not an allocated block");
+
+    if (!allocated)
+    {
+      return;
+    }
+
+    if (block_header->kind == small_block)
+    {
+      block_header->free = 1;
+      this->push_small(static_cast<std::size_t>(block_header->size), block, block);
+    }
+    else if (block_header->kind == large_block)
+    {
+      this->free_large(block);
+    }
+  }
+
+  inline void Shared_Arena::close()
+  {
+    this->memory.close();
+    this->header = nullptr;
+    this->base = nullptr;
+  }
+
+  inline bool Shared_Arena::create(const std::string& name, std::size_t size, Memory_Flags flags)
+  {
+    // Offsets are stored divided by the alignment in 40 bits
+    if (size == 0 || size / Shared_Arena::alignment > Shared_Arena::index_mask)
+    {
+      return false;
+    }
+
+    // Growing would move the base under other processes' raw pointers
+    if (flags & Memory_Flags::growable)
+    {
+      return false;
+    }
+
+    if (!this->memory.create(name, Shared_Arena::data_offset + size, flags))
+    {
+      this->close();
+      return false;
+    }
+
+    this->base = static_cast<unsigned char*>(this->memory.get_address());
+    this->header = reinterpret_cast<Header*>(this->base);
+
+    detail::initialize_once(this->header->state, [&]
+    {
+      // Rounding (huge pages) may have given us more than asked for
+      this->header->capacity = this->memory.get_size() & ~(Shared_Arena::alignment - 1);
+      this->header->bump = Shared_Arena::data_offset;
+      this->header->large_free = Shared_Arena::null_offset;
+      this->header->root.store(Shared_Arena::null_offset, std::memory_order_relaxed);
+    });
+
+    // Attached with a smaller size than the arena was created with, blocks would lie past our
+    // mapping. Only detach, the name still belongs to whoever created it.
+    if (this->header->capacity > this->memory.get_size())
+    {
+      this->memory.detach();
+      this->close();
+      return false;
+    }
+
+    return true;
+  }
+
+  inline Shared_Arena::Shared_Arena(const std::string& name, std::size_t size, Memory_Flags flags)
+  {
+    this->create(name, size, flags);
+  }
+
+  inline Shared_Arena::~Shared_Arena()
+  {
+    this->close();
+  }
+
+  // Shared_Monotonic_Resource
+
+  inline void* Shared_Monotonic_Resource::do_allocate(std::size_t bytes, std::size_t alignment)
+  {
+    if (this->header == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+
+    std::uint64_t current = this->header->bump.load(std::memory_order_relaxed);
+    std::uint64_t start;
+
+    // Offsets are relative to a page aligned base, so aligning the offset aligns the pointer
+    do
+    {
+      start = detail::align_up(static_cast<std::size_t>(current), alignment);
+
+      // Written so that neither a huge alignment nor a huge size can wrap around
+      if (start < current || start > this->header->capacity || bytes > this->header->capacity - start)
+      {
+        throw std::bad_alloc();
+      }
+    } while (!this->header->bump.compare_exchange_weak(current, start + bytes, std::memory_order_relaxed));
+
+    return this->base + start;
+  }
+
+  inline void Shared_Monotonic_Resource::do_deallocate(void*, std::size_t, std::size_t)
+  {
+  }
+
+  inline bool Shared_Monotonic_Resource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+  {
+    return this == &other;
+  }
+
+  inline const Shared_Memory& Shared_Monotonic_Resource::get_shared_memory() const
+  {
+    return this->memory;
+  }
+
+  inline std::size_t Shared_Monotonic_Resource::get_capacity() const
+  {
+    return this->header == nullptr ? 0 : static_cast<std::size_t>(this->header->capacity - Shared_Monotonic_Resource::data_offset);
+  }
+
+  inline std::size_t Shared_Monotonic_Resource::get_used() const
+  {
+    return this->header == nullptr ? 0 : static_cast<std::size_t>(this->header->bump.load(std::memory_order_relaxed) - Shared_Monotonic_Resource::data_offset);
+  }
+
+  inline void Shared_Monotonic_Resource::reset()
+  {
+    if (this->header != nullptr)
+    {
+      this->header->bump.store(Shared_Monotonic_Resource::data_offset, std::memory_order_relaxed);
+    }
+  }
+
+  inline void Shared_Monotonic_Resource::close()
+  {
+    this->memory.close();
+    this->header = nullptr;
+    this->base = nullptr;
+  }
+
+  inline bool Shared_Monotonic_Resource::create(const std::string& name, std::size_t size, Memory_Flags flags)
+  {
+    // Growing would move the base under the raw pointers handed out
+    if (size == 0 || (flags & Memory_Flags::growable))
+    {
+      return false;
+    }
+
+    if (!this->memory.create(name, Shared_Monotonic_Resource::data_offset + size, flags))
+    {
+      this->close();
+      return false;
+    }
+
+    this->base = static_cast<unsigned char*>(this->memory.get_address());
+    this->header = reinterpret_cast<Header*>(this->base);
+
+    detail::initialize_once(this->header->state, [&]
+    {
+      this->header->capacity = this->memory.get_size();
+      this->header->bump.store(Shared_Monotonic_Resource::data_offset, std::memory_order_relaxed);
+    });
+
+    // Attached with a smaller size than the resource was created with, allocations would lie past
+    // our mapping. Only detach, the name still belongs to whoever created it.
+    if (this->header->capacity > this->memory.get_size())
+    {
+      this->memory.detach();
+      this->close();
+      return false;
+    }
+
+    return true;
+  }
+
+  inline Shared_Monotonic_Resource::Shared_Monotonic_Resource(const std::string& name, std::size_t size, Memory_Flags flags)
+  {
+    this->create(name, size, flags);
+  }
+
+  inline Shared_Monotonic_Resource::~Shared_Monotonic_Resource()
+  {
+    this->close();
+  }
+
+  // Shared_Pool_Resource
+
+  inline void* Shared_Pool_Resource::do_allocate(std::size_t bytes, std::size_t alignment)
+  {
+    if (alignment <= Shared_Arena::alignment)
+    {
+      void* pointer = this->arena.to_pointer(this->arena.allocate(bytes));
+
+      if (pointer == nullptr)
+      {
+        throw std::bad_alloc();
+      }
+
+      return pointer;
+    }
+
+    // Over-aligned: over allocate and remember the real block just in front of the result
+    Shared_Arena::Offset block = bytes > SIZE_MAX - alignment ? Shared_Arena::null_offset : this->arena.allocate(bytes + alignment);
+
+    if (block == Shared_Arena::null_offset)
+    {
+      throw std::bad_alloc();
+    }
+
+    Shared_Arena::Offset aligned = detail::align_up(static_cast<std::size_t>(block) + sizeof(Shared_Arena::Offset), alignment);
+    *this->arena.get<Shared_Arena::Offset>(aligned - sizeof(Shared_Arena::Offset)) = block;
+    return this->arena.to_pointer(aligned);
+  }
+
+  inline void Shared_Pool_Resource::do_deallocate(void* pointer, std::size_t, std::size_t alignment)
+  {
+    Shared_Arena::Offset offset = this->arena.to_offset(pointer);
+
+    if (alignment > Shared_Arena::alignment)
+    {
+      offset = *this->arena.get<Shared_Arena::Offset>(offset - sizeof(Shared_Arena::Offset));
+    }
+
+    this->arena.deallocate(offset);
+  }
+
+  inline bool Shared_Pool_Resource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+  {
+    return this == &other;
+  }
+
+  inline Shared_Arena& Shared_Pool_Resource::get_arena()
+  {
+    return this->arena;
+  }
+
+  inline void Shared_Pool_Resource::close()
+  {
+    this->arena.close();
+  }
+
+  inline bool Shared_Pool_Resource::create(const std::string& name, std::size_t size, Memory_Flags flags)
+  {
+    return this->arena.create(name, size, flags);
+  }
+
+  inline Shared_Pool_Resource::Shared_Pool_Resource(const std::string& name, std::size_t size, Memory_Flags flags)
+  {
+    this->create(name, size, flags);
+  }
+
+  inline Shared_Pool_Resource::~Shared_Pool_Resource()
+  {
+    this->close();
+  }
+
+  // Shared_Hash_Map
+
+  template <typename K, typename V, typename Hash>
+  std::uint64_t Shared_Hash_Map<K, V, Hash>::hash(const K& key) const
+  {
+    // Finalizer on top of Hash, std::hash of integers is often the identity
+    std::uint64_t value = static_cast<std::uint64_t>(this->hasher(key));
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+  }
+
+  template <typename K, typename V, typename Hash>
+  std::uint32_t Shared_Hash_Map<K, V, Hash>::match_group(const std::atomic<std::uint8_t>* group, std::uint8_t value)
+  {
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    // Bytes may change under us, every hit is re-checked with an acquire load
+    __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(value)))));
+#else
+    std::uint32_t mask = 0;
+
+    for (std::size_t i = 0; i < Shared_Hash_Map::group_size; ++i)
+    {
+      if (group[i].load(std::memory_order_relaxed) == value)
+      {
+        mask |= 1u << i;
+      }
+    }
+
+    return mask;
+#endif
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool Shared_Hash_Map<K, V, Hash>::read_slot(const Slot& slot, const std::atomic<std::uint8_t>& state, std::uint8_t h2, const K& key, V* value)
+  {
+    alignas(K) unsigned char key_copy[sizeof(K)];
+    alignas(V) unsigned char value_copy[sizeof(V)];
+
+    for (;;)
+    {
+      std::uint32_t before = slot.version.load(std::memory_order_acquire);
+
+      if (before & 1)
+      {
+        detail::cpu_relax();
+        continue;
+      }
+
+      // Erases change the state under the slot lock, so it belongs to the snapshot too
+      if (state.load(std::memory_order_acquire) != h2)
+      {
+        return false;
+      }
+
+      std::memcpy(key_copy, &slot.key, sizeof(K));
+
+      if (value != nullptr)
+      {
+        std::memcpy(value_copy, &slot.value, sizeof(V));
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if (slot.version.load(std::memory_order_relaxed) != before)
+      {
+        continue;
+      }
+
+      if (!(*reinterpret_cast<const K*>(key_copy) == key))
+      {
+        return false;
+      }
+
+      if (value != nullptr)
+      {
+        std::memcpy(static_cast<void*>(value), value_copy, sizeof(V));
+      }
+
+      return true;
+    }
+  }
+
+  template <typename K, typename V, typename Hash>
+  void Shared_Hash_Map<K, V, Hash>::lock_slot(Slot& slot)
+  {
+    std::uint32_t version = slot.version.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+      if ((version & 1) == 0 && slot.version.compare_exchange_weak(version, version + 1, std::memory_order_acquire, std::memory_order_relaxed))
+      {
+        break;
+      }
+
+      detail::cpu_relax();
+      version = slot.version.load(std::memory_order_relaxed);
+    }
+
+    // Keep the value writes after the odd version for readers
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  template <typename K, typename V, typename Hash>
+  void Shared_Hash_Map<K, V, Hash>::unlock_slot(Slot& slot)
+  {
+    slot.version.fetch_add(1, std::memory_order_release);
+  }
+
+  template <typename K, typename V, typename Hash>
+  std::size_t Shared_Hash_Map<K, V, Hash>::probe_slot(std::uint64_t hash, std::size_t position) const
+  {
+    std::size_t probe = position / Shared_Hash_Map::group_size;
+    std::size_t group = (static_cast<std::size_t>(hash >> 7) + probe * (probe + 1) / 2) & this->group_mask;
+    return group * Shared_Hash_Map::group_size + position % Shared_Hash_Map::group_size;
+  }
+
+  template <typename K, typename V, typename Hash>
+  std::size_t Shared_Hash_Map<K, V, Hash>::find_slot(const K& key, std::uint8_t h2, std::uint64_t hash, V* value) const
+  {
+    std::size_t group = static_cast<std::size_t>(hash >> 7) & this->group_mask;
+
+    // Triangular probing visits every group once when the group count is a power of two
+    for (std::size_t probe = 0; probe <= this->group_mask; ++probe)
+    {
+      const std::atomic<std::uint8_t>* group_ctrl = this->ctrl + group * Shared_Hash_Map::group_size;
+      std::uint32_t matches = Shared_Hash_Map::match_group(group_ctrl, h2);
+
+      while (matches != 0)
+      {
+        std::size_t index = detail::count_trailing_zeros(matches);
+        matches &= matches - 1;
+
+        if (Shared_Hash_Map::read_slot(this->slots[group * Shared_Hash_Map::group_size + index], group_ctrl[index], h2, key, value))
+        {
+          return group * Shared_Hash_Map::group_size + index;
+        }
+      }
+
+      // An empty slot ends the probe sequence, the key was never inserted past it
+      if (Shared_Hash_Map::match_group(group_ctrl, Shared_Hash_Map::ctrl_empty) != 0)
+      {
+        break;
+      }
+
+      group = (group + probe + 1) & this->group_mask;
+    }
+
+    return this->capacity();
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool Shared_Hash_Map<K, V, Hash>::claim_is_unique(std::size_t own, const K& key, std::uint8_t h2, std::uint64_t hash)
+  {
+    bool before_own = true;
+
+    // Every claim of key is on this sequence, before its first empty slot. Both racing inserts
+    // store their claim before walking it, so at least one of them sees the other.
+    for (std::size_t position = 0; position < this->capacity(); ++position)
+    {
+      std::size_t index = this->probe_slot(hash, position);
+
+      if (index == own)
+      {
+        before_own = false;
+        continue;
+      }
+
+      std::atomic<std::uint8_t>& state = this->ctrl[index];
+      std::uint8_t current = state.load(std::memory_order_seq_cst);
+
+      for (;;)
+      {
+        if (current == Shared_Hash_Map::ctrl_busy)
+        {
+          detail::cpu_relax();
+          current = state.load(std::memory_order_seq_cst);
+          continue;
+        }
+
+        // A published copy always wins
+        if (current == h2 && Shared_Hash_Map::read_slot(this->slots[index], state, h2, key, nullptr))
+        {
+          return false;
+        }
+
+        if (current != Shared_Hash_Map::ctrl_pending || !(this->slots[index].key == key))
+        {
+          break;
+        }
+
+        // Between two claims the earlier one on the sequence wins
+        if (before_own)
+        {
+          return false;
+        }
+
+        // Take the later one out. Failing means it got published (or taken out) meanwhile, look again.
+        if (state.compare_exchange_strong(current, Shared_Hash_Map::ctrl_deleted, std::memory_order_seq_cst))
+        {
+          break;
+        }
+      }
+
+      if (current == Shared_Hash_Map::ctrl_empty)
+      {
+        break;
+      }
+    }
+
+    return true;
+  }
+
+  template <typename K, typename V, typename Hash>
+  const Shared_Memory& Shared_Hash_Map<K, V, Hash>::get_shared_memory() const
+  {
+    return this->memory;
+  }
+
+  template <typename K, typename V, typename Hash>
+  std::size_t Shared_Hash_Map<K, V, Hash>::capacity() const
+  {
+    return this->header == nullptr ? 0 : (this->group_mask + 1) * Shared_Hash_Map::group_size;
+  }
+
+  template <typename K, typename V, typename Hash>
+  std::size_t Shared_Hash_Map<K, V, Hash>::size() const
+  {
+    return this->header == nullptr ? 0 : static_cast<std::size_t>(this->header->size.load(std::memory_order_relaxed));
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool Shared_Hash_Map<K, V, Hash>::find(const K& key, V& value) const
+  {
+    if (this->header == nullptr)
+    {
+      return false;
+    }
+
+    std::uint64_t hash = this->hash(key);
+    std::uint8_t h2 = static_cast<std::uint8_t>(Shared_Hash_Map::ctrl_full | (hash & 0x7f));
+    return this->find_slot(key, h2, hash, &value) != this->capacity();
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool Shared_Hash_Map<K, V, Hash>::contains(const K& key) const
+  {
+    if (this->header == nullptr)
+    {
+      return false;
+    }
+
+    std::uint64_t hash = this->hash(key);
+    std::uint8_t h2 = static_cast<std::uint8_t>(Shared_Hash_Map::ctrl_full | (hash & 0x7f));
+    return this->find_slot(key, h2, hash) != this->capacity();
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool Shared_Hash_Map<K, V, Hash>::insert_or_assign(const K& key, const V& value)
+  {
+    if (this->header == nullptr)
+    {
+      return false;
+    }
+
+    std::uint64_t hash = this->hash(key);
+    std::uint8_t h2 = static_cast<std::uint8_t>(Shared_Hash_Map::ctrl_full | (hash & 0x7f));
+    std::size_t capacity = this->capacity();
+
+    for (;;)
+    {
+      std::size_t found = capacity;
+      std::size_t target = capacity;
+      std::uint8_t target_state = Shared_Hash_Map::ctrl_empty;
+
+      // Same probe order as find_slot(), but slot by slot, up to the first empty slot: either the
+      // key is published there, or it goes into the first tombstone or empty slot on the way
+      for (std::size_t position = 0; position < capacity; ++position)
+      {
+        std::size_t index = this->probe_slot(hash, position);
+        std::atomic<std::uint8_t>& state = this->ctrl[index];
+        std::uint8_t current = state.load(std::memory_order_acquire);
+
+        // Wait out keys being written, and concurrent inserts of this key making up their mind
+        while (current == Shared_Hash_Map::ctrl_busy || (current == Shared_Hash_Map::ctrl_pending && this->slots[index].key == key))
+        {
+          detail::cpu_relax();
+          current = state.load(std::memory_order_acquire);
+        }
+
+        if (current == h2 && Shared_Hash_Map::read_slot(this->slots[index], state, h2, key, nullptr))
+        {
+          found = index;
+          break;
+        }
+
+        if ((current == Shared_Hash_Map::ctrl_deleted || current == Shared_Hash_Map::ctrl_empty) && target == capacity)
+        {
+          target = index;
+          target_state = current;
+        }
+
+        if (current == Shared_Hash_Map::ctrl_empty)
+        {
+          break;
+        }
+      }
+
+      if (found != capacity)
+      {
+        Slot& slot = this->slots[found];
+        Shared_Hash_Map::lock_slot(slot);
+        bool assigned = this->ctrl[found].load(std::memory_order_relaxed) == h2 && slot.key == key;
+
+        if (assigned)
+        {
+          slot.value = value;
+        }
+
+        Shared_Hash_Map::unlock_slot(slot);
+
+        // Otherwise erased meanwhile, start over
+        if (assigned)
+        {
+          return true;
+        }
+
+        continue;
+      }
+
+      if (target == capacity)
+      {
+        return false;
+      }
+
+      std::atomic<std::uint8_t>& state = this->ctrl[target];
+      Slot& slot = this->slots[target];
+
+      // Lost the race for the slot, start over and look at what the winner put there
+      if (!state.compare_exchange_strong(target_state, Shared_Hash_Map::ctrl_busy, std::memory_order_acquire))
+      {
+        continue;
+      }
+
+      // Readers may still be comparing a tombstone's old key, so it changes under the slot lock
+      Shared_Hash_Map::lock_slot(slot);
+      slot.key = key;
+      slot.value = value;
+      Shared_Hash_Map::unlock_slot(slot);
+      state.store(Shared_Hash_Map::ctrl_pending, std::memory_order_seq_cst);
+
+      std::uint8_t pending = Shared_Hash_Map::ctrl_pending;
+
+      if (this->claim_is_unique(target, key, h2, hash))
+      {
+        // Fails when an earlier claim of the same key took this one out
+        if (state.compare_exchange_strong(pending, h2, std::memory_order_release, std::memory_order_relaxed))
+        {
+          this->header->size.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+
+        continue;
+      }
+
+      // Another slot has the key, give this one back and assign there
+      state.compare_exchange_strong(pending, Shared_Hash_Map::ctrl_deleted, std::memory_order_release, std::memory_order_relaxed);
+    }
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool Shared_Hash_Map<K, V, Hash>::erase(const K& key)
+  {
+    if (this->header == nullptr)
+    {
+      return false;
+    }
+
+    std::uint64_t hash = this->hash(key);
+    std::uint8_t h2 = static_cast<std::uint8_t>(Shared_Hash_Map::ctrl_full | (hash & 0x7f));
+    std::size_t index = this->find_slot(key, h2, hash);
+
+    if (index == this->capacity())
+    {
+      return false;
+    }
+
+    Slot& slot = this->slots[index];
+    bool erased = false;
+    Shared_Hash_Map::lock_slot(slot);
+
+    // The slot may have been erased and reused by another key since find_slot()
+    if (this->ctrl[index].load(std::memory_order_relaxed) == h2 && slot.key == key)
+    {
+      this->ctrl[index].store(Shared_Hash_Map::ctrl_deleted, std::memory_order_release);
+      this->header->size.fetch_sub(1, std::memory_order_relaxed);
+      erased = true;
+    }
+
+    Shared_Hash_Map::unlock_slot(slot);
+    return erased;
+  }
+
+  template <typename K, typename V, typename Hash>
+  void Shared_Hash_Map<K, V, Hash>::rebuild()
+  {
+    if (this->header == nullptr)
+    {
+      return;
+    }
+
+    std::vector<std::pair<K, V>> entries;
+    entries.reserve(this->size());
+
+    for (std::size_t index = 0; index < this->capacity(); ++index)
+    {
+      if (this->ctrl[index].load(std::memory_order_relaxed) & Shared_Hash_Map::ctrl_full)
+      {
+        entries.emplace_back(this->slots[index].key, this->slots[index].value);
+      }
+
+      this->ctrl[index].store(Shared_Hash_Map::ctrl_empty, std::memory_order_relaxed);
+    }
+
+    this->header->size.store(0, std::memory_order_relaxed);
+
+    // Fits, the table held all of them before
+    for (const std::pair<K, V>& entry : entries)
+    {
+      this->insert_or_assign(entry.first, entry.second);
+    }
+  }
+
+  template <typename K, typename V, typename Hash>
+  void Shared_Hash_Map<K, V, Hash>::close()
+  {
+    this->memory.close();
+    this->header = nullptr;
+    this->ctrl = nullptr;
+    this->slots = nullptr;
+    this->group_mask = 0;
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool Shared_Hash_Map<K, V, Hash>::create(const std::string& name, std::size_t capacity, Memory_Flags flags)
+  {
+    if (capacity == 0 || (flags & Memory_Flags::growable))
+    {
+      return false;
+    }
+
+    capacity = detail::round_up_pow2(capacity < Shared_Hash_Map::group_size ? Shared_Hash_Map::group_size : capacity);
+    std::size_t slot_alignment = alignof(Slot) > detail::cache_line_size ? alignof(Slot) : detail::cache_line_size;
+    std::size_t ctrl_end = 0;
+    std::size_t size = 0;
+
+    // A capacity whose table wouldn't fit a size_t
+    if (capacity == 0 || !detail::array_end(Shared_Hash_Map::ctrl_offset, capacity, 1, ctrl_end) || ctrl_end > SIZE_MAX - slot_alignment ||
+      !detail::array_end(detail::align_up(ctrl_end, slot_alignment), capacity, sizeof(Slot), size))
+    {
+      return false;
+    }
+
+    std::size_t slots_offset = detail::align_up(ctrl_end, slot_alignment);
+
+    if (!this->memory.create(name, size, flags))
+    {
+      this->close();
+      return false;
+    }
+
+    unsigned char* base = static_cast<unsigned char*>(this->memory.get_address());
+    this->header = reinterpret_cast<Header*>(base);
+    this->ctrl = reinterpret_cast<std::atomic<std::uint8_t>*>(base + Shared_Hash_Map::ctrl_offset);
+    this->slots = reinterpret_cast<Slot*>(base + slots_offset);
+
+    // Zero filled memory already is an empty table
+    detail::initialize_once(this->header->state, [&]
+    {
+      this->header->capacity = capacity;
+    });
+
+    // Attached to a map that was created with a different capacity. Only detach, the name
+    // still belongs to whoever created it.
+    if (this->header->capacity != capacity)
+    {
+      this->memory.detach();
+      this->close();
+      return false;
+    }
+
+    this->group_mask = capacity / Shared_Hash_Map::group_size - 1;
+    return true;
+  }
+
+  template <typename K, typename V, typename Hash>
+  Shared_Hash_Map<K, V, Hash>::Shared_Hash_Map(const std::string& name, std::size_t capacity, Memory_Flags flags)
+  {
+    this->create(name, capacity, flags);
+  }
+
+  template <typename K, typename V, typename Hash>
+  Shared_Hash_Map<K, V, Hash>::~Shared_Hash_Map()
+  {
+    this->close();
+  }
+
+  // Seqlocked
+
+  template <typename T>
+  std::uint32_t Seqlocked<T>::get_sequence() const
+  {
+    return this->sequence.load(std::memory_order_acquire);
+  }
+
+  template <typename T>
+  bool Seqlocked<T>::try_load(T& out) const
+  {
+    std::uint32_t before = this->sequence.load(std::memory_order_acquire);
+
+    if (before & 1)
+    {
+      return false;
+    }
+
+    std::memcpy(static_cast<void*>(&out), &this->value, sizeof(T));
+
+    // Keep the copy ahead of the second sequence read
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return this->sequence.load(std::memory_order_relaxed) == before;
+  }
+
+  template <typename T>
+  T Seqlocked<T>::load() const
+  {
+    T out;
+
+    for (unsigned int attempts = 1; !this->try_load(out); ++attempts)
+    {
+      // The writer may have been preempted mid-write, stop burning its CPU after a while
+      if (attempts % 64 == 0)
+      {
+        std::this_thread::yield();
+      }
+      else
+      {
+        detail::cpu_relax();
+      }
+    }
+
+    return out;
+  }
+
+  template <typename T>
+  void Seqlocked<T>::store(const T& desired)
+  {
+    std::uint32_t current = this->sequence.load(std::memory_order_relaxed);
+
+    // Going odd is the writer lock
+    for (;;)
+    {
+      if ((current & 1) == 0 && this->sequence.compare_exchange_weak(current, current + 1, std::memory_order_acquire, std::memory_order_relaxed))
+      {
+        break;
+      }
+
+      detail::cpu_relax();
+      current = this->sequence.load(std::memory_order_relaxed);
+    }
+
+    // Readers must not see value writes before the odd sequence
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(static_cast<void*>(&this->value), &desired, sizeof(T));
+    this->sequence.store(current + 2, std::memory_order_release);
+  }
+
+  template <typename T>
+  Seqlocked<T>::Seqlocked(const T& initial)
+    : value{ initial }
+  {
+  }
+
+  // Broadcast_Ring
+
+  template <typename T>
+  std::uint64_t Broadcast_Ring<T>::scan_min_cursor() const
+  {
+    // Pairs with the fence in join(): either we see the new consumer, or it sees our latest publish
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::uint64_t minimum = this->header->published.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < this->header->max_consumers; ++i)
+    {
+      const Consumer& consumer = this->consumers[i];
+
+      if (consumer.owner.load(std::memory_order_acquire) != 0)
+      {
+        std::uint64_t cursor = consumer.cursor.load(std::memory_order_acquire);
+        minimum = cursor < minimum ? cursor : minimum;
+      }
+    }
+
+    return minimum;
+  }
+
+  template <typename T>
+  const Shared_Memory& Broadcast_Ring<T>::get_shared_memory() const
+  {
+    return this->memory;
+  }
+
+  template <typename T>
+  std::size_t Broadcast_Ring<T>::capacity() const
+  {
+    return this->header == nullptr ? 0 : static_cast<std::size_t>(this->mask + 1);
+  }
+
+  template <typename T>
+  std::size_t Broadcast_Ring<T>::max_consumers() const
+  {
+    return this->header == nullptr ? 0 : static_cast<std::size_t>(this->header->max_consumers);
+  }
+
+  template <typename T>
+  std::size_t Broadcast_Ring<T>::get_consumer_id() const
+  {
+    return this->consumer_index;
+  }
+
+  template <typename T>
+  T* Broadcast_Ring<T>::claim()
+  {
+    if (this->header == nullptr)
+    {
+      return nullptr;
     }
-#endif
 
-    // Finally clear members
-    this->name.clear();
-    this->size = 0;
-    this->address = nullptr;
+    std::uint64_t next = this->header->published.load(std::memory_order_relaxed);
 
-#ifdef _WIN32
-    this->file_mapping = nullptr;
-#else
-    this->file_mapping = -1;
-#endif
+    // Only rescan the consumer cursors when the cached view says the ring is full
+    if (next - this->cached_min > this->mask)
+    {
+      this->cached_min = this->scan_min_cursor();
+
+      // Full: a reader that crashed may be what holds us back
+      if (next - this->cached_min > this->mask)
+      {
+        if (this->evict_dead() == 0)
+        {
+          return nullptr;
+        }
+
+        this->cached_min = this->scan_min_cursor();
+
+        if (next - this->cached_min > this->mask)
+        {
+          return nullptr;
+        }
+      }
+    }
+
+    return &this->slots[next & this->mask];
   }
 
-  inline void* Shared_Memory::map()
+  template <typename T>
+  void Broadcast_Ring<T>::publish()
   {
-    if (this->file_mapping == nullptr)
+    this->header->published.fetch_add(1, std::memory_order_release);
+  }
+
+  template <typename T>
+  bool Broadcast_Ring<T>::try_publish(const T& value)
+  {
+    T* slot = this->claim();
+
+    if (slot == nullptr)
+    {
+      return false;
+    }
+
+    *slot = value;
+    this->publish();
+    return true;
+  }
+
+  template <typename T>
+  std::size_t Broadcast_Ring<T>::evict_dead()
+  {
+    if (this->header == nullptr)
+    {
+      return 0;
+    }
+
+    std::size_t evicted = 0;
+
+    for (std::size_t i = 0; i < this->header->max_consumers; ++i)
+    {
+      Consumer& consumer = this->consumers[i];
+
+      // join() claims the slot and publishes its id in one CAS, so every taken slot names its
+      // process. Freeing with a CAS on that id means only one evicter wins, and never after a
+      // new consumer has claimed the slot.
+      std::uint32_t process_id = consumer.owner.load(std::memory_order_acquire);
+
+      if (process_id != 0 && !detail::process_alive(process_id) &&
+          consumer.owner.compare_exchange_strong(process_id, 0, std::memory_order_acq_rel))
+      {
+        ++evicted;
+      }
+    }
+
+    return evicted;
+  }
+
+  template <typename T>
+  bool Broadcast_Ring<T>::evict(std::size_t consumer_id)
+  {
+    if (this->header == nullptr || consumer_id >= this->header->max_consumers)
+    {
+      return false;
+    }
+
+    // Fails if the slot was free, or freed and taken by a new consumer meanwhile
+    std::atomic<std::uint32_t>& owner = this->consumers[consumer_id].owner;
+    std::uint32_t process_id = owner.load(std::memory_order_acquire);
+    return process_id != 0 && owner.compare_exchange_strong(process_id, 0, std::memory_order_acq_rel);
+  }
+
+  template <typename T>
+  bool Broadcast_Ring<T>::join()
+  {
+    if (this->header == nullptr || this->joined)
+    {
+      return this->joined;
+    }
+
+    for (std::size_t i = 0; i < this->header->max_consumers; ++i)
+    {
+      Consumer& consumer = this->consumers[i];
+      std::uint32_t expected = 0;
+
+      // Cursor goes in before the slot is taken, so a producer never sees a stale one
+      if (consumer.owner.load(std::memory_order_relaxed) == 0)
+      {
+        consumer.cursor.store(this->header->published.load(std::memory_order_acquire), std::memory_order_relaxed);
+
+        if (consumer.owner.compare_exchange_strong(expected, detail::current_process_id(), std::memory_order_acq_rel))
+        {
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          consumer.cursor.store(this->header->published.load(std::memory_order_acquire), std::memory_order_release);
+          this->consumer_index = i;
+          this->joined = true;
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  template <typename T>
+  void Broadcast_Ring<T>::leave()
+  {
+    if (this->header == nullptr || !this->joined)
+    {
+      return;
+    }
+
+    this->consumers[this->consumer_index].owner.store(0, std::memory_order_release);
+    this->joined = false;
+  }
+
+  template <typename T>
+  std::size_t Broadcast_Ring<T>::lag() const
+  {
+    if (this->header == nullptr || !this->joined)
+    {
+      return 0;
+    }
+
+    std::uint64_t cursor = this->consumers[this->consumer_index].cursor.load(std::memory_order_relaxed);
+    return static_cast<std::size_t>(this->header->published.load(std::memory_order_acquire) - cursor);
+  }
+
+  template <typename T>
+  const T* Broadcast_Ring<T>::peek() const
+  {
+    if (this->header == nullptr || !this->joined)
     {
       return nullptr;
     }
 
-    if (this->size == 0)
+    std::uint64_t cursor = this->consumers[this->consumer_index].cursor.load(std::memory_order_relaxed);
+
+    if (cursor == this->header->published.load(std::memory_order_acquire))
     {
       return nullptr;
     }
 
-#ifdef _WIN32
-    void* address = MapViewOfFile(this->file_mapping, FILE_MAP_ALL_ACCESS, 0, 0, this->size);
+    return &this->slots[cursor & this->mask];
+  }
 
-    if (address == nullptr)
+  template <typename T>
+  void Broadcast_Ring<T>::advance()
+  {
+    if (this->header == nullptr || !this->joined)
     {
-      CloseHandle(this->file_mapping); // Cleanup handle
-      this->file_mapping = nullptr;
+      return;
     }
 
-    return address;
-#else
-    void* address = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, this->file_mapping, 0);
+    // Release: our reads of the slot happen before the producer may reuse it
+    this->consumers[this->consumer_index].cursor.fetch_add(1, std::memory_order_release);
+  }
 
-    if (address == MAP_FAILED)
+  template <typename T>
+  bool Broadcast_Ring<T>::try_read(T& value)
+  {
+    const T* slot = this->peek();
+
+    if (slot == nullptr)
+    {
+      return false;
+    }
+
+    value = *slot;
+    this->advance();
+    return true;
+  }
+
+  template <typename T>
+  void Broadcast_Ring<T>::close()
+  {
+    this->leave();
+    this->memory.close();
+    this->header = nullptr;
+    this->consumers = nullptr;
+    this->slots = nullptr;
+    this->mask = 0;
+    this->cached_min = 0;
+  }
+
+  template <typename T>
+  bool Broadcast_Ring<T>::create(const std::string& name, std::size_t capacity, std::size_t max_consumers)
+  {
+    if (capacity == 0 || max_consumers == 0)
+    {
+      return false;
+    }
+
+    capacity = detail::round_up_pow2(capacity);
+    std::size_t consumers_end = 0;
+    std::size_t size = 0;
+
+    // A shape whose ring wouldn't fit a size_t
+    if (capacity == 0 || !detail::array_end(Broadcast_Ring::consumers_offset, max_consumers, sizeof(Consumer), consumers_end) ||
+      consumers_end > SIZE_MAX - detail::cache_line_size || !detail::array_end(detail::align_up(consumers_end, detail::cache_line_size), capacity, sizeof(T), size))
+    {
+      return false;
+    }
+
+    std::size_t slots_offset = detail::align_up(consumers_end, detail::cache_line_size);
+
+    if (!this->memory.create(name, size))
+    {
+      this->close();
+      return false;
+    }
+
+    unsigned char* base = static_cast<unsigned char*>(this->memory.get_address());
+    this->header = reinterpret_cast<Header*>(base);
+    this->consumers = reinterpret_cast<Consumer*>(base + Broadcast_Ring::consumers_offset);
+    this->slots = reinterpret_cast<T*>(base + slots_offset);
+
+    detail::initialize_once(this->header->state, [&]
+    {
+      this->header->capacity = capacity;
+      this->header->max_consumers = max_consumers;
+    });
+
+    // Attached to a ring that was created with a different shape. Only detach, the name still
+    // belongs to whoever created it.
+    if (this->header->capacity != capacity || this->header->max_consumers != max_consumers)
+    {
+      this->memory.detach();
+      this->close();
+      return false;
+    }
+
+    this->mask = capacity - 1;
+    this->cached_min = this->scan_min_cursor();
+    return true;
+  }
+
+  template <typename T>
+  Broadcast_Ring<T>::Broadcast_Ring(const std::string& name, std::size_t capacity, std::size_t max_consumers)
+  {
+    this->create(name, capacity, max_consumers);
+  }
+
+  template <typename T>
+  Broadcast_Ring<T>::~Broadcast_Ring()
+  {
+    this->close();
+  }
+
+  // Shared_Memory_Pool
+
+  inline std::size_t Shared_Memory_Pool::segment_index(Handle handle) const
+  {
+    return static_cast<std::size_t>(handle >> 24) * this->header->segments_per_bucket + (handle & 0xFFFFFFu);
+  }
+
+  inline bool Shared_Memory_Pool::valid(Handle handle) const
+  {
+    return this->header != nullptr && (handle >> 24) < this->header->bucket_count && (handle & 0xFFFFFFu) < this->header->segments_per_bucket;
+  }
+
+  inline std::size_t Shared_Memory_Pool::get_bucket_count() const
+  {
+    return this->header == nullptr ? 0 : this->header->bucket_count;
+  }
+
+  inline std::size_t Shared_Memory_Pool::get_bucket_size(std::size_t bucket) const
+  {
+    return bucket < this->get_bucket_count() ? static_cast<std::size_t>(this->header->sizes[bucket]) : 0;
+  }
+
+  inline std::size_t Shared_Memory_Pool::get_available(std::size_t bucket) const
+  {
+    return bucket < this->get_bucket_count() ? this->header->buckets[bucket].available.load(std::memory_order_relaxed) : 0;
+  }
+
+  inline Shared_Memory_Pool::Handle Shared_Memory_Pool::acquire(std::size_t size)
+  {
+    for (std::size_t bucket = 0; bucket < this->get_bucket_count(); ++bucket)
+    {
+      if (this->header->sizes[bucket] < size)
+      {
+        continue;
+      }
+
+      std::atomic<std::uint64_t>& list = this->header->buckets[bucket].head;
+      std::size_t first = bucket * this->header->segments_per_bucket;
+      std::uint64_t head = list.load(std::memory_order_acquire);
+
+      // Same tagged Treiber stack as Shared_Arena, links never go away so reading a stale one is safe
+      while (static_cast<std::uint32_t>(head) != 0)
+      {
+        std::uint32_t index = static_cast<std::uint32_t>(head) - 1;
+        std::uint64_t next = this->links[first + index].load(std::memory_order_relaxed);
+        std::uint64_t tag = (head >> 32) + 1;
+
+        if (list.compare_exchange_weak(head, next | (tag << 32), std::memory_order_acquire, std::memory_order_acquire))
+        {
+          // A stale pop reading this link fails its CAS on the tag anyway
+          this->links[first + index].store(Shared_Memory_Pool::in_use_link, std::memory_order_relaxed);
+          this->header->buckets[bucket].available.fetch_sub(1, std::memory_order_relaxed);
+          return static_cast<Handle>(bucket << 24) | index;
+        }
+      }
+    }
+
+    return Shared_Memory_Pool::null_handle;
+  }
+
+  inline void Shared_Memory_Pool::release(Handle handle)
+  {
+    if (handle == Shared_Memory_Pool::null_handle || this->header == nullptr)
+    {
+      return;
+    }
+
+    // Only the holder may take a segment out of use, a second release finds it already free
+    std::uint32_t in_use = Shared_Memory_Pool::in_use_link;
+    bool acquired = this->valid(handle) && this->links[this->segment_index(handle)].compare_exchange_strong(in_use, 0, std::memory_order_relaxed);
+
+    assert(acquired && "Shared_Memory_Pool::release: double release or not a handle of this pool");
+
+    if (!acquired)
+    {
+      return;
+    }
+
+    std::size_t bucket = handle >> 24;
+    std::atomic<std::uint64_t>& list = this->header->buckets[bucket].head;
+    std::atomic<std::uint32_t>& link = this->links[this->segment_index(handle)];
+    std::uint64_t head = list.load(std::memory_order_relaxed);
+    std::uint64_t tag;
+
+    do
+    {
+      link.store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+      tag = (head >> 32) + 1;
+    } while (!list.compare_exchange_weak(head, ((handle & 0xFFFFFFu) + 1) | (tag << 32), std::memory_order_release, std::memory_order_relaxed));
+
+    this->header->buckets[bucket].available.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  inline void* Shared_Memory_Pool::get_address(Handle handle) const
+  {
+    if (!this->valid(handle))
     {
-      close(this->file_mapping); // Cleanup file descriptor
-      this->file_mapping = -1;
       return nullptr;
     }
 
-    return address;
-#endif
+    return this->segments[this->segment_index(handle)]->get_address();
   }
 
-  inline bool Shared_Memory::create(const std::string& name, std::size_t size)
+  inline std::size_t Shared_Memory_Pool::get_size(Handle handle) const
   {
-    if (name.empty())
+    if (!this->valid(handle))
+    {
+      return 0;
+    }
+
+    return this->segments[this->segment_index(handle)]->get_size();
+  }
+
+  inline void Shared_Memory_Pool::close()
+  {
+    bool last = this->joined && this->header->attached.fetch_sub(1, std::memory_order_acq_rel) == 1;
+
+    for (std::unique_ptr<Shared_Memory>& segment : this->segments)
+    {
+      last ? segment->close() : segment->detach();
+    }
+
+    this->segments.clear();
+    last ? this->control.close() : this->control.detach();
+    this->header = nullptr;
+    this->links = nullptr;
+    this->joined = false;
+  }
+
+  inline bool Shared_Memory_Pool::create(const std::string& name, const std::vector<std::size_t>& bucket_sizes, std::size_t segments_per_bucket,
+    Memory_Flags flags)
+  {
+    if (bucket_sizes.empty() || bucket_sizes.size() > Shared_Memory_Pool::max_buckets)
     {
       return false;
     }
 
-    if (size == 0)
+    if (segments_per_bucket == 0 || segments_per_bucket >= Shared_Memory_Pool::max_segments_per_bucket)
     {
       return false;
     }
 
-    this->name = name;
-    this->size = size;
+    for (std::size_t i = 0; i < bucket_sizes.size(); ++i)
+    {
+      if (bucket_sizes[i] == 0 || (i > 0 && bucket_sizes[i] <= bucket_sizes[i - 1]))
+      {
+        return false;
+      }
+    }
 
-#ifdef _WIN32
-    this->file_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, size, name.data());
-    // return this->file_mapping != nullptr;
-#else
-    int shm_fd = shm_open(name.data(), O_CREAT | O_RDWR, 0666);
+    // Segments are handed out by address, growing one would move it under its current user
+    if (flags & Memory_Flags::growable)
+    {
+      return false;
+    }
 
-    if (shm_fd == -1)
+    std::size_t segment_count = bucket_sizes.size() * segments_per_bucket;
+
+    if (!this->control.create(name, Shared_Memory_Pool::links_offset + segment_count * sizeof(std::atomic<std::uint32_t>)))
     {
+      this->close();
       return false;
     }
 
-    if (ftruncate(shm_fd, size) == -1)
+    unsigned char* base = static_cast<unsigned char*>(this->control.get_address());
+    this->header = reinterpret_cast<Header*>(base);
+    this->links = reinterpret_cast<std::atomic<std::uint32_t>*>(base + Shared_Memory_Pool::links_offset);
+
+    detail::initialize_once(this->header->state, [&]
+    {
+      this->joined = true;
+      this->header->attached.store(1, std::memory_order_relaxed);
+      this->header->bucket_count = static_cast<std::uint32_t>(bucket_sizes.size());
+      this->header->segments_per_bucket = static_cast<std::uint32_t>(segments_per_bucket);
+
+      for (std::size_t bucket = 0; bucket < bucket_sizes.size(); ++bucket)
+      {
+        std::size_t first = bucket * segments_per_bucket;
+        this->header->sizes[bucket] = bucket_sizes[bucket];
+
+        // Every segment starts out free, chained in index order
+        for (std::size_t index = 0; index < segments_per_bucket; ++index)
+        {
+          std::uint32_t next = index + 1 < segments_per_bucket ? static_cast<std::uint32_t>(index + 2) : 0;
+          this->links[first + index].store(next, std::memory_order_relaxed);
+        }
+
+        this->header->buckets[bucket].head.store(1, std::memory_order_relaxed);
+        this->header->buckets[bucket].available.store(static_cast<std::uint32_t>(segments_per_bucket), std::memory_order_relaxed);
+      }
+    });
+
+    // Attached to a pool that was created with a different shape
+    bool same_shape = this->header->bucket_count == bucket_sizes.size() && this->header->segments_per_bucket == segments_per_bucket;
+
+    for (std::size_t bucket = 0; same_shape && bucket < bucket_sizes.size(); ++bucket)
+    {
+      same_shape = this->header->sizes[bucket] == bucket_sizes[bucket];
+    }
+
+    if (!same_shape)
     {
-      close(shm_fd);
-      shm_unlink(name.data());
+      this->close();
       return false;
     }
 
-    this->file_mapping = shm_fd;
-    // return true;
-#endif
+    // Once the count has dropped to 0 the segment names may already be gone, and creating them
+    // again would hand this process memory nobody else sees
+    std::uint32_t attached = this->header->attached.load(std::memory_order_relaxed);
 
-    // Now map to memory
-    this->address = this->map();
-    return this->address != nullptr;
+    while (!this->joined)
+    {
+      if (attached == 0)
+      {
+        this->close();
+        return false;
+      }
+
+      this->joined = this->header->attached.compare_exchange_weak(attached, attached + 1, std::memory_order_acq_rel, std::memory_order_relaxed);
+    }
+
+    // Map (and prefault) everything now so acquire() never has to make a system call
+    this->segments.reserve(segment_count);
+
+    for (std::size_t bucket = 0; bucket < bucket_sizes.size(); ++bucket)
+    {
+      for (std::size_t index = 0; index < segments_per_bucket; ++index)
+      {
+        std::unique_ptr<Shared_Memory> segment{ new Shared_Memory };
+        std::string segment_name = name + "." + std::to_string(bucket) + "." + std::to_string(index);
+
+        if (!segment->create(segment_name, bucket_sizes[bucket], flags))
+        {
+          this->close();
+          return false;
+        }
+
+        this->segments.push_back(std::move(segment));
+      }
+    }
+
+    return true;
   }
 
-  inline Shared_Memory::Shared_Memory(const std::string& name, std::size_t size)
+  inline Shared_Memory_Pool::Shared_Memory_Pool(const std::string& name, const std::vector<std::size_t>& bucket_sizes, std::size_t segments_per_bucket,
+    Memory_Flags flags)
   {
-    this->create(name, size);
+    this->create(name, bucket_sizes, segments_per_bucket, flags);
   }
 
-  inline Shared_Memory::~Shared_Memory()
+  inline Shared_Memory_Pool::~Shared_Memory_Pool()
   {
     this->close();
   }
@@ -0,0 +1,148 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Shared_Barrier and Shared_Latch: no process running ahead into
+// the next generation, exactly one serial process per generation, the latch releasing every
+// waiting process at once and staying open, count_down() by more than one, and timeouts.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+
+using namespace sasm_test;
+
+namespace
+{
+  constexpr std::uint32_t participants{ 4 };
+  constexpr std::uint32_t generations{ 2000 };
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    sasm::Shared_Barrier barrier{ participants };
+    sasm::Shared_Latch latch{ participants };
+    sasm::Shared_Latch gate{ 1 };
+    std::atomic<std::uint32_t> arrivals[generations];
+    std::atomic<std::uint32_t> serials[generations];
+    std::atomic<std::uint32_t> released;
+  };
+
+  Control* control{ nullptr };
+
+  void test_barrier()
+  {
+    check(control->barrier.get_participants() == participants, "the barrier has the requested participants");
+    pid_t pids[participants];
+
+    // Past the barrier for generation g, every participant must have counted itself into g
+    for (pid_t& pid : pids)
+    {
+      pid = spawn([]
+      {
+        bool ok = true;
+
+        for (std::uint32_t generation = 0; generation < generations; ++generation)
+        {
+          control->arrivals[generation].fetch_add(1);
+
+          if (control->barrier.arrive_and_wait())
+          {
+            control->serials[generation].fetch_add(1);
+          }
+
+          ok = ok && control->arrivals[generation].load() == participants;
+        }
+
+        return ok;
+      });
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    bool one_serial = true;
+
+    for (std::uint32_t generation = 0; generation < generations; ++generation)
+    {
+      one_serial = one_serial && control->serials[generation].load() == 1;
+    }
+
+    check(all, "nobody leaves a generation before everybody arrived");
+    check(one_serial, "exactly one process per generation is the serial one");
+    check(control->barrier.get_generation() == generations, "the barrier counted every generation");
+  }
+
+  void test_latch()
+  {
+    sasm::Shared_Latch& latch = control->latch;
+    check(latch.get_count() == participants && !latch.try_wait(), "a new latch is closed");
+
+    auto start = std::chrono::steady_clock::now();
+    check(!latch.wait(100), "waiting on a closed latch times out");
+    long long waited = elapsed_ms(start);
+    check(waited >= 99 && waited < 2000, "the timeout takes about 100 ms");
+
+    // Waiters block on the gate; the parent opens it once they have all gone to sleep on it
+    constexpr int waiters = 4;
+    pid_t pids[waiters];
+
+    for (pid_t& pid : pids)
+    {
+      pid = spawn([]
+      {
+        bool opened = control->gate.wait(10000);
+        control->released.fetch_add(1);
+        return opened && control->gate.try_wait();
+      });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    check(control->released.load() == 0, "nobody passes a closed latch");
+    control->gate.count_down();
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all && control->released.load() == waiters, "one count_down() releases every waiting process");
+    check(control->gate.wait(0) && control->gate.wait(), "an open latch stays open");
+
+    // The participants count down in two steps of two, the last of them waits for the rest
+    pid_t first = spawn([]
+    {
+      control->latch.count_down(2);
+      return control->latch.wait(10000);
+    });
+
+    check(control->latch.arrive_and_wait(2, 10000), "arrive_and_wait() by the amount still missing returns");
+    check(succeeded(first) && latch.get_count() == 0 && latch.try_wait(), "count_down() by two opens it in two steps");
+  }
+}
+
+int main()
+{
+  begin();
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+
+  test_barrier();
+  test_latch();
+
+  return finish("barrier_latch_test");
+}
@@ -0,0 +1,363 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Broadcast_Ring: the producer never blocks without consumers,
+// every consumer process sees every message in order, a slow consumer holds the producer back
+// by exactly one lap, the consumer limit, refusing a mismatched shape or one that would not fit a
+// size_t, a consumer that dies without leave() getting evicted, even when killed in the middle of
+// join() or leave().
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <memory>
+#include <new>
+#include <vector>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const ring_name{ "/sasm_broadcast_ring_test" };
+  constexpr std::size_t ring_capacity{ 8 };
+  constexpr std::size_t ring_consumers{ 2 };
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    std::atomic<std::uint32_t> joined;
+    std::atomic<std::uint32_t> release;   // Children holding a slot wait for this
+    std::atomic<std::uint32_t> read_one;  // Asks the slow consumer to read a single message
+    std::atomic<std::uint64_t> consumer_id;
+  };
+
+  Control* control{ nullptr };
+
+  // Runs body in a child process on its own ring attached by name, which it never destroys
+  template <typename Body>
+  pid_t spawn_attached(Body&& body)
+  {
+    return spawn([&body]
+    {
+      sasm::Broadcast_Ring<std::uint64_t>* ring = new sasm::Broadcast_Ring<std::uint64_t>(ring_name, ring_capacity, ring_consumers);
+      return ring->capacity() != 0 && body(*ring);
+    });
+  }
+
+  void reset_control()
+  {
+    control->joined.store(0);
+    control->release.store(0);
+    control->read_one.store(0);
+    control->consumer_id.store(0);
+  }
+
+  int publish_until_full(sasm::Broadcast_Ring<std::uint64_t>& ring, std::uint64_t& next, int limit)
+  {
+    int published = 0;
+
+    while (published < limit && ring.try_publish(next))
+    {
+      ++next;
+      ++published;
+    }
+
+    return published;
+  }
+
+  void test_no_consumers(sasm::Broadcast_Ring<std::uint64_t>& ring, std::uint64_t& next)
+  {
+    check(publish_until_full(ring, next, 100) == 100, "the producer never blocks while nobody has joined");
+  }
+
+  void test_every_consumer_sees_everything(sasm::Broadcast_Ring<std::uint64_t>& ring, std::uint64_t& next)
+  {
+    constexpr std::uint64_t count = 100000;
+    reset_control();
+    std::uint64_t first = next;
+    pid_t children[ring_consumers];
+
+    for (pid_t& child : children)
+    {
+      child = spawn_attached([first](sasm::Broadcast_Ring<std::uint64_t>& shared)
+      {
+        if (!shared.join())
+        {
+          return false;
+        }
+
+        control->joined.fetch_add(1);
+        bool ordered = true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+
+        for (std::uint64_t expected = first; expected < first + count && std::chrono::steady_clock::now() < deadline;)
+        {
+          std::uint64_t value;
+
+          if (shared.try_read(value))
+          {
+            ordered = ordered && value == expected;
+            ++expected;
+          }
+          else
+          {
+            std::this_thread::yield();
+          }
+        }
+
+        bool caught_up = shared.lag() == 0;
+        shared.leave();
+        return ordered && caught_up;
+      });
+    }
+
+    check(wait_until(control->joined, ring_consumers), "both consumers joined");
+
+    for (std::uint64_t sent = 0; sent < count;)
+    {
+      if (ring.try_publish(next))
+      {
+        ++next;
+        ++sent;
+      }
+      else
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    bool all = true;
+
+    for (pid_t child : children)
+    {
+      all = succeeded(child) && all;
+    }
+
+    check(all, "every consumer reads every message in order");
+  }
+
+  void test_slow_consumer(sasm::Broadcast_Ring<std::uint64_t>& ring, std::uint64_t& next)
+  {
+    reset_control();
+
+    pid_t child = spawn_attached([](sasm::Broadcast_Ring<std::uint64_t>& shared)
+    {
+      if (!shared.join())
+      {
+        return false;
+      }
+
+      control->joined.store(1);
+      std::uint64_t value;
+
+      // Read exactly one message when asked, then hold on until released
+      bool read = wait_until(control->read_one, 1) && shared.try_read(value);
+      control->read_one.store(2);
+      bool released = wait_until(control->release, 1);
+      shared.leave();
+      return read && released;
+    });
+
+    check(wait_until(control->joined, 1), "the slow consumer joined");
+    check(publish_until_full(ring, next, 100) == static_cast<int>(ring_capacity), "a consumer that doesn't read lets exactly one lap through");
+    check(ring.claim() == nullptr, "claim() reports the full ring");
+
+    control->read_one.store(1);
+    check(wait_until(control->read_one, 2), "the slow consumer read one message");
+    check(publish_until_full(ring, next, 100) == 1, "reading one message frees one slot");
+
+    control->release.store(1);
+    check(succeeded(child), "the slow consumer exits cleanly");
+    check(publish_until_full(ring, next, 100) == 100, "after leave() the producer runs free again");
+  }
+
+  void test_consumer_limit()
+  {
+    reset_control();
+    constexpr int candidates = ring_consumers + 1;
+    pid_t children[candidates];
+
+    for (pid_t& child : children)
+    {
+      child = spawn_attached([](sasm::Broadcast_Ring<std::uint64_t>& shared)
+      {
+        bool joined = shared.join();
+
+        if (joined)
+        {
+          control->joined.fetch_add(1);
+        }
+
+        control->read_one.fetch_add(1); // Counts attempts
+        wait_until(control->release, 1);
+        shared.leave();
+        return joined;
+      });
+    }
+
+    wait_until(control->read_one, candidates);
+    check(control->joined.load() == ring_consumers, "only max_consumers processes can join");
+    control->release.store(1);
+
+    int joined = 0;
+
+    for (pid_t child : children)
+    {
+      joined += succeeded(child) ? 1 : 0;
+    }
+
+    check(joined == static_cast<int>(ring_consumers), "the other join() fails");
+  }
+
+  void test_mismatch()
+  {
+    // Neither may unlink the ring, the tests after this one attach to it by name
+    sasm::Broadcast_Ring<std::uint64_t> other;
+    check(!other.create(ring_name, ring_capacity * 2, ring_consumers), "attaching with a different capacity fails");
+    check(!other.create(ring_name, ring_capacity, ring_consumers + 1), "attaching with a different consumer count fails");
+  }
+
+  void test_overflow()
+  {
+    // Capacities whose ring would not fit a size_t, none may leave an object behind
+    const char* const name = "/sasm_broadcast_ring_test_overflow";
+    sasm::Broadcast_Ring<std::uint64_t> huge;
+    check(!huge.create(name, SIZE_MAX, 4), "a capacity with no power of two above it fails");
+    check(!huge.create(name, SIZE_MAX / 2 + 1, 4), "a capacity whose slots wrap a size_t fails");
+    check(!huge.create(name, SIZE_MAX / sizeof(std::uint64_t), 4), "a capacity that rounds up into a wrap fails");
+    check(!huge.create(name, 8, SIZE_MAX / 2), "a consumer count whose table wraps a size_t fails");
+    check(shm_open(name, O_RDONLY, 0) == -1, "the failed creates leave nothing behind");
+  }
+
+  void test_dead_consumer(sasm::Broadcast_Ring<std::uint64_t>& ring, std::uint64_t& next)
+  {
+    reset_control();
+
+    pid_t child = spawn_attached([](sasm::Broadcast_Ring<std::uint64_t>& shared)
+    {
+      if (!shared.join())
+      {
+        return false;
+      }
+
+      control->consumer_id.store(shared.get_consumer_id());
+      control->joined.store(1);
+
+      // Never reads and never leaves
+      for (;;)
+      {
+        pause();
+      }
+    });
+
+    check(wait_until(control->joined, 1), "the doomed consumer joined");
+    check(publish_until_full(ring, next, 100) == static_cast<int>(ring_capacity), "the live consumer holds the producer back");
+    check(ring.evict_dead() == 0, "a live consumer isn't evicted");
+
+    // Dies without leave(). Reap it, a zombie still counts as a running process.
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+
+    check(publish_until_full(ring, next, 100) == 100, "claim() evicts the dead consumer");
+    check(!ring.evict(static_cast<std::size_t>(control->consumer_id.load())), "the evicted slot is already free");
+    check(!ring.evict(ring_consumers), "evict() rejects an out of range id");
+  }
+
+  void test_killed_while_joining(sasm::Broadcast_Ring<std::uint64_t>& ring)
+  {
+    reset_control();
+
+    // Consumers that do nothing but join and leave, killed at whatever point they reached
+    for (int round = 0; round < 40; ++round)
+    {
+      pid_t child = spawn_attached([](sasm::Broadcast_Ring<std::uint64_t>& shared)
+      {
+        control->joined.store(1);
+
+        for (;;)
+        {
+          shared.join();
+          shared.leave();
+        }
+
+        return true;
+      });
+
+      wait_until(control->joined, 1);
+      std::this_thread::sleep_for(std::chrono::microseconds(100 * (round % 10)));
+      kill(child, SIGKILL);
+      waitpid(child, nullptr, 0);
+      control->joined.store(0);
+    }
+
+    // Whatever slot a child held when it died names it, so the dead are all evicted
+    ring.evict_dead();
+
+    // Run last: destroying these closes, and so unlinks, the name
+    std::vector<std::unique_ptr<sasm::Broadcast_Ring<std::uint64_t>>> consumers;
+    bool joined = true;
+
+    for (std::size_t i = 0; i < ring_consumers; ++i)
+    {
+      consumers.emplace_back(new sasm::Broadcast_Ring<std::uint64_t>(ring_name, ring_capacity, ring_consumers));
+      joined = consumers.back()->join() && joined;
+    }
+
+    check(joined, "every slot is free again after consumers died inside join() or leave()");
+  }
+
+  void test_explicit_evict(sasm::Broadcast_Ring<std::uint64_t>& ring, std::uint64_t& next)
+  {
+    reset_control();
+
+    pid_t child = spawn_attached([](sasm::Broadcast_Ring<std::uint64_t>& shared)
+    {
+      if (!shared.join())
+      {
+        return false;
+      }
+
+      control->consumer_id.store(shared.get_consumer_id());
+      control->joined.store(1);
+      return wait_until(control->release, 1);
+    });
+
+    check(wait_until(control->joined, 1), "the consumer joined");
+    publish_until_full(ring, next, 100);
+    check(ring.evict(static_cast<std::size_t>(control->consumer_id.load())), "evict() frees a live consumer's slot");
+    check(publish_until_full(ring, next, 100) == 100, "and the producer runs free");
+
+    control->release.store(1);
+    check(succeeded(child), "the evicted consumer exits cleanly");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(ring_name);
+
+  control = shared_block<Control>();
+  sasm::Broadcast_Ring<std::uint64_t> ring(ring_name, ring_capacity, ring_consumers);
+
+  if (control == nullptr || ring.capacity() == 0)
+  {
+    std::printf("FAIL: could not create the ring\n");
+    return 1;
+  }
+  std::uint64_t next = 0;
+
+  test_no_consumers(ring, next);
+  test_every_consumer_sees_everything(ring, next);
+  test_slow_consumer(ring, next);
+  test_consumer_limit();
+  test_mismatch();
+  test_overflow();
+  test_dead_consumer(ring, next);
+  test_explicit_evict(ring, next);
+  test_killed_while_joining(ring);
+
+  return finish("broadcast_ring_test");
+}
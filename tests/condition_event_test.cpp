@@ -0,0 +1,328 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Futex_Mutex, Shared_Condition_Variable and Shared_Event:
+// mutual exclusion and lock timeouts between processes, a bounded queue handing items across
+// processes through two condition variables, notify_all() with the mutex waking every waiter,
+// wait timeouts, an auto reset event letting exactly one process through per set(), and a
+// manual reset event releasing everybody until reset().
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+
+using namespace sasm_test;
+
+namespace
+{
+  constexpr std::uint32_t queue_capacity{ 4 };
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    sasm::Futex_Mutex mutex;
+    sasm::Shared_Condition_Variable not_empty;
+    sasm::Shared_Condition_Variable not_full;
+    sasm::Shared_Event auto_event;
+    sasm::Shared_Event manual_event{ true };
+    std::atomic<std::uint32_t> started;
+    std::atomic<std::uint32_t> passed;
+    std::atomic<std::uint32_t> release;
+
+    // Only touched under mutex
+    std::uint64_t items[queue_capacity];
+    std::uint32_t head;
+    std::uint32_t count;
+    std::uint64_t counter;
+    std::uint32_t go;
+  };
+
+  Control* control{ nullptr };
+
+  // Runs call and tells whether it took about 100 ms
+  template <typename Call>
+  bool takes_100_ms(Call&& call)
+  {
+    auto start = std::chrono::steady_clock::now();
+    call();
+    long long waited = elapsed_ms(start);
+    return waited >= 99 && waited < 2000;
+  }
+
+  void reset_control()
+  {
+    control->started.store(0);
+    control->passed.store(0);
+    control->release.store(0);
+  }
+
+  void test_mutex()
+  {
+    reset_control();
+    control->counter = 0;
+
+    pid_t holder = spawn([]
+    {
+      control->mutex.lock();
+      control->started.store(1);
+      bool released = wait_until(control->release, 1);
+      control->mutex.unlock();
+      return released;
+    });
+
+    check(wait_until(control->started, 1), "the child took the mutex");
+    check(!control->mutex.try_lock(), "try_lock() fails while another process holds it");
+
+    bool timed_out = false;
+    check(takes_100_ms([&] { timed_out = !control->mutex.lock(100); }), "lock(100) takes about 100 ms");
+    check(timed_out, "lock(100) times out while another process holds it");
+
+    control->release.store(1);
+    check(succeeded(holder), "the holder unlocks and exits");
+
+    constexpr int children = 4;
+    pid_t pids[children];
+
+    for (pid_t& pid : pids)
+    {
+      pid = spawn([]
+      {
+        for (int round = 0; round < 20000; ++round)
+        {
+          control->mutex.lock();
+          std::uint64_t value = control->counter;
+
+          if (round % 64 == 0)
+          {
+            std::this_thread::yield();
+          }
+
+          control->counter = value + 1;
+          control->mutex.unlock();
+        }
+
+        return true;
+      });
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all && control->counter == children * 20000, "no increment is lost between processes");
+  }
+
+  void test_bounded_queue()
+  {
+    constexpr std::uint64_t count = 20000;
+    control->head = 0;
+    control->count = 0;
+
+    // Producer and consumer in separate processes, sleeping whenever the queue is full or empty
+    pid_t producer = spawn([]
+    {
+      for (std::uint64_t item = 0; item < count; ++item)
+      {
+        control->mutex.lock();
+
+        while (control->count == queue_capacity)
+        {
+          control->not_full.wait(control->mutex);
+        }
+
+        control->items[(control->head + control->count) % queue_capacity] = item;
+        ++control->count;
+        control->mutex.unlock();
+        control->not_empty.notify_one();
+      }
+
+      return true;
+    });
+
+    pid_t consumer = spawn([]
+    {
+      bool ordered = true;
+
+      for (std::uint64_t expected = 0; expected < count; ++expected)
+      {
+        control->mutex.lock();
+
+        while (control->count == 0)
+        {
+          control->not_empty.wait(control->mutex);
+        }
+
+        ordered = ordered && control->items[control->head] == expected;
+        control->head = (control->head + 1) % queue_capacity;
+        --control->count;
+        control->mutex.unlock();
+        control->not_full.notify_one();
+      }
+
+      return ordered;
+    });
+
+    check(succeeded(producer) && succeeded(consumer), "items cross processes in order through the condition variables");
+  }
+
+  void test_notify_all()
+  {
+    reset_control();
+    control->go = 0;
+    constexpr int waiters = 4;
+    pid_t pids[waiters];
+
+    for (pid_t& pid : pids)
+    {
+      pid = spawn([]
+      {
+        control->mutex.lock();
+        control->started.fetch_add(1);
+
+        while (control->go == 0)
+        {
+          control->not_empty.wait(control->mutex, 10000);
+        }
+
+        control->passed.fetch_add(1);
+        control->mutex.unlock();
+        return true;
+      });
+    }
+
+    check(wait_until(control->started, waiters), "every waiter is in");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // Requeued waiters get the mutex one by one once it is released
+    control->mutex.lock();
+    control->go = 1;
+    control->not_empty.notify_all(control->mutex);
+    control->mutex.unlock();
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all && control->passed.load() == waiters, "notify_all() with the mutex wakes every waiting process");
+
+    control->mutex.lock();
+    bool woken = true;
+    check(takes_100_ms([&] { woken = control->not_empty.wait(control->mutex, 100); }), "a condition wait(100) takes about 100 ms");
+    control->mutex.unlock();
+    check(!woken, "a condition wait nobody notifies times out");
+  }
+
+  void test_auto_reset()
+  {
+    reset_control();
+    sasm::Shared_Event& event = control->auto_event;
+    check(!event.is_manual_reset() && !event.is_set(), "a default event is an unset auto reset one");
+
+    bool passed = true;
+    check(takes_100_ms([&] { passed = event.wait(100); }), "an event wait(100) takes about 100 ms");
+    check(!passed, "waiting on an unset event times out");
+
+    constexpr int waiters = 4;
+    pid_t pids[waiters];
+
+    for (pid_t& pid : pids)
+    {
+      pid = spawn([]
+      {
+        control->started.fetch_add(1);
+        bool woken = control->auto_event.wait(10000);
+        control->passed.fetch_add(1);
+        return woken;
+      });
+    }
+
+    check(wait_until(control->started, waiters), "every waiter is in");
+
+    // One set() per waiter, each lets exactly one through
+    bool one_each = true;
+
+    for (std::uint32_t i = 1; i <= waiters; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      event.set();
+      one_each = wait_until(control->passed, i) && one_each;
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      one_each = one_each && control->passed.load() == i;
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(one_each && all, "an auto reset event lets exactly one process through per set()");
+    check(!event.is_set(), "and clears itself");
+  }
+
+  void test_manual_reset()
+  {
+    reset_control();
+    sasm::Shared_Event& event = control->manual_event;
+    check(event.is_manual_reset() && !event.is_set(), "a manual reset event starts unset");
+
+    constexpr int waiters = 4;
+    pid_t pids[waiters];
+
+    for (pid_t& pid : pids)
+    {
+      pid = spawn([]
+      {
+        control->started.fetch_add(1);
+        return control->manual_event.wait(10000) && control->manual_event.wait(0);
+      });
+    }
+
+    check(wait_until(control->started, waiters), "every waiter is in");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    event.set();
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all && event.is_set(), "a manual reset event releases every process and stays set");
+
+    event.reset();
+    check(!event.is_set() && !event.wait(0), "reset() clears it");
+  }
+}
+
+int main()
+{
+  begin();
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+
+  test_mutex();
+  test_bounded_queue();
+  test_notify_all();
+  test_auto_reset();
+  test_manual_reset();
+
+  return finish("condition_event_test");
+}
@@ -0,0 +1,137 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Event_Notifier: semaphore counting, timeouts, one increment
+// carrying a large count, an eventfd passed to another process over a Unix socket working in
+// both directions, and attach() / receive_from() refusing a blocking descriptor.
+
+#include "test_util.h"
+
+#include <sys/socket.h>
+
+#include <cstdio>
+
+using namespace sasm_test;
+
+namespace
+{
+  void test_counting()
+  {
+    sasm::Event_Notifier notifier(2);
+    check(notifier.get_fd() != -1, "create() opens an eventfd");
+    check(notifier.try_wait() && notifier.try_wait() && !notifier.try_wait(), "each wait takes exactly one count");
+
+    auto start = std::chrono::steady_clock::now();
+    check(!notifier.wait(100), "waiting on a zero count times out");
+    long long waited = elapsed_ms(start);
+    check(waited >= 99 && waited < 2000, "the timeout takes about 100 ms");
+
+    check(notifier.increment(1000), "increment(1000) is accepted");
+    int taken = 0;
+
+    while (notifier.try_wait())
+    {
+      ++taken;
+    }
+
+    check(taken == 1000, "a single increment carries the whole count");
+  }
+
+  void test_passed_to_another_process()
+  {
+    int sockets[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+    {
+      check(false, "socketpair() works");
+      return;
+    }
+
+    // The child creates its own notifiers and hands them over. It only shares the socket with the
+    // parent, so the eventfds can't have been inherited.
+    pid_t child = spawn([&sockets]
+    {
+      ::close(sockets[0]);
+      sasm::Event_Notifier* pings = new sasm::Event_Notifier(0);
+      sasm::Event_Notifier* pongs = new sasm::Event_Notifier(0);
+
+      if (!pings->send_to(sockets[1]) || !pongs->send_to(sockets[1]))
+      {
+        return false;
+      }
+
+      // One pong per ping
+      for (int ping = 0; ping < 3; ++ping)
+      {
+        if (!pings->wait(10000) || !pongs->increment())
+        {
+          return false;
+        }
+      }
+
+      return !pings->try_wait();
+    });
+
+    ::close(sockets[1]);
+    sasm::Event_Notifier pings;
+    sasm::Event_Notifier pongs;
+    check(pings.receive_from(sockets[0]) && pongs.receive_from(sockets[0]), "receive_from() gets the child's eventfds");
+
+    pings.increment();
+    pings.increment(2);
+    int answered = 0;
+
+    for (int pong = 0; pong < 3; ++pong)
+    {
+      answered += pongs.wait(10000) ? 1 : 0;
+    }
+
+    check(succeeded(child), "the child sees the parent's increments");
+    check(answered == 3 && !pongs.try_wait(), "the parent sees the child's increments");
+    ::close(sockets[0]);
+  }
+
+  void test_blocking_descriptor()
+  {
+    int blocking = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
+    sasm::Event_Notifier notifier;
+    check(!notifier.attach(blocking) && notifier.get_fd() == -1, "attach() refuses a blocking eventfd");
+    check(fcntl(blocking, F_GETFD) != -1, "and leaves it to the caller");
+    check(!notifier.attach(-1), "attach() refuses -1");
+
+    int sockets[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+    {
+      ::close(blocking);
+      check(false, "socketpair() works");
+      return;
+    }
+
+    // Send the blocking one over by hand, the receiving side must turn it down
+    pid_t child = spawn([&sockets, blocking]
+    {
+      return sasm::detail::send_fd(sockets[1], blocking, nullptr, 0);
+    });
+
+    check(!notifier.receive_from(sockets[0]) && notifier.get_fd() == -1, "receive_from() refuses a blocking eventfd");
+    check(succeeded(child), "the child sent it");
+
+    ::close(blocking);
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+  }
+}
+
+int main()
+{
+  begin();
+
+  test_counting();
+  test_passed_to_another_process();
+  test_blocking_descriptor();
+
+  return finish("event_notifier_test");
+}
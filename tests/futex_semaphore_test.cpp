@@ -0,0 +1,149 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Futex_Semaphore placed in a Shared_Memory segment: attaching by
+// name from another process, counts crossing the process boundary, timeouts and bulk wakes.
+
+#include "test_util.h"
+
+#include <cstdio>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const memory_name{ "/sasm_futex_semaphore_test" };
+
+  // Zero filled memory is a valid semaphore, so attaching by name needs no set up
+  sasm::Futex_Semaphore* attach(sasm::Shared_Memory& memory)
+  {
+    return memory.create(memory_name, sizeof(sasm::Futex_Semaphore)) ? static_cast<sasm::Futex_Semaphore*>(memory.get_address()) : nullptr;
+  }
+
+  // Runs body in a child process on the semaphore attached by name
+  template <typename Body>
+  pid_t spawn_attached(Body&& body)
+  {
+    return spawn([&body]
+    {
+      sasm::Futex_Semaphore* semaphore = attach(*new sasm::Shared_Memory);
+      return semaphore != nullptr && body(*semaphore);
+    });
+  }
+
+  void test_counts(sasm::Futex_Semaphore& semaphore)
+  {
+    check(!semaphore.try_wait(), "try_wait on an empty semaphore fails");
+    check(semaphore.increment(3), "increment(3)");
+    check(semaphore.get_count() == 3, "count is 3 after increment(3)");
+    check(semaphore.try_wait() && semaphore.try_wait() && semaphore.try_wait(), "three try_waits succeed");
+    check(!semaphore.try_wait(), "fourth try_wait fails");
+    check(!semaphore.increment(0) && !semaphore.increment(-1), "non-positive increments are rejected");
+  }
+
+  void test_timeout(sasm::Futex_Semaphore& semaphore)
+  {
+    auto start = std::chrono::steady_clock::now();
+    check(!semaphore.wait(0), "wait(0) on an empty semaphore fails");
+    check(!semaphore.wait(100), "wait(100) on an empty semaphore times out");
+    long long waited = elapsed_ms(start);
+    check(waited >= 99 && waited < 2000, "wait(100) takes about 100 ms");
+    check(semaphore.get_waiters() == 0, "a timed out waiter deregisters");
+  }
+
+  void test_cross_process(sasm::Futex_Semaphore& semaphore)
+  {
+    // Child blocks until the parent increments
+    pid_t child = spawn_attached([](sasm::Futex_Semaphore& shared)
+    {
+      return shared.wait(5000);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    semaphore.increment();
+    check(succeeded(child), "a child attached by name wakes on the parent's increment");
+
+    // And the other way around, many times
+    constexpr int rounds = 1000;
+
+    child = spawn_attached([](sasm::Futex_Semaphore& shared)
+    {
+      for (int i = 0; i < rounds; ++i)
+      {
+        shared.increment();
+      }
+
+      return true;
+    });
+
+    int acquired = 0;
+
+    while (acquired < rounds && semaphore.wait(5000))
+    {
+      ++acquired;
+    }
+
+    check(succeeded(child), "incrementing child exits cleanly");
+    check(acquired == rounds, "the parent acquires every count a child posted");
+    check(semaphore.get_count() == 0, "no count is left over");
+  }
+
+  void test_bulk_wake(sasm::Futex_Semaphore& semaphore)
+  {
+    constexpr int waiters = 4;
+    pid_t children[waiters];
+
+    for (pid_t& child : children)
+    {
+      child = spawn_attached([](sasm::Futex_Semaphore& shared)
+      {
+        return shared.wait(5000);
+      });
+    }
+
+    // Wait until every child is asleep, so the single increment has to wake them all
+    auto start = std::chrono::steady_clock::now();
+
+    while (semaphore.get_waiters() < waiters && elapsed_ms(start) < 5000)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    check(semaphore.get_waiters() == waiters, "every child registered as a waiter");
+    semaphore.increment(waiters);
+
+    bool all = true;
+
+    for (pid_t child : children)
+    {
+      all = succeeded(child) && all;
+    }
+
+    check(all, "one increment(n) releases n sleeping processes");
+    check(semaphore.get_count() == 0 && semaphore.get_waiters() == 0, "nothing is left after the bulk wake");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(memory_name);
+
+  sasm::Shared_Memory memory;
+  sasm::Futex_Semaphore* semaphore = attach(memory);
+
+  if (semaphore == nullptr)
+  {
+    std::printf("FAIL: could not create the shared memory segment\n");
+    return 1;
+  }
+
+  test_counts(*semaphore);
+  test_timeout(*semaphore);
+  test_cross_process(*semaphore);
+  test_bulk_wake(*semaphore);
+
+  return finish("futex_semaphore_test");
+}
@@ -0,0 +1,255 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Shared_Monotonic_Resource and Shared_Pool_Resource: aligned
+// allocations inside the segment, sizes and alignments so large that the bounds arithmetic
+// would wrap being refused, exhaustion, a forked child allocating from the same resource,
+// std::pmr containers on top, and refusing an attach smaller than the resource.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const monotonic_name{ "/sasm_memory_resource_test_monotonic" };
+  const char* const pool_name{ "/sasm_memory_resource_test_pool" };
+  constexpr std::size_t resource_size{ std::size_t{ 1 } << 20 };
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    std::uintptr_t address;
+  };
+
+  Control* control{ nullptr };
+
+  bool aligned(const void* pointer, std::size_t alignment)
+  {
+    return reinterpret_cast<std::uintptr_t>(pointer) % alignment == 0;
+  }
+
+  bool inside(const sasm::Shared_Memory& memory, const void* pointer, std::size_t bytes)
+  {
+    std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(memory.get_address());
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(pointer);
+    return address >= begin && address - begin <= memory.get_size() && bytes <= memory.get_size() - (address - begin);
+  }
+
+  // True if allocate() throws std::bad_alloc
+  bool refused(std::pmr::memory_resource& resource, std::size_t bytes, std::size_t alignment)
+  {
+    try
+    {
+      return resource.allocate(bytes, alignment) == nullptr;
+    }
+    catch (const std::bad_alloc&)
+    {
+      return true;
+    }
+
+  }
+
+  void test_monotonic_bounds(sasm::Shared_Monotonic_Resource& resource)
+  {
+    const sasm::Shared_Memory& memory = resource.get_shared_memory();
+    check(resource.get_capacity() == resource_size && resource.get_used() == 0, "a new monotonic resource is empty");
+
+    void* small = resource.allocate(100, 8);
+    void* page = resource.allocate(1, 4096);
+    check(small != nullptr && inside(memory, small, 100) && aligned(small, 8), "allocations land inside the segment");
+    check(page != nullptr && inside(memory, page, 1) && aligned(page, 4096), "and honour large alignments");
+
+    // Each of these wraps start + bytes or the alignment when computed naively
+    std::size_t used = resource.get_used();
+    check(refused(resource, SIZE_MAX, 8), "SIZE_MAX bytes are refused");
+    check(refused(resource, SIZE_MAX - 64, 1), "a size that wraps the bump offset is refused");
+    check(refused(resource, 16, std::size_t{ 1 } << 63), "an alignment past the segment is refused");
+    check(refused(resource, resource_size, 8), "more than is left is refused");
+    check(resource.get_used() == used, "refused allocations don't move the bump offset");
+
+    // Exactly what is left still fits, then nothing does
+    void* rest = resource.allocate(resource.get_capacity() - resource.get_used(), 1);
+    check(rest != nullptr && inside(memory, rest, resource.get_capacity() - used), "the exact remainder fits");
+    check(refused(resource, 1, 1), "an exhausted resource refuses even one byte");
+
+    resource.deallocate(small, 100, 8);
+    check(resource.get_used() == resource.get_capacity(), "deallocate() gives nothing back");
+    resource.reset();
+    check(resource.get_used() == 0 && resource.allocate(64, 64) != nullptr, "reset() starts over");
+    resource.reset();
+  }
+
+  void test_monotonic_across_processes(sasm::Shared_Monotonic_Resource& resource)
+  {
+    // The child uses the parent's resource object and mapping, inherited at the same address
+    pid_t child = spawn([&resource]
+    {
+      std::pmr::vector<std::uint64_t>* values = new std::pmr::vector<std::uint64_t>(&resource);
+
+      for (std::uint64_t i = 0; i < 1000; ++i)
+      {
+        values->push_back(i * 3);
+      }
+
+      control->address = reinterpret_cast<std::uintptr_t>(values->data());
+      return true;
+    });
+
+    check(succeeded(child), "a forked child fills a std::pmr::vector from the resource");
+
+    const std::uint64_t* values = reinterpret_cast<const std::uint64_t*>(control->address);
+    bool intact = values != nullptr && inside(resource.get_shared_memory(), values, 1000 * sizeof(std::uint64_t));
+
+    for (std::uint64_t i = 0; intact && i < 1000; ++i)
+    {
+      intact = values[i] == i * 3;
+    }
+
+    check(intact, "the parent reads the child's vector in the shared segment");
+    check(resource.get_used() >= 1000 * sizeof(std::uint64_t), "the child's allocations moved the shared bump offset");
+
+    void* next = resource.allocate(8, 8);
+    check(reinterpret_cast<std::uintptr_t>(next) >= control->address + 1000 * sizeof(std::uint64_t), "the parent allocates after the child's data");
+  }
+
+  void test_monotonic_attach()
+  {
+    // Neither may unlink the name, the attach after them checks it is still there
+    sasm::Shared_Monotonic_Resource smaller;
+    check(!smaller.create(monotonic_name, resource_size / 2), "attaching with a smaller size fails");
+    check(smaller.get_capacity() == 0 && refused(smaller, 8, 8), "the failed attach allocates nothing");
+
+    sasm::Shared_Monotonic_Resource growable;
+    check(!growable.create(monotonic_name, resource_size, sasm::Memory_Flags::growable), "a growable monotonic resource is refused");
+
+    pid_t child = spawn([]
+    {
+      sasm::Shared_Monotonic_Resource* same = new sasm::Shared_Monotonic_Resource(monotonic_name, resource_size);
+      return same->get_capacity() == resource_size && same->get_used() != 0;
+    });
+
+    check(succeeded(child), "an attach with the same size still finds the resource and its allocations");
+  }
+
+  void test_pool_bounds(sasm::Shared_Pool_Resource& resource)
+  {
+    const sasm::Shared_Memory& memory = resource.get_arena().get_shared_memory();
+
+    void* small = resource.allocate(100, 8);
+    void* wide = resource.allocate(100, 64);
+    void* page = resource.allocate(100, 4096);
+    check(small != nullptr && inside(memory, small, 100) && aligned(small, 8), "allocations land inside the segment");
+    check(wide != nullptr && inside(memory, wide, 100) && aligned(wide, 64), "over-aligned ones too");
+    check(page != nullptr && inside(memory, page, 100) && aligned(page, 4096), "even to a whole page");
+
+    // bytes + alignment used to wrap on the over-aligned path and hand out a tiny block
+    check(refused(resource, SIZE_MAX, 8), "SIZE_MAX bytes are refused");
+    check(refused(resource, SIZE_MAX - 16, 64), "an over-aligned size that wraps is refused");
+    check(refused(resource, SIZE_MAX - 8, 4096), "a page aligned size that wraps is refused");
+    check(refused(resource, resource_size * 2, 8), "more than the arena holds is refused");
+
+    resource.deallocate(small, 100, 8);
+    resource.deallocate(wide, 100, 64);
+    resource.deallocate(page, 100, 4096);
+
+    // Freed blocks go back to the arena, so a churn far larger than the arena keeps working
+    bool churned = true;
+
+    for (int round = 0; churned && round < 10000; ++round)
+    {
+      void* block = resource.allocate(4096, round % 2 == 0 ? 16 : 256);
+      churned = block != nullptr && inside(memory, block, 4096);
+      resource.deallocate(block, 4096, round % 2 == 0 ? 16 : 256);
+    }
+
+    check(churned, "deallocated blocks are reused");
+  }
+
+  void test_pool_across_processes(sasm::Shared_Pool_Resource& resource)
+  {
+    pid_t child = spawn([&resource]
+    {
+      std::pmr::vector<std::uint64_t>* values = new std::pmr::vector<std::uint64_t>(&resource);
+
+      for (std::uint64_t i = 0; i < 1000; ++i)
+      {
+        values->push_back(i * 7);
+      }
+
+      control->address = reinterpret_cast<std::uintptr_t>(values->data());
+      return true;
+    });
+
+    check(succeeded(child), "a forked child fills a std::pmr::vector from the pool");
+
+    std::uint64_t* values = reinterpret_cast<std::uint64_t*>(control->address);
+    bool intact = values != nullptr && inside(resource.get_arena().get_shared_memory(), values, 1000 * sizeof(std::uint64_t));
+
+    for (std::uint64_t i = 0; intact && i < 1000; ++i)
+    {
+      intact = values[i] == i * 7;
+    }
+
+    check(intact, "the parent reads the child's vector in the shared segment");
+
+    // The parent frees what the child allocated
+    resource.deallocate(values, 1024 * sizeof(std::uint64_t), alignof(std::uint64_t));
+    check(resource.allocate(64, 8) != nullptr, "the pool keeps working after freeing a child's block");
+  }
+
+  void test_pool_attach()
+  {
+    sasm::Shared_Pool_Resource smaller;
+    check(!smaller.create(pool_name, resource_size / 2), "attaching with a smaller size fails");
+    check(refused(smaller, 8, 8), "the failed attach allocates nothing");
+
+    pid_t child = spawn([]
+    {
+      sasm::Shared_Pool_Resource* same = new sasm::Shared_Pool_Resource(pool_name, resource_size);
+      return same->get_arena().get_shared_memory().get_address() != nullptr && same->allocate(8, 8) != nullptr;
+    });
+
+    check(succeeded(child), "an attach with the same size still finds the pool");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(monotonic_name);
+  shm_unlink(pool_name);
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+
+  sasm::Shared_Monotonic_Resource monotonic(monotonic_name, resource_size);
+  sasm::Shared_Pool_Resource pool(pool_name, resource_size);
+
+  if (monotonic.get_capacity() == 0 || pool.get_arena().get_shared_memory().get_address() == nullptr)
+  {
+    std::printf("FAIL: could not create the resources\n");
+    return 1;
+  }
+
+  test_monotonic_bounds(monotonic);
+  test_monotonic_across_processes(monotonic);
+  test_monotonic_attach();
+  test_pool_bounds(pool);
+  test_pool_across_processes(pool);
+  test_pool_attach();
+
+  return finish("memory_resource_test");
+}
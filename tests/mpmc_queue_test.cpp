@@ -0,0 +1,206 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Mpmc_Queue: capacity rounding, full and empty edges, refusing a
+// mismatched capacity or one whose queue would not fit a size_t, and several producer and
+// consumer processes moving a stream through it with nothing lost, duplicated or reordered per
+// producer.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const queue_name{ "/sasm_mpmc_queue_test" };
+  const char* const results_name{ "/sasm_mpmc_queue_test_results" };
+  constexpr std::size_t queue_capacity{ 5 }; // Rounded up to 8
+
+  constexpr std::uint64_t producers{ 3 };
+  constexpr std::uint64_t consumers{ 2 };
+  constexpr std::uint64_t per_producer{ 50000 };
+
+  // Producer in the top 16 bits, its sequence number below
+  constexpr std::uint64_t encode(std::uint64_t producer, std::uint64_t sequence)
+  {
+    return (producer << 48) | sequence;
+  }
+
+  struct Results
+  {
+    std::atomic<std::uint64_t> consumed;
+    std::atomic<std::uint64_t> sum;
+    std::atomic<std::uint64_t> out_of_order;
+  };
+
+  // Runs body in a child process on its own queue attached by name, which it never destroys
+  template <typename Body>
+  pid_t spawn_attached(Body&& body)
+  {
+    return spawn([&body]
+    {
+      sasm::Mpmc_Queue<std::uint64_t>* queue = new sasm::Mpmc_Queue<std::uint64_t>(queue_name, queue_capacity);
+      return queue->capacity() != 0 && body(*queue);
+    });
+  }
+
+  void test_edges(sasm::Mpmc_Queue<std::uint64_t>& queue)
+  {
+    std::uint64_t value = 0;
+
+    check(queue.capacity() == 8, "capacity rounds up to a power of two");
+    check(queue.empty() && !queue.try_pop(value), "popping an empty queue fails");
+
+    for (std::uint64_t i = 0; i < 8; ++i)
+    {
+      check(queue.try_push(i), "pushing up to capacity succeeds");
+    }
+
+    check(queue.size() == 8, "size reaches capacity");
+    check(!queue.try_push(99), "pushing a full queue fails");
+    check(queue.try_pop(value) && value == 0, "pop returns the oldest value");
+    check(queue.try_push(8), "one pop frees one slot");
+
+    for (std::uint64_t i = 1; i <= 8; ++i)
+    {
+      check(queue.try_pop(value) && value == i, "values come out in order across the wrap");
+    }
+
+    check(queue.empty(), "the queue is empty again");
+
+    sasm::Mpmc_Queue<std::uint64_t> tiny;
+    check(tiny.create("/sasm_mpmc_queue_test_tiny", 1) && tiny.capacity() == 2, "capacity is at least 2");
+  }
+
+  void test_mismatch()
+  {
+    // Neither may unlink or shrink the queue, test_cross_process() attaches to it by name afterwards
+    sasm::Mpmc_Queue<std::uint64_t> other;
+    check(!other.create(queue_name, 64), "attaching with a larger capacity fails");
+    check(!other.create(queue_name, 2), "attaching with a smaller capacity fails");
+  }
+
+  void test_overflow()
+  {
+    // Capacities whose queue would not fit a size_t, none may leave an object behind
+    const char* const name = "/sasm_mpmc_queue_test_overflow";
+    sasm::Mpmc_Queue<std::uint64_t> huge;
+    check(!huge.create(name, SIZE_MAX), "a capacity with no power of two above it fails");
+    check(!huge.create(name, SIZE_MAX / 2 + 1), "a capacity whose cells wrap a size_t fails");
+    check(!huge.create(name, SIZE_MAX / sizeof(std::uint64_t)), "a capacity that rounds up into a wrap fails");
+    check(shm_open(name, O_RDONLY, 0) == -1, "the failed creates leave nothing behind");
+  }
+
+  void test_cross_process(Results* results)
+  {
+    pid_t children[producers + consumers];
+
+    for (std::uint64_t producer = 0; producer < producers; ++producer)
+    {
+      children[producer] = spawn_attached([producer](sasm::Mpmc_Queue<std::uint64_t>& shared)
+      {
+        for (std::uint64_t i = 0; i < per_producer;)
+        {
+          if (shared.try_push(encode(producer, i)))
+          {
+            ++i;
+          }
+          else
+          {
+            std::this_thread::yield();
+          }
+        }
+
+        return true;
+      });
+    }
+
+    // Consumers share the results through the parent's mapping, inherited across fork()
+    for (std::uint64_t consumer = 0; consumer < consumers; ++consumer)
+    {
+      children[producers + consumer] = spawn_attached([results](sasm::Mpmc_Queue<std::uint64_t>& shared)
+      {
+        std::uint64_t next[producers] = {};
+
+        while (results->consumed.load(std::memory_order_relaxed) < producers * per_producer)
+        {
+          std::uint64_t value;
+
+          if (!shared.try_pop(value))
+          {
+            std::this_thread::yield();
+            continue;
+          }
+
+          std::uint64_t producer = value >> 48;
+          std::uint64_t sequence = value & ((std::uint64_t{ 1 } << 48) - 1);
+
+          // Values of one producer may skip ahead (the other consumer took some), never go back
+          if (producer >= producers || sequence < next[producer])
+          {
+            results->out_of_order.fetch_add(1);
+          }
+          else
+          {
+            next[producer] = sequence + 1;
+          }
+
+          results->sum.fetch_add(value);
+          results->consumed.fetch_add(1);
+        }
+
+        return true;
+      });
+    }
+
+    bool all = true;
+
+    for (pid_t child : children)
+    {
+      all = succeeded(child) && all;
+    }
+
+    std::uint64_t expected_sum = 0;
+
+    for (std::uint64_t producer = 0; producer < producers; ++producer)
+    {
+      for (std::uint64_t i = 0; i < per_producer; ++i)
+      {
+        expected_sum += encode(producer, i);
+      }
+    }
+
+    check(all, "every producer and consumer exits cleanly");
+    check(results->consumed.load() == producers * per_producer, "every value is consumed exactly once");
+    check(results->sum.load() == expected_sum, "the consumed values are the produced ones");
+    check(results->out_of_order.load() == 0, "each producer's values arrive in order");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(queue_name);
+  shm_unlink(results_name);
+
+  sasm::Mpmc_Queue<std::uint64_t> queue(queue_name, queue_capacity);
+  sasm::Shared_Memory results_memory(results_name, sizeof(Results));
+
+  if (queue.capacity() == 0 || results_memory.get_address() == nullptr)
+  {
+    std::printf("FAIL: could not create the queue\n");
+    return 1;
+  }
+
+  test_edges(queue);
+  test_mismatch();
+  test_overflow();
+  test_cross_process(new (results_memory.get_address()) Results{});
+
+  return finish("mpmc_queue_test");
+}
@@ -0,0 +1,293 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for the C++20 coroutine Reactor: awaiting an available count
+// without suspending, waiters resumed in FIFO order by increments from another process, waits
+// through a Semaphore opened by name, timeouts, more words than one futex_waitv() call watches,
+// and post() / stop() from another thread. Needs C++20, `make check` builds it with -std=c++20.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifndef __cpp_impl_coroutine
+#error "reactor_test.cpp needs C++20 coroutines"
+#endif
+
+using namespace sasm_test;
+
+namespace
+{
+  // More than the 127 words one futex_waitv() call watches next to the control word
+  constexpr std::size_t word_count{ 150 };
+  const char* const semaphore_name{ "/sasm_reactor_test" };
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    sasm::Futex_Semaphore semaphores[word_count];
+  };
+
+  Control* control{ nullptr };
+
+  // Only touched on the thread running the reactor
+  struct Progress
+  {
+    std::size_t target{ 0 };
+    std::size_t finished{ 0 };
+    std::size_t acquired{ 0 };
+    std::vector<int> order;
+  };
+
+  // Awaits one count, records the outcome and stops the reactor once target waiters are done
+  sasm::Reactor::Task await_count(sasm::Reactor& reactor, sasm::Reactor::Wait_Awaiter awaiter, Progress& progress, int id)
+  {
+    // Not `if (co_await awaiter)`, which g++ 12 miscompiles
+    bool acquired = co_await awaiter;
+
+    if (acquired)
+    {
+      ++progress.acquired;
+      progress.order.push_back(id);
+    }
+
+    if (++progress.finished == progress.target)
+    {
+      reactor.stop();
+    }
+  }
+
+  // Runs the reactor on this thread until stop(). A watchdog stops it after 10 s, so a lost wake
+  // fails the test instead of hanging it.
+  void run_guarded(sasm::Reactor& reactor)
+  {
+    std::atomic<bool> returned{ false };
+
+    std::thread watchdog([&reactor, &returned]
+    {
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+      while (!returned.load() && std::chrono::steady_clock::now() < deadline)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      if (!returned.load())
+      {
+        reactor.stop();
+      }
+    });
+
+    reactor.run();
+    returned.store(true);
+    watchdog.join();
+  }
+
+  // Forks a child that sleeps a little, then increments semaphores [first, last) one at a time
+  pid_t spawn_incrementer(std::size_t first, std::size_t last, unsigned int pause_ms)
+  {
+    return spawn([first, last, pause_ms]
+    {
+      bool incremented = true;
+
+      for (std::size_t i = first; i < last; ++i)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(pause_ms));
+        incremented = control->semaphores[i].increment() && incremented;
+      }
+
+      return incremented;
+    });
+  }
+
+  void test_immediate(sasm::Reactor& reactor)
+  {
+    Progress progress; // No target, nothing here runs the reactor
+    sasm::Futex_Semaphore& semaphore = control->semaphores[0];
+    semaphore.increment();
+
+    // Coroutines start eagerly, none of these suspends
+    await_count(reactor, reactor.async_wait(semaphore), progress, 0);
+    check(progress.finished == 1 && progress.acquired == 1, "an available count is taken without suspending");
+    check(semaphore.get_count() == 0 && semaphore.get_waiters() == 0, "and without registering as a waiter");
+
+    await_count(reactor, reactor.async_wait(semaphore, 0), progress, 1);
+    check(progress.finished == 2 && progress.acquired == 1, "a zero timeout on an empty count fails without suspending");
+
+    sasm::Semaphore empty;
+    await_count(reactor, reactor.async_wait(empty), progress, 2);
+    check(progress.finished == 3 && progress.acquired == 1, "an empty Semaphore fails without suspending");
+  }
+
+  void test_resumed_from_another_process(sasm::Reactor& reactor)
+  {
+    Progress progress;
+    progress.target = 3;
+    sasm::Futex_Semaphore& semaphore = control->semaphores[1];
+
+    // Three waiters on one word, the child hands out one count at a time
+    for (int id = 0; id < 3; ++id)
+    {
+      await_count(reactor, reactor.async_wait(semaphore, 10000), progress, id);
+    }
+
+    check(progress.finished == 0 && semaphore.get_waiters() == 1, "waiters on an empty count suspend, registered once per word");
+
+    pid_t child = spawn_incrementer(1, 2, 50);
+    pid_t second = spawn([]
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(150));
+      return control->semaphores[1].increment(2);
+    });
+
+    run_guarded(reactor);
+    check(succeeded(child) && succeeded(second), "the incrementing children exit");
+    check(progress.acquired == 3, "increments from another process resume every waiter");
+    check(progress.order == std::vector<int>({ 0, 1, 2 }), "waiters on one word resume in FIFO order");
+    check(semaphore.get_count() == 0 && semaphore.get_waiters() == 0, "each took one count and the word is no longer watched");
+  }
+
+  void test_semaphore(sasm::Reactor& reactor)
+  {
+    Progress progress;
+    progress.target = 1;
+    sasm::Semaphore semaphore(semaphore_name);
+    await_count(reactor, reactor.async_wait(semaphore, 10000), progress, 0);
+
+    pid_t child = spawn([]
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      sasm::Semaphore* shared = new sasm::Semaphore(semaphore_name);
+      return shared->get_object() != nullptr && shared->increment();
+    });
+
+    run_guarded(reactor);
+    check(succeeded(child), "the child opened the Semaphore by name");
+    check(progress.acquired == 1, "a Semaphore incremented from another process resumes its waiter");
+  }
+
+  void test_timeout(sasm::Reactor& reactor)
+  {
+    Progress progress;
+    progress.target = 2;
+    sasm::Futex_Semaphore& semaphore = control->semaphores[2];
+
+    auto start = std::chrono::steady_clock::now();
+    await_count(reactor, reactor.async_wait(semaphore, 100), progress, 0);
+    await_count(reactor, reactor.async_wait(semaphore, 200), progress, 1);
+    run_guarded(reactor);
+    long long waited = elapsed_ms(start);
+
+    check(progress.finished == 2 && progress.acquired == 0, "waits nobody increments time out");
+    check(waited >= 199 && waited < 2000, "the later timeout takes about 200 ms");
+    check(semaphore.get_waiters() == 0, "timed out waiters deregister");
+  }
+
+  void test_many_words(sasm::Reactor& reactor)
+  {
+    Progress progress;
+    progress.target = word_count;
+
+    for (std::size_t i = 0; i < word_count; ++i)
+    {
+      await_count(reactor, reactor.async_wait(control->semaphores[i], 10000), progress, static_cast<int>(i));
+    }
+
+    // The child starts with the words past the first 127
+    pid_t late = spawn_incrementer(word_count - 20, word_count, 0);
+    pid_t early = spawn([]
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      bool incremented = true;
+
+      for (std::size_t i = 0; i < word_count - 20; ++i)
+      {
+        incremented = control->semaphores[i].increment() && incremented;
+      }
+
+      return incremented;
+    });
+
+    run_guarded(reactor);
+    check(succeeded(late) && succeeded(early), "the incrementing children exit");
+    check(progress.acquired == word_count, "waits on 150 words all resume");
+  }
+
+  void test_post_and_stop(sasm::Reactor& reactor)
+  {
+    bool ran = false;
+    std::thread::id ran_on;
+
+    // post() from another thread runs on the reactor thread and pulls run() out of its sleep
+    std::thread poster([&reactor, &ran, &ran_on]
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+      reactor.post([&reactor, &ran, &ran_on]
+      {
+        ran = true;
+        ran_on = std::this_thread::get_id();
+        reactor.stop();
+      });
+    });
+
+    run_guarded(reactor);
+    poster.join();
+    check(ran && ran_on == std::this_thread::get_id(), "a posted function runs on the thread calling run()");
+
+    // stop() alone from another thread ends an idle run()
+    std::thread stopper([&reactor]
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      reactor.stop();
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    run_guarded(reactor);
+    stopper.join();
+    check(elapsed_ms(start) < 5000, "stop() from another thread ends run()");
+
+    // A coroutine started through post() suspends and resumes on the reactor thread
+    Progress progress;
+    progress.target = 1;
+    sasm::Futex_Semaphore& semaphore = control->semaphores[3];
+
+    reactor.post([&reactor, &progress, &semaphore]
+    {
+      await_count(reactor, reactor.async_wait(semaphore, 10000), progress, 0);
+    });
+
+    pid_t child = spawn_incrementer(3, 4, 50);
+    run_guarded(reactor);
+    check(succeeded(child) && progress.acquired == 1, "a coroutine started with post() resumes on an increment");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink((std::string(semaphore_name) + ".sem").c_str());
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+  sasm::Reactor reactor;
+
+  test_immediate(reactor);
+  test_resumed_from_another_process(reactor);
+  test_semaphore(reactor);
+  test_timeout(reactor);
+  test_many_words(reactor);
+  test_post_and_stop(reactor);
+
+  return finish("reactor_test");
+}
@@ -0,0 +1,229 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Robust_Mutex: busy and timed out results against a holder in
+// another process, mutual exclusion between processes, a holder killed with the lock handing
+// owner_died to the next locker, recovery through make_consistent(), not_recoverable when the
+// repair is skipped, and zero filled memory being a valid unlocked mutex.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+
+using namespace sasm_test;
+
+namespace
+{
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    sasm::Robust_Mutex mutex;
+    sasm::Robust_Mutex skipped; // Left not_recoverable on purpose
+    std::atomic<std::uint32_t> locked;
+    std::atomic<std::uint32_t> release;
+    std::uint64_t counter;      // Only touched under mutex
+  };
+
+  Control* control{ nullptr };
+
+  void reset_control()
+  {
+    control->locked.store(0);
+    control->release.store(0);
+  }
+
+  void test_basics()
+  {
+    sasm::Robust_Mutex& mutex = control->mutex;
+    check(mutex.try_lock() == sasm::Lock_Status::acquired, "try_lock() takes a free mutex");
+    mutex.unlock();
+    check(mutex.lock(0) == sasm::Lock_Status::acquired, "lock(0) takes a free mutex");
+    mutex.unlock();
+    check(mutex.lock() == sasm::Lock_Status::acquired, "lock() takes a free mutex");
+    mutex.unlock();
+  }
+
+  void test_held_elsewhere()
+  {
+    reset_control();
+
+    pid_t child = spawn([]
+    {
+      bool locked = control->mutex.lock() == sasm::Lock_Status::acquired;
+      control->locked.store(1);
+      bool released = wait_until(control->release, 1);
+      control->mutex.unlock();
+      return locked && released;
+    });
+
+    check(wait_until(control->locked, 1), "the child took the mutex");
+    check(control->mutex.try_lock() == sasm::Lock_Status::busy, "try_lock() reports busy while another process holds it");
+    check(control->mutex.lock(0) == sasm::Lock_Status::timed_out, "lock(0) times out while another process holds it");
+
+    auto start = std::chrono::steady_clock::now();
+    check(control->mutex.lock(100) == sasm::Lock_Status::timed_out, "lock(100) times out while another process holds it");
+    long long waited = elapsed_ms(start);
+    check(waited >= 99 && waited < 2000, "the timeout takes about 100 ms");
+
+    control->release.store(1);
+    check(succeeded(child), "the holder unlocks and exits");
+    check(control->mutex.lock(1000) == sasm::Lock_Status::acquired, "the mutex is free after the holder unlocked");
+    control->mutex.unlock();
+  }
+
+  void test_mutual_exclusion()
+  {
+    constexpr int children = 4;
+    constexpr std::uint64_t rounds = 20000;
+    control->counter = 0;
+    pid_t pids[children];
+
+    // A plain read-modify-write with a yield in between loses increments unless the lock holds
+    for (pid_t& pid : pids)
+    {
+      pid = spawn([]
+      {
+        for (std::uint64_t round = 0; round < rounds; ++round)
+        {
+          if (control->mutex.lock() != sasm::Lock_Status::acquired)
+          {
+            return false;
+          }
+
+          std::uint64_t value = control->counter;
+
+          if (round % 64 == 0)
+          {
+            std::this_thread::yield();
+          }
+
+          control->counter = value + 1;
+          control->mutex.unlock();
+        }
+
+        return true;
+      });
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all, "every child finishes");
+    check(control->counter == children * rounds, "no increment is lost between processes");
+  }
+
+  // Forks a child that takes mutex and gets killed holding it
+  void kill_holder(sasm::Robust_Mutex& mutex)
+  {
+    reset_control();
+
+    pid_t child = spawn([&mutex]
+    {
+      mutex.lock();
+      control->locked.store(1);
+
+      for (;;)
+      {
+        pause();
+      }
+
+      return true;
+    });
+
+    check(wait_until(control->locked, 1), "the doomed holder took the mutex");
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+  }
+
+  void test_owner_died()
+  {
+    kill_holder(control->mutex);
+    check(control->mutex.lock(1000) == sasm::Lock_Status::owner_died, "the next locker after a killed holder gets owner_died");
+    check(control->mutex.make_consistent(), "make_consistent() repairs it");
+    control->mutex.unlock();
+
+    // A child repairs it this time, so the result crosses processes too
+    kill_holder(control->mutex);
+
+    pid_t child = spawn([]
+    {
+      if (control->mutex.try_lock() != sasm::Lock_Status::owner_died || !control->mutex.make_consistent())
+      {
+        return false;
+      }
+
+      control->mutex.unlock();
+      return true;
+    });
+
+    check(succeeded(child), "try_lock() in another process reports owner_died too");
+    check(control->mutex.try_lock() == sasm::Lock_Status::acquired, "a repaired mutex is acquired normally");
+    control->mutex.unlock();
+  }
+
+  void test_not_recoverable()
+  {
+    kill_holder(control->skipped);
+    check(control->skipped.lock(1000) == sasm::Lock_Status::owner_died, "the skipped mutex reports owner_died");
+    control->skipped.unlock();
+
+    pid_t child = spawn([]
+    {
+      return control->skipped.try_lock() == sasm::Lock_Status::not_recoverable &&
+        control->skipped.lock(100) == sasm::Lock_Status::not_recoverable;
+    });
+
+    check(succeeded(child), "unlocking without make_consistent() leaves it not_recoverable for everyone");
+  }
+
+  void test_zero_filled()
+  {
+    // No constructor ran, the first locker initializes it
+    sasm::Robust_Mutex* mutex = static_cast<sasm::Robust_Mutex*>(shared_mapping(sizeof(sasm::Robust_Mutex)));
+    check(mutex != nullptr, "the zero filled mapping exists");
+
+    pid_t child = spawn([mutex]
+    {
+      if (mutex->lock(1000) != sasm::Lock_Status::acquired)
+      {
+        return false;
+      }
+
+      mutex->unlock();
+      return true;
+    });
+
+    check(succeeded(child), "a child initializes and takes a zero filled mutex");
+    check(mutex->try_lock() == sasm::Lock_Status::acquired, "the parent takes it after the child");
+    mutex->unlock();
+  }
+}
+
+int main()
+{
+  begin();
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+
+  test_basics();
+  test_held_elsewhere();
+  test_mutual_exclusion();
+  test_owner_died();
+  test_not_recoverable();
+  test_zero_filled();
+
+  return finish("robust_mutex_test");
+}
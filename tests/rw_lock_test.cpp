@@ -0,0 +1,219 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Shared_Rw_Lock: readers in several processes holding it at
+// once, try_lock() / try_lock_shared() against holders in another process, a writer waiting
+// for readers to drain and holding new readers back meanwhile, and readers in some processes
+// never seeing a half done update from writers in others.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+
+using namespace sasm_test;
+
+namespace
+{
+  // Few slots, so readers in different processes share them as well
+  using Lock = sasm::Shared_Rw_Lock<4>;
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    Lock lock;
+    std::atomic<std::uint32_t> readers;
+    std::atomic<std::uint32_t> release;
+    std::atomic<std::uint32_t> writer_done;
+    std::uint64_t first;  // Writers keep both equal, only under the lock
+    std::uint64_t second;
+  };
+
+  Control* control{ nullptr };
+
+  void reset_control()
+  {
+    control->readers.store(0);
+    control->release.store(0);
+    control->writer_done.store(0);
+  }
+
+  void test_shared_readers()
+  {
+    reset_control();
+    constexpr std::uint32_t readers = 6;
+    pid_t pids[readers];
+
+    // Every reader holds the lock until all of them are inside at once
+    for (std::uint32_t i = 0; i < readers; ++i)
+    {
+      pids[i] = spawn([]
+      {
+        Lock::Ticket ticket = control->lock.lock_shared();
+        control->readers.fetch_add(1);
+        bool together = wait_until(control->readers, readers);
+        bool released = wait_until(control->release, 1);
+        control->lock.unlock_shared(ticket);
+        return together && released;
+      });
+    }
+
+    check(wait_until(control->readers, readers), "readers in several processes hold the lock together");
+    check(!control->lock.try_lock(), "try_lock() fails while readers hold it");
+
+    Lock::Ticket ticket = 1;
+    check(control->lock.try_lock_shared(ticket), "try_lock_shared() joins the readers");
+    control->lock.unlock_shared(ticket);
+
+    control->release.store(1);
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all, "every reader leaves cleanly");
+    check(control->lock.try_lock(), "try_lock() succeeds once the readers left");
+    control->lock.unlock();
+  }
+
+  void test_writer_held_elsewhere()
+  {
+    reset_control();
+
+    pid_t child = spawn([]
+    {
+      control->lock.lock();
+      control->readers.store(1);
+      bool released = wait_until(control->release, 1);
+      control->lock.unlock();
+      return released;
+    });
+
+    check(wait_until(control->readers, 1), "the child took the write lock");
+
+    Lock::Ticket ticket = 0;
+    check(!control->lock.try_lock_shared(ticket), "try_lock_shared() fails while another process writes");
+    check(!control->lock.try_lock(), "try_lock() fails while another process writes");
+
+    control->release.store(1);
+    check(succeeded(child), "the writer unlocks and exits");
+
+    ticket = control->lock.lock_shared();
+    control->lock.unlock_shared(ticket);
+  }
+
+  void test_writer_drains_readers()
+  {
+    reset_control();
+    Lock::Ticket ticket = control->lock.lock_shared();
+
+    // The writer has to wait for the parent's read lock
+    pid_t writer = spawn([]
+    {
+      control->readers.store(1);
+      control->lock.lock();
+      control->writer_done.store(1);
+      control->lock.unlock();
+      return true;
+    });
+
+    check(wait_until(control->readers, 1), "the writer started");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    check(control->writer_done.load() == 0, "the writer waits for the reader to leave");
+
+    Lock::Ticket other = ticket + 1;
+    check(!control->lock.try_lock_shared(other), "new readers back off while a writer waits");
+
+    control->lock.unlock_shared(ticket);
+    check(succeeded(writer) && control->writer_done.load() == 1, "the writer gets in once the reader left");
+  }
+
+  void test_consistency()
+  {
+    constexpr int writers = 2;
+    constexpr int readers = 3;
+    control->first = 0;
+    control->second = 0;
+    pid_t pids[writers + readers];
+
+    for (int i = 0; i < writers; ++i)
+    {
+      pids[i] = spawn([]
+      {
+        for (int round = 0; round < 20000; ++round)
+        {
+          control->lock.lock();
+          ++control->first;
+
+          if (round % 64 == 0)
+          {
+            std::this_thread::yield();
+          }
+
+          ++control->second;
+          control->lock.unlock();
+        }
+
+        return true;
+      });
+    }
+
+    for (int i = 0; i < readers; ++i)
+    {
+      pids[writers + i] = spawn([]
+      {
+        bool consistent = true;
+
+        for (int round = 0; round < 20000; ++round)
+        {
+          Lock::Ticket ticket = control->lock.lock_shared();
+          std::uint64_t first = control->first;
+
+          if (round % 64 == 0)
+          {
+            std::this_thread::yield();
+          }
+
+          consistent = consistent && control->second == first;
+          control->lock.unlock_shared(ticket);
+        }
+
+        return consistent;
+      });
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all, "readers never see a half done update");
+    check(control->first == writers * 20000 && control->second == control->first, "no update is lost between writers");
+  }
+}
+
+int main()
+{
+  begin();
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+
+  test_shared_readers();
+  test_writer_held_elsewhere();
+  test_writer_drains_readers();
+  test_consistency();
+
+  return finish("rw_lock_test");
+}
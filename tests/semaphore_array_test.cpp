@@ -0,0 +1,135 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Semaphore_Array: the initial count reaching every slot, slots
+// staying independent, handles working from a process that attached by name, out of range
+// indexes, timeouts, and refusing a mismatched size.
+
+#include "test_util.h"
+
+#include <cstdio>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const array_name{ "/sasm_semaphore_array_test" };
+  constexpr std::size_t array_size{ 64 };
+
+  // Runs body in a child process on its own array attached by name, which it never destroys
+  template <typename Body>
+  pid_t spawn_attached(Body&& body)
+  {
+    return spawn([&body]
+    {
+      sasm::Semaphore_Array* array = new sasm::Semaphore_Array(array_name, array_size);
+      return array->size() != 0 && body(*array);
+    });
+  }
+
+  void test_slots(sasm::Semaphore_Array& array)
+  {
+    bool initial = true;
+
+    for (std::size_t i = 0; i < array_size; ++i)
+    {
+      initial = initial && array[i].get_index() == i && array[i].get_count() == 1;
+    }
+
+    check(array.size() == array_size, "the array has the requested size");
+    check(initial, "every slot starts at the initial count");
+    check(!array.get(array_size) && !array[array_size].try_wait(), "an out of range index gives an empty handle");
+
+    // Draining one slot leaves its neighbours alone
+    check(array[5].try_wait() && !array[5].try_wait(), "a slot holds exactly its count");
+    check(array[4].get_count() == 1 && array[6].get_count() == 1, "neighbouring slots are independent");
+    check(array[5].increment(3) && array[5].get_count() == 3, "increment(3) adds three");
+
+    while (array[5].try_wait())
+    {
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    check(!array[5].wait(100), "waiting on an empty slot times out");
+    long long waited = elapsed_ms(start);
+    check(waited >= 99 && waited < 2000, "the timeout takes about 100 ms");
+  }
+
+  void test_across_processes(sasm::Semaphore_Array& array)
+  {
+    // Each child waits on its own slot, the parent wakes them in reverse order
+    constexpr std::size_t children = 8;
+    pid_t pids[children];
+
+    for (std::size_t i = 0; i < children; ++i)
+    {
+      while (array[10 + i].try_wait())
+      {
+      }
+
+      pids[i] = spawn_attached([i](sasm::Semaphore_Array& shared)
+      {
+        // Answer on the slot next to the one waited on
+        return shared[10 + i].wait(5000) && shared[30 + i].increment();
+      });
+    }
+
+    for (std::size_t i = children; i-- > 0;)
+    {
+      array[10 + i].increment();
+    }
+
+    bool answered = true;
+
+    for (std::size_t i = 0; i < children; ++i)
+    {
+      answered = array[30 + i].wait(5000) && answered;
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all && answered, "children attached by name wait and post on individual slots");
+  }
+
+  void test_mismatch()
+  {
+    // Neither may unlink or shrink the array, a child attaches to it right after
+    sasm::Semaphore_Array other;
+    check(!other.create(array_name, array_size * 2), "attaching with a larger size fails");
+    check(!other.create(array_name, array_size / 2), "attaching with a smaller size fails");
+
+    pid_t child = spawn_attached([](sasm::Semaphore_Array& shared)
+    {
+      return shared[0].get_count() == 1;
+    });
+
+    check(succeeded(child), "the array is intact after the failed attaches");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(array_name);
+
+  sasm::Semaphore_Array array(array_name, array_size, 1);
+
+  if (array.size() == 0)
+  {
+    std::printf("FAIL: could not create the array\n");
+    return 1;
+  }
+
+  test_slots(array);
+  test_across_processes(array);
+  test_mismatch();
+
+  return finish("semaphore_array_test");
+}
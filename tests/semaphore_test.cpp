@@ -0,0 +1,269 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for the named Semaphore on Linux: only the creator applies the
+// initial count, wait policies and the statistics they keep, increment(count) releases that
+// many sleeping processes at once, release_all() wakes exactly the sleepers, closing a handle
+// doesn't release anyone, and moves leave the source closed.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+#include <utility>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const semaphore_name{ "/sasm_semaphore_test" };
+
+  // Runs body in a child process on its own Semaphore opened by name, which it never destroys
+  template <typename Body>
+  pid_t spawn_attached(Body&& body, int initial_count = 0)
+  {
+    return spawn([&]
+    {
+      sasm::Semaphore* semaphore = new sasm::Semaphore(semaphore_name, initial_count);
+      return semaphore->get_object() != nullptr && body(*semaphore);
+    });
+  }
+
+  bool wait_for_waiters(const sasm::Semaphore& semaphore, std::uint32_t count)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    while (semaphore.get_object()->get_waiters() < count && elapsed_ms(start) < 5000)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return semaphore.get_object()->get_waiters() == count;
+  }
+
+  void test_initial_count(sasm::Semaphore& semaphore)
+  {
+    // The parent created it with 2, a child asking for 5 attaches to the existing count
+    pid_t child = spawn_attached([](sasm::Semaphore& shared)
+    {
+      return shared.wait(0) && shared.wait(0) && !shared.wait(0);
+    }, 5);
+
+    check(succeeded(child), "an attaching process doesn't apply its initial count");
+    check(!semaphore.wait(0), "the child took both initial counts");
+  }
+
+  void test_timeout(sasm::Semaphore& semaphore)
+  {
+    auto start = std::chrono::steady_clock::now();
+    check(!semaphore.wait(100), "wait(100) on an empty semaphore times out");
+    long long waited = elapsed_ms(start);
+    check(waited >= 99 && waited < 2000, "wait(100) takes about 100 ms");
+
+    // Spinning counts against the timeout too
+    semaphore.set_wait_policy(sasm::Wait_Policy::spin_yield_block);
+    start = std::chrono::steady_clock::now();
+    check(!semaphore.wait(100), "spinning wait(100) times out");
+    waited = elapsed_ms(start);
+    check(waited >= 99 && waited < 2000, "spinning wait(100) takes about 100 ms");
+    semaphore.set_wait_policy(sasm::Wait_Policy::block);
+  }
+
+  bool stats_are(const sasm::Semaphore& semaphore, std::uint64_t immediate, std::uint64_t spun, std::uint64_t blocked)
+  {
+    sasm::Wait_Stats stats = semaphore.get_wait_stats();
+    return stats.immediate == immediate && stats.spun == spun && stats.blocked == blocked;
+  }
+
+  void test_wait_stats(sasm::Semaphore& semaphore)
+  {
+    semaphore.reset_wait_stats();
+    check(stats_are(semaphore, 0, 0, 0), "reset_wait_stats() clears every counter");
+    check(semaphore.get_wait_policy() == sasm::Wait_Policy::block, "block is the default policy");
+
+    // Available counts are immediate, waits that fail are blocked ones (timeouts included)
+    semaphore.increment(3);
+    bool taken = semaphore.wait(0) && semaphore.wait(100) && semaphore.wait();
+    bool failed = !semaphore.wait(0) && !semaphore.wait(10);
+    check(taken && failed, "three counts are taken, then waits fail");
+    check(stats_are(semaphore, 3, 0, 2), "block counts three immediate and two blocked waits");
+
+    // Spinning without a count to find ends up blocked, a zero timeout never spins
+    semaphore.set_wait_policy(sasm::Wait_Policy::spin, 1000);
+    check(semaphore.get_wait_policy() == sasm::Wait_Policy::spin, "set_wait_policy() switches to spin");
+    failed = !semaphore.wait(10) && !semaphore.wait(0);
+    check(failed && stats_are(semaphore, 3, 0, 4), "fruitless spins count as blocked");
+
+    // A count arriving from another process during a long spin is a spun wait
+    std::atomic<std::uint32_t>* started = shared_block<std::atomic<std::uint32_t>>();
+    check(started != nullptr, "the start flag exists");
+
+    pid_t child = spawn_attached([started](sasm::Semaphore& shared)
+    {
+      bool go = wait_until(*started, 1);
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      return go && shared.increment();
+    });
+
+    // Far more spins than 20 ms take, the child's increment lands while spinning
+    semaphore.set_wait_policy(sasm::Wait_Policy::spin, 1u << 31);
+    started->store(1);
+    check(semaphore.wait(5000), "a spinning wait gets the child's count");
+    check(succeeded(child), "the child incremented");
+    check(stats_are(semaphore, 3, 1, 4), "a count taken while spinning counts as spun");
+
+    semaphore.set_wait_policy(sasm::Wait_Policy::spin_yield_block, 100);
+    failed = !semaphore.wait(10);
+    semaphore.set_wait_policy(sasm::Wait_Policy::adaptive);
+    semaphore.increment();
+    taken = semaphore.wait(10);
+    failed = !semaphore.wait(10) && failed;
+    check(taken && failed, "spin_yield_block and adaptive wait and time out");
+
+    // Every wait() lands in exactly one counter
+    sasm::Wait_Stats stats = semaphore.get_wait_stats();
+    check(stats.immediate + stats.spun + stats.blocked == 11, "the counters add up to the number of waits");
+    check(stats.immediate == 4 && stats.spun == 1 && stats.blocked == 6, "and each wait landed in the right one");
+
+    semaphore.set_wait_policy(sasm::Wait_Policy::block);
+    semaphore.reset_wait_stats();
+    check(stats_are(semaphore, 0, 0, 0), "reset_wait_stats() starts over");
+  }
+
+  void test_bulk_increment(sasm::Semaphore& semaphore)
+  {
+    constexpr int waiters = 4;
+    pid_t children[waiters];
+
+    for (pid_t& child : children)
+    {
+      child = spawn_attached([](sasm::Semaphore& shared)
+      {
+        return shared.wait(5000);
+      });
+    }
+
+    check(wait_for_waiters(semaphore, waiters), "every child is asleep on the semaphore");
+    check(semaphore.increment(waiters), "increment(n)");
+
+    bool all = true;
+
+    for (pid_t child : children)
+    {
+      all = succeeded(child) && all;
+    }
+
+    check(all, "one increment(n) releases n sleeping processes");
+    check(!semaphore.wait(0), "no count is left over");
+  }
+
+  void test_release_all(sasm::Semaphore& semaphore)
+  {
+    check(semaphore.release_all() && !semaphore.wait(0), "release_all() without sleepers adds nothing");
+
+    constexpr int waiters = 3;
+    pid_t children[waiters];
+
+    for (pid_t& child : children)
+    {
+      child = spawn_attached([](sasm::Semaphore& shared)
+      {
+        return shared.wait(5000);
+      });
+    }
+
+    check(wait_for_waiters(semaphore, waiters), "every child is asleep on the semaphore");
+    check(semaphore.release_all(), "release_all()");
+
+    bool all = true;
+
+    for (pid_t child : children)
+    {
+      all = succeeded(child) && all;
+    }
+
+    check(all, "release_all() releases every sleeping process");
+    check(!semaphore.wait(0), "and leaves no count behind");
+
+    sasm::Semaphore empty;
+    check(!empty.release_all(), "release_all() on an empty Semaphore fails");
+  }
+
+  void test_peer_close(sasm::Semaphore& semaphore)
+  {
+    pid_t child = spawn_attached([](sasm::Semaphore& shared)
+    {
+      // Nobody increments, so this must run into its timeout
+      return !shared.wait(300);
+    });
+
+    check(wait_for_waiters(semaphore, 1), "the child is asleep on the semaphore");
+
+    // Another handle on the same name going away must not hand out counts
+    sasm::Semaphore peer(semaphore_name);
+    peer.close();
+
+    check(succeeded(child), "closing a peer handle doesn't release a waiter");
+    check(!semaphore.wait(0), "closing a peer handle doesn't add counts");
+
+    // close() unlinked the name, bring it back for the tests that follow. Not by move assigning a
+    // new Semaphore, closing the old handle would unlink the new object's name again.
+    semaphore.close();
+    semaphore.create(semaphore_name, 0);
+  }
+
+  void test_close(sasm::Semaphore& semaphore)
+  {
+    pid_t child = spawn_attached([](sasm::Semaphore& shared)
+    {
+      return !shared.wait(300);
+    });
+
+    // Nor does closing the creator's handle, which also unlinks the name
+    check(wait_for_waiters(semaphore, 1), "the child is asleep on the semaphore");
+    semaphore.close();
+    check(succeeded(child), "closing the creating handle doesn't release a waiter");
+  }
+
+  void test_move()
+  {
+    sasm::Semaphore source(semaphore_name, 1);
+    sasm::Semaphore target(std::move(source));
+
+    check(source.get_object() == nullptr && !source.wait(0) && !source.increment(), "a moved from semaphore is closed");
+    check(target.get_object() != nullptr && target.wait(0), "the move target owns the count");
+
+    sasm::Semaphore assigned;
+    assigned = std::move(target);
+
+    check(target.get_object() == nullptr, "move assignment leaves the source closed");
+    check(assigned.increment() && assigned.wait(0), "the move assigned semaphore works");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink((std::string(semaphore_name) + ".sem").c_str());
+
+  sasm::Semaphore semaphore(semaphore_name, 2);
+
+  if (semaphore.get_object() == nullptr)
+  {
+    std::printf("FAIL: could not create the semaphore\n");
+    return 1;
+  }
+
+  test_initial_count(semaphore);
+  test_timeout(semaphore);
+  test_wait_stats(semaphore);
+  test_bulk_increment(semaphore);
+  test_release_all(semaphore);
+  test_peer_close(semaphore);
+  test_close(semaphore);
+  test_move();
+
+  return finish("semaphore_test");
+}
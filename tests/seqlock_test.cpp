@@ -0,0 +1,158 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Seqlocked<T>: zero filled memory holding a zero filled value,
+// stores in one process showing up in another, readers in several processes never seeing a
+// torn value while writers in several others store concurrently, and no write being lost.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+
+using namespace sasm_test;
+
+namespace
+{
+  // Large enough to take several stores to copy, every word holds the same value
+  struct Snapshot
+  {
+    std::uint64_t words[32];
+  };
+
+  Snapshot make_snapshot(std::uint64_t value)
+  {
+    Snapshot snapshot;
+
+    for (std::uint64_t& word : snapshot.words)
+    {
+      word = value;
+    }
+
+    return snapshot;
+  }
+
+  bool consistent(const Snapshot& snapshot)
+  {
+    for (std::uint64_t word : snapshot.words)
+    {
+      if (word != snapshot.words[0])
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    sasm::Seqlocked<Snapshot> snapshot;
+    std::atomic<std::uint32_t> writers_done;
+  };
+
+  Control* control{ nullptr };
+
+  void test_zero_filled()
+  {
+    // No constructor ran
+    sasm::Seqlocked<Snapshot>* seqlocked = static_cast<sasm::Seqlocked<Snapshot>*>(shared_mapping(sizeof(sasm::Seqlocked<Snapshot>)));
+    check(seqlocked != nullptr, "the zero filled mapping exists");
+
+    Snapshot snapshot = make_snapshot(1);
+    check(seqlocked->try_load(snapshot) && snapshot.words[0] == 0 && consistent(snapshot), "zero filled memory holds a zero filled value");
+    check(seqlocked->get_sequence() == 0, "and an even sequence");
+
+    pid_t child = spawn([seqlocked]
+    {
+      seqlocked->store(make_snapshot(7));
+      return true;
+    });
+
+    check(succeeded(child), "a child stores into it");
+    snapshot = seqlocked->load();
+    check(snapshot.words[0] == 7 && consistent(snapshot), "the parent loads the child's store");
+    check(seqlocked->get_sequence() == 2, "one store moves the sequence by two");
+  }
+
+  void test_concurrent()
+  {
+    constexpr int writers = 2;
+    constexpr int readers = 3;
+    constexpr std::uint64_t rounds = 20000;
+    control->writers_done.store(0);
+    pid_t pids[writers + readers];
+
+    // Writers race each other on the sequence word, readers keep loading until they are done
+    for (int i = 0; i < writers; ++i)
+    {
+      pids[i] = spawn([i]
+      {
+        for (std::uint64_t round = 0; round < rounds; ++round)
+        {
+          control->snapshot.store(make_snapshot(round * writers + i));
+        }
+
+        control->writers_done.fetch_add(1);
+        return true;
+      });
+    }
+
+    for (int i = 0; i < readers; ++i)
+    {
+      pids[writers + i] = spawn([]
+      {
+        bool torn = false;
+        std::uint64_t loads = 0;
+
+        while (control->writers_done.load() < writers || loads < 1000)
+        {
+          Snapshot snapshot = control->snapshot.load();
+          torn = torn || !consistent(snapshot);
+          ++loads;
+
+          if (loads % 64 == 0)
+          {
+            std::this_thread::yield();
+          }
+        }
+
+        return !torn;
+      });
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all, "readers in several processes never see a torn value");
+    check(control->snapshot.get_sequence() == 2 * writers * rounds, "every store from every writer went through the sequence");
+
+    Snapshot last = control->snapshot.load();
+    check(consistent(last) && last.words[0] >= (rounds - 1) * writers, "the last value is one of the final stores");
+  }
+}
+
+int main()
+{
+  begin();
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+
+  test_zero_filled();
+  test_concurrent();
+
+  return finish("seqlock_test");
+}
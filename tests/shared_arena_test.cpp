@@ -0,0 +1,280 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Shared_Arena: offsets and the root object crossing processes,
+// alignment, exhaustion and recovery, concurrent allocation from several processes without
+// overlapping blocks, and processes killed mid-allocation not wedging the large block list.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const arena_name{ "/sasm_shared_arena_test" };
+  constexpr std::size_t arena_size{ std::size_t{ 64 } << 20 };
+
+  using Offset = sasm::Shared_Arena::Offset;
+
+  // Runs body in a child process on its own arena attached by name, which it never destroys
+  template <typename Body>
+  pid_t spawn_attached(Body&& body)
+  {
+    return spawn([&body]
+    {
+      sasm::Shared_Arena* arena = new sasm::Shared_Arena(arena_name, arena_size);
+      return arena->get_capacity() != 0 && body(*arena);
+    });
+  }
+
+  // Deterministic mix of small (size classes) and large (free list) requests
+  std::size_t request_size(std::size_t seed)
+  {
+    seed = seed * 2654435761u;
+    return seed % 4 == 0 ? 2049 + seed % 30000 : 1 + seed % 2048;
+  }
+
+  void fill(void* payload, std::size_t size, unsigned char tag)
+  {
+    std::memset(payload, tag, size);
+  }
+
+  bool intact(const void* payload, std::size_t size, unsigned char tag)
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(payload);
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      if (bytes[i] != tag)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  void test_basics(sasm::Shared_Arena& arena)
+  {
+    check(arena.get_capacity() >= arena_size, "capacity covers the requested size");
+    check(arena.allocate(0) != sasm::Shared_Arena::null_offset, "a zero byte allocation still gets a block");
+    check(arena.allocate(arena_size * 2) == sasm::Shared_Arena::null_offset, "an allocation larger than the arena fails");
+
+    bool aligned = true;
+
+    for (std::size_t size : { 1, 15, 16, 17, 100, 2048, 2049, 5000, 100000 })
+    {
+      Offset offset = arena.allocate(size);
+      aligned = aligned && offset != sasm::Shared_Arena::null_offset && offset % 16 == 0 &&
+        reinterpret_cast<std::uintptr_t>(arena.to_pointer(offset)) % 16 == 0;
+      arena.deallocate(offset);
+    }
+
+    check(aligned, "every payload is 16 byte aligned");
+    check(arena.to_offset(arena.to_pointer(4096)) == 4096, "to_offset inverts to_pointer");
+  }
+
+  void test_root_across_processes(sasm::Shared_Arena& arena)
+  {
+    // The parent publishes a block through the root, a child attached by name reads it and answers
+    Offset message = arena.allocate(64);
+    std::strcpy(arena.get<char>(message), "from the parent");
+    arena.set_root(message);
+
+    pid_t child = spawn_attached([](sasm::Shared_Arena& shared)
+    {
+      Offset root = shared.get_root();
+
+      if (root == sasm::Shared_Arena::null_offset || std::strcmp(shared.get<char>(root), "from the parent") != 0)
+      {
+        return false;
+      }
+
+      Offset reply = shared.allocate(64);
+      std::strcpy(shared.get<char>(reply), "from the child");
+      shared.set_root(reply);
+      return true;
+    });
+
+    check(succeeded(child), "a child attached by name finds the parent's root block");
+    Offset reply = arena.get_root();
+    check(reply != message && std::strcmp(arena.get<char>(reply), "from the child") == 0, "the parent finds the child's reply");
+
+    arena.set_root(sasm::Shared_Arena::null_offset);
+    arena.deallocate(message);
+    arena.deallocate(reply);
+  }
+
+  void test_concurrent(sasm::Shared_Arena&)
+  {
+    constexpr int children = 4;
+    pid_t pids[children];
+
+    // Each child keeps its blocks filled with its own tag, then checks nobody else wrote over them
+    for (int i = 0; i < children; ++i)
+    {
+      pids[i] = spawn_attached([i](sasm::Shared_Arena& shared)
+      {
+        unsigned char tag = static_cast<unsigned char>(0x10 + i);
+        std::vector<std::pair<Offset, std::size_t>> blocks;
+        bool ok = true;
+
+        for (std::size_t round = 0; round < 3000; ++round)
+        {
+          std::size_t size = request_size(round * children + i);
+          Offset offset = shared.allocate(size);
+
+          if (offset == sasm::Shared_Arena::null_offset)
+          {
+            return false;
+          }
+
+          fill(shared.to_pointer(offset), size, tag);
+          blocks.emplace_back(offset, size);
+
+          // Free every third block right away so merges and reuse race with the other children
+          if (round % 3 == 2)
+          {
+            std::pair<Offset, std::size_t> victim = blocks[blocks.size() / 2];
+            blocks[blocks.size() / 2] = blocks.back();
+            blocks.pop_back();
+            ok = ok && intact(shared.to_pointer(victim.first), victim.second, tag);
+            shared.deallocate(victim.first);
+          }
+        }
+
+        for (const std::pair<Offset, std::size_t>& block : blocks)
+        {
+          ok = ok && intact(shared.to_pointer(block.first), block.second, tag);
+          shared.deallocate(block.first);
+        }
+
+        return ok;
+      });
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all, "concurrent allocations from several processes never overlap");
+  }
+
+  void test_exhaustion(sasm::Shared_Arena& arena)
+  {
+    // Large blocks until nothing fits, then everything back and the space is usable again
+    constexpr std::size_t block = std::size_t{ 1 } << 20;
+    std::vector<Offset> blocks;
+
+    for (Offset offset; (offset = arena.allocate(block)) != sasm::Shared_Arena::null_offset;)
+    {
+      blocks.push_back(offset);
+    }
+
+    check(!blocks.empty() && blocks.size() <= arena_size / block, "allocation stops when the arena is full");
+    check(arena.allocate(block) == sasm::Shared_Arena::null_offset, "a full arena keeps failing");
+
+    std::size_t count = blocks.size();
+
+    for (Offset offset : blocks)
+    {
+      arena.deallocate(offset);
+    }
+
+    blocks.clear();
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      blocks.push_back(arena.allocate(block));
+    }
+
+    check(blocks.back() != sasm::Shared_Arena::null_offset, "freed large blocks are reused");
+
+    // Neighbours coalesce: freeing everything lets a block spanning several of them fit
+    for (Offset offset : blocks)
+    {
+      arena.deallocate(offset);
+    }
+
+    Offset merged = arena.allocate(block * 4);
+    check(merged != sasm::Shared_Arena::null_offset, "adjacent free blocks merge");
+    arena.deallocate(merged);
+  }
+
+  void test_killed_holders(sasm::Shared_Arena& arena)
+  {
+    // Children churn large blocks and get killed at arbitrary points, possibly holding the lock
+    for (int round = 0; round < 30; ++round)
+    {
+      pid_t child = spawn_attached([](sasm::Shared_Arena& shared)
+      {
+        for (std::size_t i = 0;; ++i)
+        {
+          Offset offset = shared.allocate(4096 + i % 8192);
+
+          if (offset != sasm::Shared_Arena::null_offset)
+          {
+            shared.deallocate(offset);
+          }
+        }
+
+        return true;
+      });
+
+      std::this_thread::sleep_for(std::chrono::microseconds(500 + round * 97));
+      kill(child, SIGKILL);
+      waitpid(child, nullptr, 0);
+    }
+
+    Offset offset = arena.allocate(100000);
+    check(offset != sasm::Shared_Arena::null_offset, "the arena keeps working after holders were killed");
+    arena.deallocate(offset);
+  }
+
+  void test_mismatch()
+  {
+    // Smaller would map less than the arena spans, and must not unlink it either
+    sasm::Shared_Arena other;
+    check(!other.create(arena_name, arena_size / 2), "attaching with a smaller size fails");
+
+    int fd = shm_open(arena_name, O_RDWR, 0);
+    check(fd != -1, "the arena's name survives the failed attach");
+
+    if (fd != -1)
+    {
+      close(fd);
+    }
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(arena_name);
+
+  sasm::Shared_Arena arena(arena_name, arena_size);
+
+  if (arena.get_capacity() == 0)
+  {
+    std::printf("FAIL: could not create the arena\n");
+    return 1;
+  }
+
+  test_basics(arena);
+  test_root_across_processes(arena);
+  test_concurrent(arena);
+  test_exhaustion(arena);
+  test_killed_holders(arena);
+  test_mismatch();
+
+  return finish("shared_arena_test");
+}
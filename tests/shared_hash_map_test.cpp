@@ -0,0 +1,307 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Shared_Hash_Map: lookups, updates and erases crossing processes,
+// the full table edge, tombstones being reused by other keys, rebuild() keeping every entry,
+// several processes racing to insert the same keys without duplicates, readers never seeing a torn
+// value, and refusing a mismatched capacity or one whose table would not fit a size_t.
+
+#include "test_util.h"
+
+#include <cstdio>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const map_name{ "/sasm_shared_hash_map_test" };
+  constexpr std::size_t map_capacity{ 4096 };
+
+  // Both halves are written together, a reader seeing them disagree saw a torn value
+  struct Value
+  {
+    std::uint64_t value;
+    std::uint64_t inverse;
+  };
+
+  using Map = sasm::Shared_Hash_Map<std::uint64_t, Value>;
+
+  Value make_value(std::uint64_t value)
+  {
+    return Value{ value, ~value };
+  }
+
+  bool consistent(const Value& value)
+  {
+    return value.inverse == ~value.value;
+  }
+
+  // Runs body in a child process on its own map attached by name, which it never destroys
+  template <typename Body>
+  pid_t spawn_attached(const char* name, std::size_t capacity, Body&& body)
+  {
+    return spawn([&]
+    {
+      Map* map = new Map(name, capacity);
+      return map->capacity() != 0 && body(*map);
+    });
+  }
+
+  void test_basics(Map& map)
+  {
+    Value value{};
+
+    check(map.capacity() == map_capacity && map.size() == 0, "a new map is empty");
+    check(!map.find(1, value) && !map.contains(1) && !map.erase(1), "missing keys are missing");
+    check(map.insert_or_assign(1, make_value(10)) && map.find(1, value) && value.value == 10, "insert then find");
+    check(map.insert_or_assign(1, make_value(11)) && map.find(1, value) && value.value == 11 && map.size() == 1, "assigning an existing key updates it in place");
+    check(map.erase(1) && !map.contains(1) && map.size() == 0, "erase removes the key");
+    check(!map.erase(1), "erasing twice fails");
+
+    Map tiny;
+    check(tiny.create("/sasm_shared_hash_map_test_tiny", 3) && tiny.capacity() == 16, "capacity is at least one probe group");
+  }
+
+  void test_across_processes(Map& map)
+  {
+    map.insert_or_assign(100, make_value(1000));
+    map.insert_or_assign(101, make_value(1010));
+
+    pid_t child = spawn_attached(map_name, map_capacity, [](Map& shared)
+    {
+      Value value{};
+      bool found = shared.find(100, value) && value.value == 1000 && shared.contains(101);
+      return found && shared.insert_or_assign(100, make_value(2000)) && shared.erase(101) && shared.insert_or_assign(102, make_value(1020));
+    });
+
+    Value value{};
+    check(succeeded(child), "a child attached by name sees the parent's entries");
+    check(map.find(100, value) && value.value == 2000, "the parent sees the child's update");
+    check(!map.contains(101) && map.contains(102), "the parent sees the child's erase and insert");
+
+    map.erase(100);
+    map.erase(102);
+    check(map.size() == 0, "the map is empty again");
+  }
+
+  void test_full_table()
+  {
+    const char* const name = "/sasm_shared_hash_map_test_full";
+    shm_unlink(name);
+    Map map(name, 64);
+    bool filled = true;
+
+    for (std::uint64_t key = 0; key < 64; ++key)
+    {
+      filled = map.insert_or_assign(key, make_value(key)) && filled;
+    }
+
+    check(filled && map.size() == 64, "every slot can be filled");
+    check(!map.insert_or_assign(64, make_value(64)), "a new key doesn't fit a full table");
+    check(map.insert_or_assign(63, make_value(630)), "an existing key can still be assigned when full");
+
+    // Another process keeps the table full while replacing every key many times over: each new
+    // key has to land in the tombstone some other key just left
+    pid_t child = spawn_attached(name, 64, [](Map& shared)
+    {
+      for (std::uint64_t round = 0; round < 20000; ++round)
+      {
+        std::uint64_t victim = round < 64 ? round : 1000 + round - 64;
+        std::uint64_t key = 1000 + round;
+        Value value{};
+
+        if (!shared.erase(victim) || !shared.insert_or_assign(key, make_value(key)) || !shared.find(key, value) || value.value != key)
+        {
+          return false;
+        }
+      }
+
+      return true;
+    });
+
+    check(succeeded(child), "tombstones are reused by other keys without the table filling up");
+    check(map.size() == 64, "the table is exactly full again");
+  }
+
+  void test_rebuild()
+  {
+    const char* const name = "/sasm_shared_hash_map_test_rebuild";
+    shm_unlink(name);
+    Map map(name, 64);
+
+    // Thousands of keys passing through leave tombstones all over the table
+    for (std::uint64_t key = 0; key < 5000; ++key)
+    {
+      map.insert_or_assign(key, make_value(key));
+
+      if (key % 10 != 0)
+      {
+        map.erase(key);
+      }
+
+      // Keep only the last few multiples of ten
+      if (key >= 200 && key % 10 == 0)
+      {
+        map.erase(key - 200);
+      }
+    }
+
+    std::size_t before = map.size();
+    map.rebuild();
+    check(map.size() == before && before == 20, "rebuild() keeps the entry count");
+
+    bool kept = true;
+
+    for (std::uint64_t key = 4800; key < 5000; ++key)
+    {
+      Value value{};
+      kept = kept && map.find(key, value) == (key % 10 == 0) && (key % 10 != 0 || value.value == key);
+    }
+
+    check(kept && !map.contains(4790), "rebuild() keeps exactly the live entries and their values");
+
+    pid_t child = spawn_attached(name, 64, [](Map& shared)
+    {
+      bool filled = true;
+
+      for (std::uint64_t key = 10000; key < 10044; ++key)
+      {
+        filled = shared.insert_or_assign(key, make_value(key)) && filled;
+      }
+
+      return filled && shared.contains(4990) && !shared.insert_or_assign(20000, make_value(0));
+    });
+
+    check(succeeded(child), "another process sees the rebuilt table and can fill it exactly");
+    check(map.size() == 64 && map.contains(10043), "the parent sees the child's inserts");
+
+    Map empty;
+    empty.rebuild();
+    check(empty.size() == 0, "rebuild() on an empty Shared_Hash_Map does nothing");
+  }
+
+  void test_racing_inserts(Map& map)
+  {
+    constexpr int writers = 4;
+    constexpr std::uint64_t shared_keys = 1000;
+    constexpr std::uint64_t own_keys = 500;
+    pid_t children[writers];
+
+    // Every writer inserts the same shared keys plus its own, and rewrites the shared ones repeatedly
+    for (int i = 0; i < writers; ++i)
+    {
+      children[i] = spawn_attached(map_name, map_capacity, [i](Map& shared)
+      {
+        for (int pass = 0; pass < 5; ++pass)
+        {
+          for (std::uint64_t key = 0; key < shared_keys; ++key)
+          {
+            if (!shared.insert_or_assign(key, make_value(key * 10 + i)))
+            {
+              return false;
+            }
+          }
+        }
+
+        for (std::uint64_t key = 0; key < own_keys; ++key)
+        {
+          if (!shared.insert_or_assign(100000 * (i + 1) + key, make_value(key)))
+          {
+            return false;
+          }
+        }
+
+        return true;
+      });
+    }
+
+    // Meanwhile the parent keeps reading the shared keys
+    bool torn = false;
+
+    for (int round = 0; round < 200; ++round)
+    {
+      for (std::uint64_t key = 0; key < shared_keys; key += 7)
+      {
+        Value value{};
+
+        if (map.find(key, value))
+        {
+          torn = torn || !consistent(value) || value.value / 10 != key;
+        }
+      }
+    }
+
+    bool all = true;
+
+    for (pid_t child : children)
+    {
+      all = succeeded(child) && all;
+    }
+
+    check(all, "every writer process finishes");
+    check(!torn, "readers never see a torn or misplaced value");
+    check(map.size() == shared_keys + writers * own_keys, "keys inserted by several processes at once appear exactly once");
+
+    bool found = true;
+
+    for (std::uint64_t key = 0; key < shared_keys; ++key)
+    {
+      Value value{};
+      found = found && map.find(key, value) && consistent(value) && value.value / 10 == key;
+    }
+
+    check(found, "every shared key holds one of the written values");
+  }
+
+  void test_mismatch()
+  {
+    // Neither may unlink or shrink the map, its name is checked right after
+    Map other;
+    check(!other.create(map_name, map_capacity * 2), "attaching with a larger capacity fails");
+    check(!other.create(map_name, map_capacity / 2), "attaching with a smaller capacity fails");
+
+    pid_t child = spawn_attached(map_name, map_capacity, [](Map& shared)
+    {
+      return shared.contains(0) && shared.size() != 0;
+    });
+
+    check(succeeded(child), "the map is intact after the failed attaches");
+  }
+
+  void test_overflow()
+  {
+    // Capacities whose map would not fit a size_t, none may leave an object behind
+    const char* const name = "/sasm_shared_hash_map_test_overflow";
+    Map huge;
+    check(!huge.create(name, SIZE_MAX), "a capacity with no power of two above it fails");
+    check(!huge.create(name, SIZE_MAX / 2 + 1), "a capacity whose slots wrap a size_t fails");
+    check(!huge.create(name, SIZE_MAX / sizeof(Value)), "a capacity that rounds up into a wrap fails");
+    check(shm_open(name, O_RDONLY, 0) == -1, "the failed creates leave nothing behind");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(map_name);
+
+  Map map(map_name, map_capacity);
+
+  if (map.capacity() == 0)
+  {
+    std::printf("FAIL: could not create the map\n");
+    return 1;
+  }
+
+  test_basics(map);
+  test_across_processes(map);
+  test_full_table();
+  test_rebuild();
+  test_racing_inserts(map);
+  test_mismatch();
+  test_overflow();
+
+  return finish("shared_hash_map_test");
+}
@@ -0,0 +1,305 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Shared_Memory_Pool: bucket selection and exhaustion, handles
+// resolving to the same memory in another process, exclusive ownership under concurrent
+// acquire() / release(), bad or repeated releases being caught, refusing a mismatched shape, and
+// only the last closer unlinking.
+
+#include "test_util.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <sys/resource.h>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const pool_name{ "/sasm_shared_memory_pool_test" };
+  const std::vector<std::size_t> bucket_sizes{ 4096, 65536 };
+  constexpr std::size_t segments_per_bucket{ 4 };
+
+  using Pool = sasm::Shared_Memory_Pool;
+
+  bool name_exists(const std::string& name)
+  {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+
+    if (fd == -1)
+    {
+      return false;
+    }
+
+    close(fd);
+    return true;
+  }
+
+  // Runs body in a child process on its own pool joined by name, then closes it, which only
+  // detaches while the parent still has the pool open
+  template <typename Body>
+  pid_t spawn_attached(Body&& body)
+  {
+    return spawn([&body]
+    {
+      Pool* pool = new Pool(pool_name, bucket_sizes, segments_per_bucket);
+      bool passed = pool->get_bucket_count() != 0 && body(*pool);
+      pool->close();
+      return passed;
+    });
+  }
+
+  void test_buckets(Pool& pool)
+  {
+    check(pool.get_bucket_count() == 2 && pool.get_bucket_size(0) == 4096 && pool.get_bucket_size(1) == 65536, "the pool has the requested shape");
+    check(pool.get_available(0) == segments_per_bucket && pool.get_available(1) == segments_per_bucket, "every segment starts out free");
+    check(pool.acquire(65537) == Pool::null_handle, "nothing fits a request above the largest bucket");
+
+    Pool::Handle small = pool.acquire(100);
+    check(small != Pool::null_handle && pool.get_size(small) >= 4096 && pool.get_size(small) < 65536, "a small request gets the smallest bucket");
+
+    Pool::Handle large = pool.acquire(5000);
+    check(large != Pool::null_handle && pool.get_size(large) >= 65536, "a larger request skips to the bucket that fits");
+
+    // Draining the small bucket spills small requests into the large one
+    Pool::Handle drained[segments_per_bucket - 1];
+
+    for (Pool::Handle& handle : drained)
+    {
+      handle = pool.acquire(1);
+    }
+
+    check(pool.get_available(0) == 0, "the small bucket is drained");
+    Pool::Handle spilled = pool.acquire(1);
+    check(spilled != Pool::null_handle && pool.get_size(spilled) >= 65536, "small requests spill into the next bucket");
+
+    Pool::Handle rest[segments_per_bucket - 2];
+
+    for (Pool::Handle& handle : rest)
+    {
+      handle = pool.acquire(1);
+    }
+
+    check(pool.acquire(1) == Pool::null_handle, "a fully drained pool returns null_handle");
+
+    pool.release(small);
+    pool.release(large);
+    pool.release(spilled);
+
+    for (Pool::Handle handle : drained)
+    {
+      pool.release(handle);
+    }
+
+    for (Pool::Handle handle : rest)
+    {
+      pool.release(handle);
+    }
+
+    pool.release(Pool::null_handle);
+    check(pool.get_available(0) == segments_per_bucket && pool.get_available(1) == segments_per_bucket, "every segment is free again");
+  }
+
+  void test_handles_across_processes(Pool& pool)
+  {
+    Pool::Handle handle = pool.acquire(1000);
+    std::strcpy(static_cast<char*>(pool.get_address(handle)), "from the parent");
+
+    // The child gets the handle through fork, resolves it in its own mappings, answers and releases it
+    pid_t child = spawn_attached([handle](Pool& shared)
+    {
+      char* text = static_cast<char*>(shared.get_address(handle));
+
+      if (text == nullptr || std::strcmp(text, "from the parent") != 0)
+      {
+        return false;
+      }
+
+      std::strcpy(text, "from the child");
+      shared.release(handle);
+      return true;
+    });
+
+    check(succeeded(child), "a child resolves the parent's handle to the same memory");
+    check(std::strcmp(static_cast<char*>(pool.get_address(handle)), "from the child") == 0, "the parent sees the child's write");
+    check(pool.get_available(0) == segments_per_bucket, "a release in one process frees the segment for all");
+  }
+
+  void test_exclusive_ownership()
+  {
+    // More takers than segments: whoever holds a segment stamps it and checks nobody else did
+    constexpr int takers = 12;
+    pid_t pids[takers];
+
+    for (int i = 0; i < takers; ++i)
+    {
+      pids[i] = spawn_attached([i](Pool& shared)
+      {
+        bool ok = true;
+
+        for (int round = 0; round < 5000; ++round)
+        {
+          Pool::Handle handle = shared.acquire(1);
+
+          if (handle == Pool::null_handle)
+          {
+            std::this_thread::yield();
+            continue;
+          }
+
+          volatile int* stamp = static_cast<volatile int*>(shared.get_address(handle));
+          *stamp = i;
+          std::this_thread::yield();
+          ok = ok && *stamp == i;
+          shared.release(handle);
+        }
+
+        return ok;
+      });
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    check(all, "concurrent takers never share a segment");
+  }
+
+  // Releases handle in a child: the assert kills it in debug builds, release builds ignore the
+  // handle. Either way the free lists must come out unchanged.
+  bool release_rejected(Pool& pool, Pool::Handle handle)
+  {
+    std::size_t available[] = { pool.get_available(0), pool.get_available(1) };
+
+    pid_t child = spawn([&pool, handle]
+    {
+      // Keep the assert message and a core dump out of the test output
+      rlimit no_core{ 0, 0 };
+      setrlimit(RLIMIT_CORE, &no_core);
+      std::freopen("/dev/null", "w", stderr);
+
+      pool.release(handle);
+      return true;
+    });
+
+    int status = 0;
+    waitpid(child, &status, 0);
+
+#ifdef NDEBUG
+    bool rejected = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+    bool rejected = WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+#endif
+
+    return rejected && pool.get_available(0) == available[0] && pool.get_available(1) == available[1];
+  }
+
+  void test_bad_release(Pool& pool)
+  {
+    Pool::Handle held = pool.acquire(1000);
+    Pool::Handle handle = pool.acquire(1000);
+    pool.release(handle);
+
+    check(release_rejected(pool, handle), "releasing a handle twice is caught");
+    Pool::Handle free_handle = 0;
+
+    while (free_handle == held || free_handle == handle)
+    {
+      ++free_handle;
+    }
+
+    check(release_rejected(pool, free_handle), "releasing a segment nobody acquired is caught");
+    check(release_rejected(pool, static_cast<Pool::Handle>(bucket_sizes.size()) << 24), "a handle past the last bucket is caught");
+    check(release_rejected(pool, (handle & 0xFF000000u) | segments_per_bucket), "a handle past the bucket's segments is caught");
+    check(pool.get_address(static_cast<Pool::Handle>(bucket_sizes.size()) << 24) == nullptr && pool.get_size(segments_per_bucket) == 0, "bad handles resolve to nothing");
+
+    pool.release(Pool::null_handle);
+    pool.release(held);
+
+    // The lists still hold every segment exactly once
+    Pool::Handle handles[segments_per_bucket];
+    bool distinct = true;
+
+    for (std::size_t i = 0; i < segments_per_bucket; ++i)
+    {
+      handles[i] = pool.acquire(1000);
+      distinct = distinct && handles[i] != Pool::null_handle && (handles[i] >> 24) == 0;
+
+      for (std::size_t j = 0; j < i; ++j)
+      {
+        distinct = distinct && handles[j] != handles[i];
+      }
+    }
+
+    check(distinct && pool.get_available(0) == 0, "after the bad releases every segment is handed out once");
+
+    for (Pool::Handle acquired : handles)
+    {
+      pool.release(acquired);
+    }
+
+    check(pool.get_available(0) == segments_per_bucket, "and all of them come back");
+  }
+
+  void test_mismatch(Pool& pool)
+  {
+    Pool other;
+    check(!other.create(pool_name, bucket_sizes, segments_per_bucket + 1), "joining with a different shape fails");
+    check(!other.create(pool_name, { 4096, 131072 }, segments_per_bucket), "joining with different bucket sizes fails");
+    check(name_exists(pool_name) && pool.get_available(0) == segments_per_bucket, "a failed join leaves the pool alone");
+  }
+
+  void test_last_closer(Pool& pool)
+  {
+    std::string segment = std::string(pool_name) + ".0.0";
+
+    // A child joining and closing must not take the names with it
+    pid_t child = spawn_attached([](Pool&)
+    {
+      return true;
+    });
+
+    check(succeeded(child), "a child joins and closes");
+    check(name_exists(pool_name) && name_exists(segment), "an early closer leaves the names");
+
+    pool.close();
+    check(!name_exists(pool_name) && !name_exists(segment), "the last closer unlinks every name");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(pool_name);
+
+  for (std::size_t bucket = 0; bucket < bucket_sizes.size(); ++bucket)
+  {
+    for (std::size_t index = 0; index < segments_per_bucket; ++index)
+    {
+      shm_unlink((std::string(pool_name) + "." + std::to_string(bucket) + "." + std::to_string(index)).c_str());
+    }
+  }
+
+  Pool pool(pool_name, bucket_sizes, segments_per_bucket);
+
+  if (pool.get_bucket_count() == 0)
+  {
+    std::printf("FAIL: could not create the pool\n");
+    return 1;
+  }
+
+  test_buckets(pool);
+  test_handles_across_processes(pool);
+  test_exclusive_ownership();
+  test_bad_release(pool);
+  test_mismatch(pool);
+  test_last_closer(pool);
+
+  return finish("shared_memory_pool_test");
+}
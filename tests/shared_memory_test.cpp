@@ -0,0 +1,542 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Shared_Memory: growable segments resized in one process and
+// picked up with refresh() in another, data written to the grown tail crossing processes,
+// attaching to a segment that already grew mapping it at its current size, anonymous segments
+// passed over a Unix socket with send_to() / receive_from(), their seals, the growable
+// layout travelling along to the receiver, explicit huge pages with their transparent huge page
+// fallback, the ".hugetlbfs" redirect every later create() of a name follows, and prefaulting
+// and locking keeping existing contents, growth only populating the new tail, and what
+// is_locked() / get_populate_time() report.
+
+#include "test_util.h"
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const growable_name{ "/sasm_shared_memory_test_growable" };
+  const char* const huge_name{ "/sasm_shared_memory_test_huge" };
+  const char* const redirected_name{ "/sasm_shared_memory_test_redirected" };
+  const char* const redirect_target{ "/tmp/sasm_shared_memory_test_redirected" };
+  const char* const prefault_name{ "/sasm_shared_memory_test_prefault" };
+  const char* const scratch_name{ "/sasm_shared_memory_test_scratch" };
+  const char* const spare_name{ "/sasm_shared_memory_test_spare" };
+  constexpr std::size_t huge_2mb{ std::size_t{ 2 } << 20 };
+  constexpr std::size_t huge_1gb{ std::size_t{ 1 } << 30 };
+  constexpr std::size_t small_size{ 4096 };
+  constexpr std::size_t grown_size{ std::size_t{ 1 } << 20 };
+  constexpr std::size_t regrown_size{ std::size_t{ 2 } << 20 };
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    std::atomic<std::uint32_t> attached;
+    std::atomic<std::uint32_t> grown;
+    std::atomic<std::uint32_t> regrown;
+  };
+
+  Control* control{ nullptr };
+
+  void reset_control()
+  {
+    control->attached.store(0);
+    control->grown.store(0);
+    control->regrown.store(0);
+  }
+
+  unsigned char* bytes(const sasm::Shared_Memory& memory)
+  {
+    return static_cast<unsigned char*>(memory.get_address());
+  }
+
+  // Whether every page under the segment's data is resident
+  bool resident(const sasm::Shared_Memory& memory)
+  {
+    std::size_t page = sasm::detail::system_page_size();
+    std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(memory.get_address()) & ~(page - 1);
+    std::uintptr_t end = reinterpret_cast<std::uintptr_t>(memory.get_address()) + memory.get_size();
+    std::vector<unsigned char> pages((end - begin + page - 1) / page);
+
+    if (mincore(reinterpret_cast<void*>(begin), end - begin, pages.data()) != 0)
+    {
+      return false;
+    }
+
+    for (unsigned char state : pages)
+    {
+      if (!(state & 1))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // One byte per page, so every page holds something a prefault must not clear
+  void fill_pages(const sasm::Shared_Memory& memory, std::size_t from, std::size_t to)
+  {
+    for (std::size_t offset = from; offset < to; offset += 4096)
+    {
+      bytes(memory)[offset] = static_cast<unsigned char>(offset / 4096 % 251 + 1);
+    }
+  }
+
+  bool pages_filled(const sasm::Shared_Memory& memory, std::size_t from, std::size_t to)
+  {
+    for (std::size_t offset = from; offset < to; offset += 4096)
+    {
+      if (bytes(memory)[offset] != static_cast<unsigned char>(offset / 4096 % 251 + 1))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // Creates memory under name, dropping whatever an earlier run left behind
+  bool create_fresh(sasm::Shared_Memory& memory, const char* name, std::size_t size, sasm::Memory_Flags flags = sasm::Memory_Flags::none)
+  {
+    shm_unlink(name);
+    return memory.create(name, size, flags);
+  }
+
+  bool exists(const std::string& shm_name)
+  {
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+
+    if (fd == -1)
+    {
+      return false;
+    }
+
+    ::close(fd);
+    return true;
+  }
+
+  // Runs body in a child process on the segment it receives over a fresh socketpair, after the
+  // parent sent memory through the other end
+  template <typename Body>
+  pid_t spawn_receiver(const sasm::Shared_Memory& memory, Body&& body)
+  {
+    int sockets[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+    {
+      return -1;
+    }
+
+    pid_t child = spawn([&sockets, &body]
+    {
+      ::close(sockets[0]);
+      sasm::Shared_Memory* received = new sasm::Shared_Memory;
+      return received->receive_from(sockets[1]) && body(*received);
+    });
+
+    bool sent = memory.send_to(sockets[0]);
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+
+    if (!sent)
+    {
+      kill(child, SIGKILL);
+      waitpid(child, nullptr, 0);
+      return -1;
+    }
+
+    return child;
+  }
+
+  void test_fixed_size()
+  {
+    sasm::Shared_Memory memory;
+    check(create_fresh(memory, scratch_name, small_size), "a fixed size segment is created");
+    check(!memory.resize(grown_size) && memory.get_size() == small_size, "resize() refuses a segment that isn't growable");
+    check(memory.refresh(), "refresh() on a fixed size segment is a no-op");
+  }
+
+  void test_resize_and_refresh()
+  {
+    reset_control();
+    sasm::Shared_Memory memory;
+    check(create_fresh(memory, growable_name, small_size, sasm::Memory_Flags::growable), "a growable segment is created");
+    check(memory.get_size() >= small_size && memory.get_generation() == 0, "it starts at the requested size, generation 0");
+    bytes(memory)[0] = 0x11;
+
+    // The peer attaches small, then follows the parent's growth and grows it once more itself
+    pid_t child = spawn([]
+    {
+      sasm::Shared_Memory* peer = new sasm::Shared_Memory(growable_name, small_size, sasm::Memory_Flags::growable);
+      bool attached = peer->get_address() != nullptr && bytes(*peer)[0] == 0x11;
+      control->attached.store(1);
+
+      if (!attached || !wait_until(control->grown, 1))
+      {
+        return false;
+      }
+
+      // Nothing changes until refresh()
+      bool stale = peer->get_size() < grown_size;
+      bool refreshed = peer->refresh() && peer->get_size() >= grown_size && peer->get_generation() == 1;
+      bool tail = refreshed && bytes(*peer)[grown_size - 1] == 0x22 && bytes(*peer)[0] == 0x11;
+
+      if (!peer->resize(regrown_size))
+      {
+        return false;
+      }
+
+      bytes(*peer)[regrown_size - 1] = 0x33;
+      control->regrown.store(1);
+      return stale && refreshed && tail;
+    });
+
+    check(wait_until(control->attached, 1), "the peer attached");
+    check(memory.resize(grown_size) && memory.get_size() >= grown_size, "resize() grows the segment locally");
+    check(memory.get_generation() == 1, "growing bumps the generation");
+    check(bytes(memory)[0] == 0x11, "growing keeps the contents");
+    bytes(memory)[grown_size - 1] = 0x22;
+    control->grown.store(1);
+
+    check(wait_until(control->regrown, 1), "the peer grew the segment again");
+    check(memory.get_size() < regrown_size, "the peer's growth isn't visible before refresh()");
+    check(memory.refresh() && memory.get_size() >= regrown_size && memory.get_generation() == 2, "refresh() picks up the peer's growth");
+    check(bytes(memory)[regrown_size - 1] == 0x33 && bytes(memory)[grown_size - 1] == 0x22, "data the peer wrote to the new tail is visible");
+    check(succeeded(child), "the peer refreshed to the new size and saw the grown tail");
+
+    check(memory.resize(small_size) && memory.get_size() >= regrown_size, "resize() never shrinks");
+    check(memory.refresh() && memory.get_generation() == 2, "refresh() without growth keeps the generation");
+  }
+
+  void test_attach_to_grown()
+  {
+    // The segment is at regrown_size now, attachers map all of it
+    sasm::Shared_Memory memory;
+    check(create_fresh(memory, growable_name, small_size, sasm::Memory_Flags::growable) && memory.resize(regrown_size), "a segment is grown");
+    bytes(memory)[regrown_size - 1] = 0x33;
+
+    pid_t child = spawn([]
+    {
+      sasm::Shared_Memory* peer = new sasm::Shared_Memory(growable_name, small_size, sasm::Memory_Flags::growable);
+      return peer->get_address() != nullptr && peer->get_size() >= regrown_size && peer->get_generation() == 1 && bytes(*peer)[regrown_size - 1] == 0x33;
+    });
+
+    check(succeeded(child), "another process attaching small maps the current size and sees the data at its end");
+
+    // In this process too, closing it at the end unlinks the name just like memory's destructor
+    sasm::Shared_Memory attached;
+    check(attached.create(growable_name, small_size, sasm::Memory_Flags::growable), "attaching to the grown segment works");
+    check(attached.get_size() >= regrown_size && attached.get_generation() == 1, "an attach asking for less maps the current size");
+    check(bytes(attached)[regrown_size - 1] == 0x33, "and sees the data at its end");
+  }
+
+  void test_sent_over_socket()
+  {
+    sasm::Shared_Memory memory;
+    check(memory.create_anonymous(small_size), "an anonymous segment is created");
+    check(memory.get_name().empty(), "it has no name");
+    bytes(memory)[0] = 0x44;
+
+    pid_t child = spawn_receiver(memory, [](sasm::Shared_Memory& received)
+    {
+      bool same = received.get_size() == small_size && received.get_name().empty() && bytes(received)[0] == 0x44;
+
+      // The seals protect the sender from a receiver truncating the segment under its mapping
+      bool protected_size = ftruncate(received.get_file_mapping(), 0) != 0;
+      bytes(received)[1] = 0x55;
+      return same && protected_size;
+    });
+
+    check(child != -1, "send_to() passes the segment over a Unix socket");
+    check(succeeded(child), "the receiver maps the same memory and can't shrink it");
+    check(bytes(memory)[1] == 0x55, "writes from the receiver are visible to the sender");
+
+    sasm::Shared_Memory closed;
+    check(!closed.send_to(-1), "send_to() without a segment fails");
+  }
+
+  void test_seals()
+  {
+    sasm::Shared_Memory fixed;
+    check(fixed.create_anonymous(small_size), "a fixed size anonymous segment is created");
+    int fd = fixed.get_file_mapping();
+    int seals = fcntl(fd, F_GET_SEALS);
+    check(seals != -1 && (seals & F_SEAL_SHRINK) && (seals & F_SEAL_GROW), "it is sealed against shrinking and growing");
+    check(ftruncate(fd, small_size / 2) != 0 && errno == EPERM, "shrinking it is refused");
+    check(ftruncate(fd, small_size * 2) != 0 && errno == EPERM, "growing it is refused");
+
+    sasm::Shared_Memory growable;
+    check(growable.create_anonymous(small_size, sasm::Memory_Flags::growable), "a growable anonymous segment is created");
+    fd = growable.get_file_mapping();
+    seals = fcntl(fd, F_GET_SEALS);
+    check(seals != -1 && (seals & F_SEAL_SHRINK) && !(seals & F_SEAL_GROW), "it is only sealed against shrinking");
+    check(ftruncate(fd, 0) != 0 && errno == EPERM, "shrinking it is refused");
+    check(growable.resize(grown_size) && growable.get_size() >= grown_size, "resize() still grows it");
+  }
+
+  void test_growable_sent()
+  {
+    reset_control();
+    sasm::Shared_Memory memory;
+    check(memory.create_anonymous(small_size, sasm::Memory_Flags::growable | sasm::Memory_Flags::prefault), "a growable prefaulted anonymous segment is created");
+    bytes(memory)[0] = 0x66;
+    std::size_t sent_size = memory.get_size();
+
+    // The receiver passes no flags at all
+    pid_t child = spawn_receiver(memory, [sent_size](sasm::Shared_Memory& received)
+    {
+      sasm::Memory_Flags flags = received.get_flags();
+      bool layout = (flags & sasm::Memory_Flags::growable) && !(flags & sasm::Memory_Flags::prefault);
+      bool same = received.get_size() == sent_size && bytes(received)[0] == 0x66;
+      control->attached.store(1);
+
+      if (!wait_until(control->grown, 1))
+      {
+        return false;
+      }
+
+      bool refreshed = received.refresh() && received.get_size() >= grown_size && bytes(received)[grown_size - 1] == 0x77;
+      return layout && same && refreshed;
+    });
+
+    check(child != -1 && wait_until(control->attached, 1), "the growable segment reaches the receiver");
+    check(memory.resize(grown_size), "the sender grows it");
+    bytes(memory)[grown_size - 1] = 0x77;
+    control->grown.store(1);
+    check(succeeded(child), "the receiver gets the growable layout but not prefault, and follows the growth");
+  }
+
+  void test_transparent_fallback()
+  {
+    std::size_t base_page = sasm::detail::system_page_size();
+
+    // Without a 1 GiB hugetlbfs mount the named path can only fall back
+    if (sasm::detail::find_hugetlbfs_mount(huge_1gb).empty())
+    {
+      shm_unlink(huge_name);
+      sasm::Shared_Memory memory;
+      check(memory.create(huge_name, small_size, sasm::Memory_Flags::huge_pages_1gb), "1 GiB pages without a mount still create a segment");
+      check(memory.uses_transparent_huge_pages() && memory.get_page_size() == base_page, "it falls back to transparent huge pages on base pages");
+      check(memory.get_size() == huge_2mb, "rounded up to 2 MiB so the kernel can use them");
+      check(!exists(std::string(huge_name) + ".hugetlbfs"), "and leaves no redirect behind");
+    }
+
+    sasm::Shared_Memory transparent;
+    check(create_fresh(transparent, scratch_name, small_size, sasm::Memory_Flags::transparent_huge_pages), "a transparent huge page segment is created");
+    check(transparent.uses_transparent_huge_pages() && transparent.get_page_size() == base_page, "it reports base pages plus the hint");
+    check(transparent.get_size() == huge_2mb, "rounded up to 2 MiB");
+
+    sasm::Shared_Memory plain;
+    check(create_fresh(plain, spare_name, small_size), "a plain segment is created");
+    check(!plain.uses_transparent_huge_pages() && plain.get_page_size() == base_page && plain.get_size() == small_size, "without flags it is left alone");
+  }
+
+  void test_hugetlbfs()
+  {
+    std::string mount = sasm::detail::find_hugetlbfs_mount(huge_2mb);
+
+    if (mount.empty())
+    {
+      std::printf("skipped: no 2 MiB hugetlbfs mount\n");
+      return;
+    }
+
+    shm_unlink((std::string(huge_name) + ".hugetlbfs").c_str());
+    shm_unlink(huge_name);
+    sasm::Shared_Memory memory;
+    check(memory.create(huge_name, small_size, sasm::Memory_Flags::huge_pages_2mb), "a 2 MiB huge page segment is created");
+    std::string file = mount + huge_name;
+
+    // An empty huge page pool makes the creator fall back and remove its hugetlbfs file again
+    if (memory.get_page_size() != huge_2mb)
+    {
+      check(memory.uses_transparent_huge_pages() && memory.get_size() == huge_2mb, "an empty pool falls back to transparent huge pages");
+      check(!exists(std::string(huge_name) + ".hugetlbfs") && access(file.c_str(), F_OK) != 0, "and removes the hugetlbfs file");
+      return;
+    }
+
+    check(!memory.uses_transparent_huge_pages() && memory.get_size() == huge_2mb, "it is backed by one explicit 2 MiB page");
+    check(exists(std::string(huge_name) + ".hugetlbfs") && access(file.c_str(), F_OK) == 0, "the hugetlbfs file and its redirect exist");
+    bytes(memory)[0] = 0x88;
+
+    // Whatever flags a later creator passes, it maps the same huge page file
+    pid_t child = spawn([]
+    {
+      sasm::Shared_Memory* peer = new sasm::Shared_Memory(huge_name, small_size);
+      bool same = peer->get_address() != nullptr && peer->get_page_size() == huge_2mb && bytes(*peer)[0] == 0x88;
+      bytes(*peer)[1] = 0x99;
+      return same;
+    });
+
+    check(succeeded(child), "a peer without huge page flags follows the redirect");
+    check(bytes(memory)[1] == 0x99, "and writes to the same memory");
+
+    memory.close();
+    check(!exists(std::string(huge_name) + ".hugetlbfs") && access(file.c_str(), F_OK) != 0, "close() removes the file and the redirect");
+  }
+
+  void test_redirect()
+  {
+    // A redirect as a hugetlbfs creator leaves it, here pointing at a plain file
+    std::string redirect = std::string(redirected_name) + ".hugetlbfs";
+    shm_unlink(redirected_name);
+
+    {
+      std::ofstream target(redirect_target, std::ios::binary | std::ios::trunc);
+      target.write("\x5a", 1);
+    }
+
+    int fd = shm_open(redirect.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    bool written = fd != -1 && write(fd, redirect_target, std::strlen(redirect_target)) == static_cast<ssize_t>(std::strlen(redirect_target));
+    ::close(fd);
+
+    sasm::Shared_Memory memory;
+    check(written && memory.create(redirected_name, small_size), "create() succeeds on a redirected name");
+    check(memory.get_size() >= small_size && bytes(memory)[0] == 0x5a, "it maps the file the redirect names");
+    memory.close();
+    check(!exists(redirect) && access(redirect_target, F_OK) != 0, "close() removes the file and the redirect");
+
+    // A redirect to a file that is gone fails, rather than mapping separate memory under the name
+    fd = shm_open(redirect.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    written = fd != -1 && write(fd, redirect_target, std::strlen(redirect_target)) == static_cast<ssize_t>(std::strlen(redirect_target));
+    ::close(fd);
+    check(written && !memory.create(redirected_name, small_size), "a redirect to a missing file fails");
+    shm_unlink(redirect.c_str());
+    shm_unlink(redirected_name);
+  }
+
+  void test_plain_reports()
+  {
+    sasm::Shared_Memory memory;
+    check(create_fresh(memory, scratch_name, grown_size), "a plain segment is created");
+    check(!memory.is_locked() && memory.get_populate_time().count() == 0, "without flags nothing is locked or populated");
+
+    // The fallback prefault, for kernels without MADV_POPULATE_WRITE
+    fill_pages(memory, 0, grown_size);
+    sasm::detail::touch_pages(memory.get_address(), grown_size, sasm::detail::system_page_size());
+    check(pages_filled(memory, 0, grown_size), "touching pages to fault them in keeps their contents");
+  }
+
+  void test_prefault_keeps_contents()
+  {
+    shm_unlink(prefault_name);
+    sasm::Shared_Memory memory;
+    check(memory.create(prefault_name, grown_size), "a named segment is created");
+    fill_pages(memory, 0, grown_size);
+
+    // Peers attaching with prefault or lock must not disturb what is already there
+    for (sasm::Memory_Flags flags : { sasm::Memory_Flags::prefault, sasm::Memory_Flags::prefault_parallel, sasm::Memory_Flags::lock_in_memory })
+    {
+      pid_t child = spawn([flags]
+      {
+        sasm::Shared_Memory* peer = new sasm::Shared_Memory(prefault_name, grown_size, flags);
+        bool prefaulted = peer->get_address() != nullptr && pages_filled(*peer, 0, grown_size) && resident(*peer);
+        bool reports = peer->get_populate_time().count() > 0 && peer->is_locked() == (flags == sasm::Memory_Flags::lock_in_memory);
+        return prefaulted && reports;
+      });
+
+      check(succeeded(child), "a peer prefaulting or locking an existing segment keeps its contents and reports it");
+    }
+
+    check(pages_filled(memory, 0, grown_size), "the creator still sees its contents");
+  }
+
+  void test_locked()
+  {
+    sasm::Shared_Memory memory;
+    check(create_fresh(memory, scratch_name, grown_size, sasm::Memory_Flags::prefault | sasm::Memory_Flags::lock_in_memory), "a prefaulted locked segment is created");
+    check(memory.is_locked() && resident(memory), "it is locked and resident");
+    check(memory.get_populate_time().count() > 0, "populating it took measurable time");
+
+    // Over the limit, mlock fails and is_locked() says so instead of pretending
+    struct rlimit limit;
+    getrlimit(RLIMIT_MEMLOCK, &limit);
+
+    if (geteuid() != 0 && limit.rlim_cur != RLIM_INFINITY)
+    {
+      sasm::Shared_Memory huge;
+      check(create_fresh(huge, spare_name, limit.rlim_cur * 2, sasm::Memory_Flags::lock_in_memory) && !huge.is_locked(), "a segment over RLIMIT_MEMLOCK isn't reported locked");
+    }
+  }
+
+  void test_growth_populates_tail()
+  {
+    sasm::Shared_Memory memory;
+    check(create_fresh(memory, scratch_name, small_size, sasm::Memory_Flags::growable | sasm::Memory_Flags::prefault | sasm::Memory_Flags::lock_in_memory), "a growable prefaulted locked segment is created");
+    std::size_t old_size = memory.get_size();
+    fill_pages(memory, 0, old_size);
+    std::chrono::nanoseconds created = memory.get_populate_time();
+
+    check(memory.resize(regrown_size), "it grows");
+    check(pages_filled(memory, 0, old_size), "growing keeps the old contents");
+    check(resident(memory) && memory.is_locked(), "the grown segment is resident and still locked");
+    check(memory.get_populate_time() > created, "populating the tail adds to the populate time");
+
+    // A peer following the growth maps the new tail and keeps the old contents
+    reset_control();
+
+    pid_t child = spawn([old_size]
+    {
+      sasm::Shared_Memory* peer = new sasm::Shared_Memory(scratch_name, small_size, sasm::Memory_Flags::growable);
+      control->attached.store(1);
+
+      if (peer->get_address() == nullptr || !wait_until(control->grown, 1) || !peer->refresh())
+      {
+        return false;
+      }
+
+      return peer->get_size() >= grown_size * 4 && bytes(*peer)[grown_size * 4 - 1] == 0xaa && pages_filled(*peer, 0, old_size);
+    });
+
+    check(wait_until(control->attached, 1), "a peer attached");
+    check(memory.resize(grown_size * 4), "it grows again");
+    bytes(memory)[grown_size * 4 - 1] = 0xaa;
+    control->grown.store(1);
+    check(succeeded(child), "a peer refreshing to the new size sees the old contents and the new tail");
+  }
+}
+
+int main()
+{
+  begin();
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+
+  test_fixed_size();
+  test_resize_and_refresh();
+  test_attach_to_grown();
+  test_sent_over_socket();
+  test_seals();
+  test_growable_sent();
+  test_transparent_fallback();
+  test_hugetlbfs();
+  test_redirect();
+  test_plain_reports();
+  test_prefault_keeps_contents();
+  test_locked();
+  test_growth_populates_tail();
+
+  return finish("shared_memory_test");
+}
@@ -0,0 +1,145 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Spsc_Ring: capacity rounding, full and empty edges, refusing a
+// mismatched capacity or one whose ring would not fit a size_t, and FIFO order for a stream
+// crossing from a child producer to the parent.
+
+#include "test_util.h"
+
+#include <cstdio>
+
+using namespace sasm_test;
+
+namespace
+{
+  const char* const ring_name{ "/sasm_spsc_ring_test" };
+  constexpr std::size_t ring_capacity{ 6 }; // Rounded up to 8
+
+  // Runs body in a child process on its own ring attached by name, which it never destroys
+  template <typename Body>
+  pid_t spawn_attached(Body&& body)
+  {
+    return spawn([&body]
+    {
+      sasm::Spsc_Ring<std::uint64_t>* ring = new sasm::Spsc_Ring<std::uint64_t>(ring_name, ring_capacity);
+      return ring->capacity() != 0 && body(*ring);
+    });
+  }
+
+  void test_edges(sasm::Spsc_Ring<std::uint64_t>& ring)
+  {
+    std::uint64_t value = 0;
+
+    check(ring.capacity() == 8, "capacity rounds up to a power of two");
+    check(ring.empty() && ring.size() == 0, "a new ring is empty");
+    check(!ring.try_pop(value), "popping an empty ring fails");
+
+    for (std::uint64_t i = 0; i < 8; ++i)
+    {
+      check(ring.try_push(i), "pushing up to capacity succeeds");
+    }
+
+    check(ring.size() == 8, "size reaches capacity");
+    check(!ring.try_push(99), "pushing a full ring fails");
+    check(ring.try_pop(value) && value == 0, "pop returns the oldest value");
+    check(ring.try_push(8), "one pop frees one slot");
+    check(!ring.try_push(99), "and the ring is full again");
+
+    for (std::uint64_t i = 1; i <= 8; ++i)
+    {
+      check(ring.try_pop(value) && value == i, "values come out in order across the wrap");
+    }
+
+    check(ring.empty() && !ring.try_pop(value), "the ring is empty again");
+  }
+
+  void test_mismatch()
+  {
+    // Neither may unlink or shrink the ring, test_cross_process() attaches to it by name afterwards
+    sasm::Spsc_Ring<std::uint64_t> other;
+    check(!other.create(ring_name, 64), "attaching with a larger capacity fails");
+    check(!other.create(ring_name, 2), "attaching with a smaller capacity fails");
+  }
+
+  void test_overflow()
+  {
+    // Capacities whose ring would not fit a size_t, none may leave an object behind
+    const char* const name = "/sasm_spsc_ring_test_overflow";
+    sasm::Spsc_Ring<std::uint64_t> huge;
+    check(!huge.create(name, SIZE_MAX), "a capacity with no power of two above it fails");
+    check(!huge.create(name, SIZE_MAX / 2 + 1), "a capacity whose slots wrap a size_t fails");
+    check(!huge.create(name, SIZE_MAX / sizeof(std::uint64_t)), "a capacity that rounds up into a wrap fails");
+    check(shm_open(name, O_RDONLY, 0) == -1, "the failed creates leave nothing behind");
+  }
+
+  void test_cross_process(sasm::Spsc_Ring<std::uint64_t>& ring)
+  {
+    constexpr std::uint64_t count = 200000;
+
+    // Child produces, the parent consumes, so both the full and empty paths get exercised
+    pid_t child = spawn_attached([](sasm::Spsc_Ring<std::uint64_t>& shared)
+    {
+      for (std::uint64_t i = 0; i < count;)
+      {
+        if (shared.try_push(i))
+        {
+          ++i;
+        }
+        else
+        {
+          std::this_thread::yield();
+        }
+      }
+
+      return true;
+    });
+
+    std::uint64_t expected = 0;
+    bool ordered = true;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+
+    while (expected < count && std::chrono::steady_clock::now() < deadline)
+    {
+      std::uint64_t value;
+
+      if (ring.try_pop(value))
+      {
+        ordered = ordered && value == expected;
+        ++expected;
+      }
+      else
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    check(succeeded(child), "the producing child exits cleanly");
+    check(expected == count, "every value crosses the process boundary");
+    check(ordered, "values arrive in FIFO order");
+    check(ring.empty(), "nothing is left behind");
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink(ring_name);
+
+  sasm::Spsc_Ring<std::uint64_t> ring(ring_name, ring_capacity);
+
+  if (ring.capacity() == 0)
+  {
+    std::printf("FAIL: could not create the ring\n");
+    return 1;
+  }
+
+  test_edges(ring);
+  test_mismatch();
+  test_overflow();
+  test_cross_process(ring);
+
+  return finish("spsc_ring_test");
+}
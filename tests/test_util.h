@@ -0,0 +1,134 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Helpers shared by the fork based behaviour tests. Every test is a plain program that prints one
+// line per failed check and exits non-zero if any failed; `make check` builds and runs them all.
+
+#ifndef SASM_TEST_UTIL_H
+#define SASM_TEST_UTIL_H
+
+#include "sasm.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <new>
+#include <thread>
+
+namespace sasm_test
+{
+  inline int failures{ 0 };
+
+  inline void check(bool condition, const char* what)
+  {
+    if (!condition)
+    {
+      std::printf("FAIL: %s\n", what);
+      ++failures;
+    }
+  }
+
+  // Runs body() in a child process that leaves with _exit(body() ? 0 : 1). The child never returns
+  // into the caller, so none of the parent's objects get destroyed there: closing a named
+  // primitive unlinks its name, which would pull it out from under the parent.
+  template <typename Body>
+  pid_t spawn(Body&& body)
+  {
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+      _exit(body() ? 0 : 1);
+    }
+
+    return child;
+  }
+
+  // Reaps a child, true if it exited with 0. Kills it if it is still running after 30 s.
+  inline bool succeeded(pid_t child)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    int status = 0;
+    pid_t result = 0;
+
+    while (child > 0 && (result = waitpid(child, &status, WNOHANG)) == 0)
+    {
+      if (std::chrono::steady_clock::now() > deadline)
+      {
+        kill(child, SIGKILL);
+        waitpid(child, &status, 0);
+        return false;
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return result == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  // Maps size zero filled bytes the children inherit across fork(), nullptr if that fails. Never
+  // unmapped, the tests hand these out for the life of the process.
+  inline void* shared_mapping(std::size_t size)
+  {
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return address == MAP_FAILED ? nullptr : address;
+  }
+
+  // A value initialized T in a shared_mapping()
+  template <typename T>
+  T* shared_block()
+  {
+    void* address = shared_mapping(sizeof(T));
+    return address == nullptr ? nullptr : new (address) T{};
+  }
+
+  // Spins until word reaches value, giving up after 10 s so a broken peer fails the test instead
+  // of hanging it
+  inline bool wait_until(const std::atomic<std::uint32_t>& word, std::uint32_t value)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    while (word.load() < value)
+    {
+      if (std::chrono::steady_clock::now() > deadline)
+      {
+        return false;
+      }
+
+      std::this_thread::yield();
+    }
+
+    return true;
+  }
+
+  inline long long elapsed_ms(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // Unbuffered, so the output of a test that gets killed or forks isn't lost or repeated
+  inline void begin()
+  {
+    std::setvbuf(stdout, nullptr, _IONBF, 0);
+  }
+
+  // Prints the summary line, returns main()'s exit code
+  inline int finish(const char* test_name)
+  {
+    if (failures != 0)
+    {
+      std::printf("%s: %d checks failed\n", test_name, failures);
+      return 1;
+    }
+
+    std::printf("%s: all checks passed\n", test_name);
+    return 0;
+  }
+}
+
+#endif
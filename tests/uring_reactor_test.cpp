@@ -0,0 +1,322 @@
+// Copyright (c) [2024] [Jovan J. E. Odassius]
+//
+// License: MIT (See the LICENSE file in the root directory)
+// Github: https://github.com/untyper/semaphores-and-shared-memory-classes
+
+// Fork based behaviour tests for Uring_Reactor, run once on io_uring (when the kernel has futex
+// support for it) and once on the epoll fallback forced through Backend::fallback: futex waits
+// completed by increments from another process, Semaphore waits and an empty Semaphore being
+// ignored, Event_Notifier waits, run_once() timing out, increment() holding wakes back until the
+// next run_once(), more waits than one futex_waitv() call or a small submission queue can hold,
+// and close() dropping pending waits.
+
+#include "test_util.h"
+
+#include <cstdio>
+#include <new>
+#include <string>
+
+using namespace sasm_test;
+
+namespace
+{
+  // More than the 127 words one futex_waitv() call watches next to the control word
+  constexpr std::size_t word_count{ 200 };
+  const char* const semaphore_name{ "/sasm_uring_reactor_test" };
+
+  // Shared with the children through an anonymous mapping inherited across fork()
+  struct Control
+  {
+    sasm::Futex_Semaphore semaphores[word_count];
+    std::atomic<std::uint32_t> started;
+  };
+
+  Control* control{ nullptr };
+  const char* backend_name{ "" };
+
+  // check() with the backend under test in front
+  void expect(bool condition, const char* what)
+  {
+    std::string line = std::string(backend_name) + ": " + what;
+    check(condition, line.c_str());
+  }
+
+  void reset_control()
+  {
+    for (sasm::Futex_Semaphore& semaphore : control->semaphores)
+    {
+      while (semaphore.try_wait())
+      {
+      }
+    }
+
+    control->started.store(0);
+  }
+
+  // Runs the reactor until callbacks reaches target, giving up after 10 s
+  bool run_until(sasm::Uring_Reactor& reactor, const std::size_t& callbacks, std::size_t target)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    while (callbacks < target && std::chrono::steady_clock::now() < deadline)
+    {
+      reactor.run_once(100);
+    }
+
+    return callbacks == target;
+  }
+
+  // Forks a child that sleeps a little, then increments semaphores [first, last)
+  pid_t spawn_incrementer(std::size_t first, std::size_t last)
+  {
+    return spawn([first, last]
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      bool incremented = true;
+
+      for (std::size_t i = first; i < last; ++i)
+      {
+        incremented = control->semaphores[i].increment() && incremented;
+      }
+
+      return incremented;
+    });
+  }
+
+  void test_futex_waits(sasm::Uring_Reactor& reactor)
+  {
+    reset_control();
+    std::size_t callbacks = 0;
+    sasm::Futex_Semaphore& ready = control->semaphores[0];
+    sasm::Futex_Semaphore& later = control->semaphores[1];
+
+    ready.increment();
+    reactor.async_wait(ready, [&callbacks] { ++callbacks; });
+    expect(reactor.run_once(1000) == 1 && callbacks == 1, "a wait on an available count completes on the next run");
+    expect(ready.get_count() == 0 && ready.get_waiters() == 0, "the callback took the count and deregistered");
+
+    reactor.async_wait(later, [&callbacks] { ++callbacks; });
+    expect(reactor.run_once(0) == 0 && later.get_waiters() == 1, "a wait on an empty count stays pending");
+
+    pid_t child = spawn_incrementer(1, 2);
+    expect(run_until(reactor, callbacks, 2), "an increment from another process completes the wait");
+    expect(succeeded(child), "the incrementing child exits");
+    expect(later.get_count() == 0 && later.get_waiters() == 0, "and the callback took that count");
+  }
+
+  void test_timeout(sasm::Uring_Reactor& reactor)
+  {
+    reset_control();
+    std::size_t callbacks = 0;
+    sasm::Futex_Semaphore& semaphore = control->semaphores[2];
+    reactor.async_wait(semaphore, [&callbacks] { ++callbacks; });
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t ran = reactor.run_once(100);
+    long long waited = elapsed_ms(start);
+    expect(ran == 0 && callbacks == 0, "run_once(100) without any count runs nothing");
+    expect(waited >= 99 && waited < 2000, "run_once(100) takes about 100 ms");
+
+    // The wait survives the timeout
+    semaphore.increment();
+    expect(run_until(reactor, callbacks, 1), "the wait completes after a timed out run");
+  }
+
+  void test_semaphore(sasm::Uring_Reactor& reactor)
+  {
+    std::size_t callbacks = 0;
+    sasm::Semaphore empty;
+    reactor.async_wait(empty, [&callbacks] { ++callbacks; });
+    expect(reactor.run_once(0) == 0 && callbacks == 0, "a wait on an empty Semaphore is ignored");
+
+    sasm::Semaphore semaphore(semaphore_name);
+    reactor.async_wait(semaphore, [&callbacks] { ++callbacks; });
+    expect(reactor.run_once(0) == 0, "a wait on a Semaphore with no count stays pending");
+
+    pid_t child = spawn([]
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      sasm::Semaphore* shared = new sasm::Semaphore(semaphore_name);
+      return shared->get_object() != nullptr && shared->increment();
+    });
+
+    expect(run_until(reactor, callbacks, 1), "a Semaphore incremented by name from another process completes the wait");
+    expect(succeeded(child), "the child opened the Semaphore by name");
+  }
+
+  void test_notifier(sasm::Uring_Reactor& reactor)
+  {
+    std::size_t callbacks = 0;
+    sasm::Event_Notifier notifier(0);
+
+    // Two waits on one notifier, each needs its own count
+    reactor.async_wait(notifier, [&callbacks] { ++callbacks; });
+    reactor.async_wait(notifier, [&callbacks] { ++callbacks; });
+    expect(reactor.run_once(0) == 0, "waits on an Event_Notifier with no count stay pending");
+
+    pid_t child = spawn([&notifier]
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      return notifier.increment();
+    });
+
+    expect(run_until(reactor, callbacks, 1), "an increment from another process completes one notifier wait");
+    expect(succeeded(child), "the notifying child exits");
+    expect(reactor.run_once(50) == 0 && callbacks == 1, "the other wait needs a second count");
+
+    notifier.increment();
+    expect(run_until(reactor, callbacks, 2) && !notifier.try_wait(), "which completes it");
+  }
+
+  void test_increment_batching(sasm::Uring_Reactor& reactor)
+  {
+    reset_control();
+    constexpr std::size_t children = 4;
+    pid_t pids[children];
+
+    for (std::size_t i = 0; i < children; ++i)
+    {
+      pids[i] = spawn([i]
+      {
+        control->started.fetch_add(1);
+        return control->semaphores[10 + i].wait(10000);
+      });
+    }
+
+    // Wait until every child sleeps in the kernel
+    bool sleeping = wait_until(control->started, children);
+
+    for (std::size_t i = 0; i < children; ++i)
+    {
+      while (sleeping && control->semaphores[10 + i].get_waiters() == 0)
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    bool incremented = true;
+
+    for (std::size_t i = 0; i < children; ++i)
+    {
+      incremented = reactor.increment(control->semaphores[10 + i]) && incremented;
+    }
+
+    expect(sleeping && incremented, "increment() through the reactor succeeds");
+
+    // io_uring queues the wakes with the next batch, the fallback wakes right away
+    if (reactor.uses_io_uring())
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      int status = 0;
+      bool still_asleep = true;
+
+      for (pid_t pid : pids)
+      {
+        still_asleep = still_asleep && waitpid(pid, &status, WNOHANG) == 0;
+      }
+
+      expect(still_asleep, "queued wakes wait for the next run_once()");
+      reactor.run_once(0);
+    }
+
+    bool all = true;
+
+    for (pid_t pid : pids)
+    {
+      all = succeeded(pid) && all;
+    }
+
+    expect(all, "every child woken through the reactor takes its count");
+
+    sasm::Futex_Semaphore& unwatched = control->semaphores[20];
+    expect(reactor.increment(unwatched, 3) && unwatched.get_count() == 3, "increment() without waiters only adds");
+    expect(!reactor.increment(unwatched, 0) && unwatched.get_count() == 3, "increment(0) is rejected");
+  }
+
+  void test_many_words(sasm::Uring_Reactor::Backend backend)
+  {
+    reset_control();
+
+    // On io_uring the waits don't fit the submission queue, on the fallback not in one futex_waitv()
+    sasm::Uring_Reactor reactor(8, backend);
+    std::size_t callbacks = 0;
+
+    for (sasm::Futex_Semaphore& semaphore : control->semaphores)
+    {
+      reactor.async_wait(semaphore, [&callbacks] { ++callbacks; });
+    }
+
+    expect(reactor.run_once(0) == 0, "200 pending waits run nothing");
+
+    // The last words registered are the ones past the first 127
+    pid_t child = spawn_incrementer(word_count - 50, word_count);
+    expect(run_until(reactor, callbacks, 50), "increments on the words past the first 127 complete their waits");
+    expect(succeeded(child), "the child incremented them");
+
+    child = spawn_incrementer(0, word_count - 50);
+    expect(run_until(reactor, callbacks, word_count), "every one of 200 waits completes");
+    expect(succeeded(child), "the child incremented the rest");
+
+    bool drained = true;
+
+    for (sasm::Futex_Semaphore& semaphore : control->semaphores)
+    {
+      drained = drained && semaphore.get_count() == 0 && semaphore.get_waiters() == 0;
+    }
+
+    expect(drained, "each callback took exactly its own count");
+  }
+
+  void test_close(sasm::Uring_Reactor& reactor)
+  {
+    reset_control();
+    std::size_t callbacks = 0;
+    sasm::Futex_Semaphore& semaphore = control->semaphores[30];
+    reactor.async_wait(semaphore, [&callbacks] { ++callbacks; });
+    expect(semaphore.get_waiters() == 1, "a pending wait registers as a waiter");
+
+    reactor.close();
+    expect(semaphore.get_waiters() == 0, "close() deregisters pending waits");
+    expect(reactor.get_fd() == -1 && reactor.run_once(0) == 0, "a closed reactor runs nothing");
+
+    semaphore.increment();
+    expect(callbacks == 0 && semaphore.get_count() == 1, "and never runs their callbacks");
+  }
+
+  void test_backend(sasm::Uring_Reactor::Backend backend)
+  {
+    sasm::Uring_Reactor reactor(256, backend);
+    backend_name = reactor.uses_io_uring() ? "io_uring" : "fallback";
+
+    expect(reactor.get_fd() != -1, "create() succeeds");
+    expect(backend == sasm::Uring_Reactor::Backend::automatic || !reactor.uses_io_uring(), "Backend::fallback never uses io_uring");
+
+    test_futex_waits(reactor);
+    test_timeout(reactor);
+    test_semaphore(reactor);
+    test_notifier(reactor);
+    test_increment_batching(reactor);
+    test_many_words(backend);
+    test_close(reactor);
+  }
+}
+
+int main()
+{
+  begin();
+  shm_unlink((std::string(semaphore_name) + ".sem").c_str());
+
+  control = shared_block<Control>();
+
+  if (control == nullptr)
+  {
+    std::printf("FAIL: could not create the shared control block\n");
+    return 1;
+  }
+
+  test_backend(sasm::Uring_Reactor::Backend::automatic);
+  test_backend(sasm::Uring_Reactor::Backend::fallback);
+
+  return finish("uring_reactor_test");
+}